@@ -0,0 +1,13 @@
+// generated by CodeGenManager::GenerateExpressionHeader()
+#pragma once
+
+#include "sdfexpr.hpp"
+
+namespace GeneratedScene {
+
+	typedef sdf::Difference<sdf::Box, sdf::Sphere> Scene;
+
+	// scene(x, y, z), scene.Id(x, y, z), scene.Bound()
+	constexpr Scene scene = sdf::Difference<sdf::Box, sdf::Sphere>(sdf::Box(0.7f, 0), sdf::Sphere(1.0f, 1));
+
+}
@@ -1,4 +1,12 @@
 #include "appstate.hpp"
 
 // singletonΪﻹҪ
-const std::string AppState::OutputShaderName = std::string("Output.fragmentshader");
\ No newline at end of file
+const std::string AppState::OutputShaderName = std::string("Output.fragmentshader");
+const std::string AppState::OutputMarchShaderName = std::string("OutputMarch.fragmentshader");
+const std::string AppState::OutputComputeShaderName = std::string("OutputCompute.computeshader");
+const std::string AppState::OutputSweepVertexShaderName = std::string("OutputSweep.vertexshader");
+const std::string AppState::OutputSweepShaderName = std::string("OutputSweep.fragmentshader");
+const std::string AppState::ShadingShaderName = std::string("Shading.fragmentshader");
+const std::string AppState::GraphFileName = std::string("graph.txt");
+const std::string AppState::OutputExpressionHeaderName = std::string("OutputScene.hpp");
+const std::string AppState::NativeScenePrefix = std::string("NativeScene_");
\ No newline at end of file
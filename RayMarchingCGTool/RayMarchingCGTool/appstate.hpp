@@ -12,6 +12,14 @@
 struct AppState {
 
 	static const std::string OutputShaderName;
+	static const std::string OutputMarchShaderName; // deferred march pass
+	static const std::string OutputComputeShaderName; // compute backend
+	static const std::string OutputSweepVertexShaderName; // parameter sweep (instanced tiles)
+	static const std::string OutputSweepShaderName;
+	static const std::string ShadingShaderName; // deferred shading pass (hand-written)
+	static const std::string GraphFileName; // Ctrl+S in the diagram window
+	static const std::string OutputExpressionHeaderName; // the graph as an sdfexpr.hpp type expression
+	static const std::string NativeScenePrefix; // native backend sources & libraries, followed by the source hash
 
 	static AppState &getInstance() {
 		static AppState instance;
@@ -30,8 +38,52 @@ struct AppState {
 	bool isRunning;
 	thrd_t uiThreadID;
 
+	// Command line options (see ParseCommandLine)
+	bool headless; // render frames to files without any visible window
+	bool poster; // headless: one frame of any size, rendered in tiles and streamed to a PPM file
+	bool cpu; // headless: render with the CPU reference raymarcher, no GL context at all
+	bool benchmark; // headless cpu: thread scaling benchmark instead of writing frames
+	int numThreads; // CPU rendering threads (0: one per core)
+	std::string simd; // CPU packet kernels: none, sse, avx2 or avx512 (empty: the best the cpu has)
+	bool benchmarkSimd; // headless cpu: packet kernels against the scalar march instead of writing frames
+	bool benchmarkQuery; // headless cpu: SdfQuery points per second instead of writing frames
+	std::string meshFile; // headless cpu: marching cubes export of the graph (.stl, .ply or .obj) instead of writing frames
+	int meshResolution; // mesh export: cells along the longest side of the scene bounds
+	bool meshDense; // mesh export: sample every cell corner instead of the octree leaves (baseline)
+	std::string volumeFile; // headless cpu: chunked distance volume export instead of writing frames
+	int volumeResolution; // volume export: samples along the longest side of the scene bounds
+	int volumeRegion[6]; // x, y, z, w, h, d: read this region of volumeFile back instead of exporting (w = 0: export)
+	bool validate; // headless cpu: check that the distance functions are distance bounds instead of writing frames
+	int validateSamples; // bound validation: random points per function
+	std::string graphFile; // loaded at startup when not empty
+	float autoBakeCost; // time-invariant subtrees costlier than this (estimated ALU ops per step) are baked; 0: never (default)
+	int outputWidth, outputHeight;
+	int numFrames;
+	float startTime, timeStep; // frame i is rendered at startTime + i * timeStep
+	std::string outputPattern; // printf pattern taking the frame number
+
 private:
-	AppState() { isRunning = false; }
+	AppState() {
+		isRunning = false;
+		headless = false;
+		poster = false;
+		cpu = false;
+		benchmark = false;
+		numThreads = 0;
+		benchmarkSimd = false;
+		benchmarkQuery = false;
+		meshResolution = 256;
+		meshDense = false;
+		volumeResolution = 512;
+		for (int i = 0; i < 6; i++) volumeRegion[i] = 0;
+		validate = false;
+		validateSamples = 1 << 21;
+		autoBakeCost = 0.0f;
+		outputWidth = 1280; outputHeight = 720;
+		numFrames = 1;
+		startTime = 0.0f; timeStep = 1.0f / 30.0f;
+		outputPattern = "frame_%04d.ppm";
+	}
 };
 
 
@@ -0,0 +1,112 @@
+#include "asyncshaderloader.hpp"
+
+// Include standard headers
+#include <stdio.h>
+
+#include "shader.hpp"
+
+AsyncShaderLoader::AsyncShaderLoader() :
+	window(NULL), threadRunning(false),
+	requestSerial(0), startedSerial(0), linkedSerial(0), linkedProgram(0), stopping(false)
+{
+	mtx_init(&mutex, mtx_plain);
+	cnd_init(&requestAvailable);
+}
+
+AsyncShaderLoader::~AsyncShaderLoader() {
+	Stop();
+	cnd_destroy(&requestAvailable);
+	mtx_destroy(&mutex);
+}
+
+bool AsyncShaderLoader::SetupRC(GLFWwindow *sharedWith) {
+	// the context hints of the shared window are still current
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	window = glfwCreateWindow(64, 64, "RaymarchingCGTool shader loader", NULL, sharedWith);
+	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+	if (!window)
+		fprintf(stderr, "No shared context, shaders will be compiled on the rendering thread\n");
+	return window != NULL;
+}
+
+void AsyncShaderLoader::DestroyRC() {
+	Stop();
+	glfwDestroyWindow(window);
+	window = NULL;
+}
+
+void AsyncShaderLoader::Request(const std::string &vertexFile, const std::string &fragmentFile) {
+	mtx_lock(&mutex);
+	this->vertexFile = vertexFile;
+	this->fragmentFile = fragmentFile;
+	requestSerial++;
+	stopping = false;
+	cnd_signal(&requestAvailable);
+	mtx_unlock(&mutex);
+
+	// the worker is started on first use
+	if (!threadRunning)
+		threadRunning = thrd_create(&thread, ThreadMain, this) == thrd_success;
+}
+
+bool AsyncShaderLoader::Poll(GLuint &program) {
+	bool linked = false;
+	mtx_lock(&mutex);
+	if (linkedSerial == requestSerial && linkedSerial > 0) {
+		program = linkedProgram;
+		linkedProgram = 0;
+		linkedSerial = 0;
+		linked = true;
+	}
+	mtx_unlock(&mutex);
+	return linked;
+}
+
+void AsyncShaderLoader::Stop() {
+	if (!threadRunning)
+		return;
+	mtx_lock(&mutex);
+	stopping = true;
+	cnd_signal(&requestAvailable);
+	mtx_unlock(&mutex);
+
+	int result;
+	thrd_join(thread, &result);
+	threadRunning = false;
+}
+
+int AsyncShaderLoader::ThreadMain(void *data) {
+	AsyncShaderLoader *loader = (AsyncShaderLoader *)data;
+	glfwMakeContextCurrent(loader->window);
+
+	mtx_lock(&loader->mutex);
+	while (true) {
+		while (loader->startedSerial == loader->requestSerial && !loader->stopping)
+			cnd_wait(&loader->requestAvailable, &loader->mutex);
+		if (loader->stopping)
+			break;
+		int serial = loader->startedSerial = loader->requestSerial;
+		std::string vertexFile = loader->vertexFile, fragmentFile = loader->fragmentFile;
+		mtx_unlock(&loader->mutex);
+
+		GLuint program = LoadShaders(vertexFile.c_str(), fragmentFile.c_str());
+		glFinish(); // the program is complete before another context uses it
+
+		mtx_lock(&loader->mutex);
+		if (serial == loader->requestSerial) {
+			glDeleteProgram(loader->linkedProgram); // never polled
+			loader->linkedProgram = program;
+			loader->linkedSerial = serial;
+		}
+		else glDeleteProgram(program); // superseded while linking
+	}
+
+	// unpolled programs die with the loader
+	glDeleteProgram(loader->linkedProgram);
+	loader->linkedProgram = 0;
+	loader->linkedSerial = 0;
+	mtx_unlock(&loader->mutex);
+
+	glfwMakeContextCurrent(NULL);
+	return 0;
+}
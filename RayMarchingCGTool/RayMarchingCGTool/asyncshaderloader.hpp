@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef ASYNCSHADERLOADER_HPP
+#define ASYNCSHADERLOADER_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include "tinythread.hpp"
+
+// Links programs on a worker thread owning a hidden context that shares its objects with a window:
+// the window's rendering thread keeps drawing while the driver compiles
+class AsyncShaderLoader {
+
+public:
+	AsyncShaderLoader();
+	~AsyncShaderLoader();
+
+	// main thread (GLFW windows); false: no shared context, programs must be loaded synchronously
+	bool SetupRC(GLFWwindow *sharedWith);
+	void DestroyRC(); // stops the worker first
+
+	bool IsAvailable() const { return window != NULL; }
+
+	// rendering thread of the shared window
+	void Request(const std::string &vertexFile, const std::string &fragmentFile); // supersedes a pending request
+	bool Poll(GLuint &program); // true once per request: the linked program, owned by the caller
+
+	void Stop();
+
+private:
+	static int ThreadMain(void *data);
+
+	GLFWwindow *window;
+	thrd_t thread;
+	bool threadRunning;
+
+	// everything below is guarded by mutex
+	mtx_t mutex;
+	cnd_t requestAvailable;
+	std::string vertexFile, fragmentFile;
+	int requestSerial; // latest request
+	int startedSerial; // latest request taken by the worker
+	int linkedSerial; // request of linkedProgram
+	GLuint linkedProgram; // 0: nothing to poll
+	bool stopping;
+};
+
+
+#endif
@@ -0,0 +1,128 @@
+#include "bakescheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+
+BakeScheduler::BakeScheduler() : threadRunning(false), finished(false), runningOwner(-1), stopping(false) {
+	mtx_init(&mutex, mtx_plain);
+	cnd_init(&jobAvailable);
+	cnd_init(&jobDone);
+}
+
+BakeScheduler::~BakeScheduler() {
+	Stop();
+	cnd_destroy(&jobDone);
+	cnd_destroy(&jobAvailable);
+	mtx_destroy(&mutex);
+}
+
+void BakeScheduler::Request(int owner, const std::string &key, const CpuScene &scene, int resolution) {
+	mtx_lock(&mutex);
+	// a finished or running bake of the same request will do, the other ones of the owner are stale
+	auto result = results.find(owner);
+	bool pending = (result != results.end() && result->second.key == key) || (runningOwner == owner && runningKey == key);
+	if (result != results.end() && result->second.key != key)
+		results.erase(result);
+	for (auto it = jobs.begin(); it != jobs.end();) {
+		if (it->owner != owner)
+			++it;
+		else if (it->key == key) {
+			pending = true;
+			++it;
+		}
+		else it = jobs.erase(it);
+	}
+	if (!pending) {
+		Job job;
+		job.owner = owner;
+		job.key = key;
+		job.scene = scene;
+		job.resolution = resolution;
+		jobs.push_back(job);
+		stopping = false;
+		cnd_signal(&jobAvailable);
+	}
+	mtx_unlock(&mutex);
+
+	// the worker is started on first use
+	if (!threadRunning)
+		threadRunning = thrd_create(&thread, ThreadMain, this) == thrd_success;
+}
+
+bool BakeScheduler::Take(int owner, const std::string &key, BrickMap &map) {
+	bool taken = false;
+	mtx_lock(&mutex);
+	auto result = results.find(owner);
+	if (result != results.end() && result->second.key == key) {
+		std::swap(map, result->second.map);
+		results.erase(result);
+		taken = true;
+	}
+	mtx_unlock(&mutex);
+	return taken;
+}
+
+void BakeScheduler::Cancel(int owner) {
+	mtx_lock(&mutex);
+	results.erase(owner);
+	for (auto it = jobs.begin(); it != jobs.end();)
+		it = it->owner == owner ? jobs.erase(it) : it + 1;
+	if (runningOwner == owner)
+		runningKey.clear(); // its result is dropped when it finishes
+	mtx_unlock(&mutex);
+}
+
+void BakeScheduler::Wait() {
+	mtx_lock(&mutex);
+	while (threadRunning && (!jobs.empty() || runningOwner >= 0))
+		cnd_wait(&jobDone, &mutex);
+	mtx_unlock(&mutex);
+}
+
+void BakeScheduler::Stop() {
+	if (!threadRunning)
+		return;
+	mtx_lock(&mutex);
+	stopping = true;
+	jobs.clear();
+	cnd_signal(&jobAvailable);
+	mtx_unlock(&mutex);
+
+	int result;
+	thrd_join(thread, &result);
+	threadRunning = false;
+}
+
+int BakeScheduler::ThreadMain(void *data) {
+	BakeScheduler *scheduler = (BakeScheduler *)data;
+	// leave a core to the rendering thread
+	int numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	mtx_lock(&scheduler->mutex);
+	while (true) {
+		while (scheduler->jobs.empty() && !scheduler->stopping)
+			cnd_wait(&scheduler->jobAvailable, &scheduler->mutex);
+		if (scheduler->stopping)
+			break;
+		Job job = scheduler->jobs.front();
+		scheduler->jobs.pop_front();
+		scheduler->runningOwner = job.owner;
+		scheduler->runningKey = job.key;
+		mtx_unlock(&scheduler->mutex);
+
+		Result result;
+		result.key = job.key;
+		result.map.Bake(job.scene, job.resolution, numThreads);
+
+		mtx_lock(&scheduler->mutex);
+		if (scheduler->runningKey == job.key)
+			std::swap(scheduler->results[job.owner], result);
+		scheduler->runningOwner = -1;
+		scheduler->finished = true;
+		cnd_broadcast(&scheduler->jobDone);
+	}
+	scheduler->runningOwner = -1;
+	cnd_broadcast(&scheduler->jobDone);
+	mtx_unlock(&scheduler->mutex);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef BAKESCHEDULER_HPP
+#define BAKESCHEDULER_HPP
+
+#include <string>
+#include <deque>
+#include <map>
+#include <atomic>
+#include "tinythread.hpp"
+
+#include "cpuscene.hpp"
+#include "brickmap.hpp"
+
+// Bakes brick maps on a worker thread, so the thread running codegen never waits for them: the
+// generated code stays analytic until the bake is taken (CodeGenManager::UpdateBakes) and compiled
+// again. An owner (the id of the block the bake replaces) has at most one request in flight.
+class BakeScheduler {
+
+public:
+	static BakeScheduler &getInstance() {
+		static BakeScheduler instance;
+		return instance;
+	}
+
+	// main thread
+	void Request(int owner, const std::string &key, const CpuScene &scene, int resolution); // key: identifies scene and resolution
+	bool Take(int owner, const std::string &key, BrickMap &map); // the finished bake of the request, once
+	void Cancel(int owner); // drops the pending request and the finished bake of the owner
+	void Wait(); // until every request is baked (headless)
+	void Stop(); // pending requests are dropped
+
+	// any thread: true once after bakes finished
+	bool PollFinished() { return finished.exchange(false); }
+
+private:
+	BakeScheduler();
+	~BakeScheduler();
+
+	static int ThreadMain(void *data);
+
+	struct Job {
+		int owner;
+		std::string key;
+		CpuScene scene;
+		int resolution;
+	};
+	struct Result {
+		std::string key;
+		BrickMap map;
+	};
+
+	thrd_t thread;
+	bool threadRunning;
+	std::atomic<bool> finished;
+
+	// everything below is guarded by mutex
+	mtx_t mutex;
+	cnd_t jobAvailable;
+	cnd_t jobDone;
+	std::deque<Job> jobs;
+	int runningOwner; // -1: idle
+	std::string runningKey;
+	std::map<int, Result> results; // by owner, until taken
+	bool stopping;
+};
+
+
+#endif
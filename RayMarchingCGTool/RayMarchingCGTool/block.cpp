@@ -1,18 +1,67 @@
 #include "block.hpp"
 
 #include "renderingtarget.hpp"
+#include "codegen.hpp"
+#include "cpuscene.hpp"
+#include "brickmap.hpp"
+#include "bakescheduler.hpp"
+#include "thumbnailcache.hpp"
 #include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+int Block::nextId = 0;
 
 Block::Block(int numIn, int numOut) :
+	id(nextId++),
 	numInput(numIn), srcBlocks(numIn, NULL),
 	numOutput(numOut), dstBlocks(numOut, NULL),
 	renderRec(0, 0, BlockDefaultSize + 2 * BlockDefaultPortLength, BlockDefaultSize)
 	{  }
 
+Block *Block::Create(const std::string &typeName) {
+	if (typeName == "Sphere") return new SphereBlock();
+	if (typeName == "Box") return new BoxBlock();
+	if (typeName == "Screen") return new ScreenBlock();
+	if (typeName == "BoolDifference") return new BoolDifferenceBlock();
+	if (typeName == "Baked") return new BakedBlock();
+	return NULL;
+}
+
+std::string Block::GenerateParam(int paramIdx) {
+	return CodeGenManager::getInstance().GenerateParam(this, paramIdx);
+}
+
+std::string Block::GenerateInputCallsite(int inputIdx) {
+	return CodeGenManager::getInstance().GenerateCallsite(srcBlocks[inputIdx]->from);
+}
+
+bool Block::IsTimeDependent() {
+	for (int i = 0; i < numInput; i++)
+		if (srcBlocks[i] && srcBlocks[i]->from && srcBlocks[i]->from->IsTimeDependent())
+			return true;
+	return false;
+}
+
+float Block::EstimateCost() {
+	float cost = 0.0f;
+	for (int i = 0; i < numInput; i++)
+		if (srcBlocks[i] && srcBlocks[i]->from)
+			cost += srcBlocks[i]->from->EstimateCost();
+	return cost;
+}
+
+std::string Block::GenerateIdCallsite() {
+	// leaf blocks contribute themselves
+	return "vec2(" + GenerateCallsite() + ", " + std::to_string(id) + ".0)";
+}
+
 void Block::DrawObject(){
 	// draw block rect
 	Rec blockRect(renderRec.pos.x + BlockDefaultPortLength, renderRec.pos.y, renderRec.size.x - 2 * BlockDefaultPortLength, renderRec.size.y);
-	rtUtil::setColor(rtConstants::normalFillColor);
+	rtUtil::setColor(id == BlockGraph::getInstance().highlightedBlock ? rtConstants::highlightFillColor : rtConstants::normalFillColor);
 	rtBox::getInstance().Draw(blockRect, true);
 	rtUtil::setColor(rtConstants::normalLineColor);
 	rtBox::getInstance().Draw(blockRect, false);
@@ -29,8 +78,13 @@ void Block::DrawObject(){
 		rtLine::getInstance().Draw({ portPos.x - 2 * BlockDefaultPortLength, portPos.y }, { portPos.x, portPos.y });
 	}
 
-	// draw block icon
-	DrawIcon();
+	// draw the thumbnail of the output with the icon in a corner, the icon alone until it is rendered
+	float side = std::min(blockRect.size.x, blockRect.size.y) - 2 * BlockThumbnailMargin;
+	Rec thumbnailRect(blockRect.pos.x + (blockRect.size.x - side) * 0.5f, blockRect.pos.y + (blockRect.size.y - side) * 0.5f, side, side);
+	if (ThumbnailCache::getInstance().Draw(this, thumbnailRect))
+		DrawIcon(Vec2(blockRect.pos.x + 4, blockRect.pos.y + blockRect.size.y - 2), 7, BlockDefaultSize * 0.25);
+	else
+		DrawIcon(Vec2(renderRec.pos.x + renderRec.size.x * 0.5, renderRec.pos.y + renderRec.size.y * 0.5), 5, BlockDefaultSize * 0.6);
 }
 
 int Block::IsPicked(Vec2 cursorPos) {
@@ -73,7 +127,7 @@ Rec Block::GetOutputPortRenderRec(int portIdx){
 
 
 
-BlockGraph::BlockGraph() {
+BlockGraph::BlockGraph() : highlightedBlock(-1) {
 	blockList.push_back(new BoxBlock());
 	blockList.push_back(new SphereBlock()); blockList.back()->renderRec = Rec(rand() % 500, rand() % 500, Block::BlockDefaultSize + Block::BlockDefaultPortLength * 2, Block::BlockDefaultSize);
 	blockList.push_back(new BoolDifferenceBlock()); blockList.back()->renderRec = Rec(rand() % 500, rand() % 500, Block::BlockDefaultSize + Block::BlockDefaultPortLength * 2, Block::BlockDefaultSize);
@@ -119,6 +173,93 @@ void BlockGraph::RemoveConnection(Connection *conn) {
 
 
 
+bool BlockGraph::LoadFromFile(const std::string &fileName) {
+	std::ifstream file(fileName.c_str());
+	if (!file.is_open()) {
+		fprintf(stderr, "Impossible to open graph %s\n", fileName.c_str());
+		return false;
+	}
+
+	// parse into a new graph first
+	std::vector<Block*> newBlocks;
+	std::vector<Connection*> newConnections;
+	bool ok = true;
+	std::string line;
+	int lineNumber = 0;
+	while (ok && std::getline(file, line)) {
+		lineNumber++;
+		std::istringstream in(line);
+		std::string tag;
+		if (!(in >> tag) || tag[0] == '#')
+			continue;
+
+		if (tag == "block") {
+			std::string type;
+			float x, y;
+			Block *b = (in >> type >> x >> y) ? Block::Create(type) : NULL;
+			if (b) {
+				b->renderRec = Rec(x, y, Block::BlockDefaultSize + Block::BlockDefaultPortLength * 2, Block::BlockDefaultSize);
+				// optional, missing params keep their defaults
+				for (size_t i = 0; i < b->params.size() && (in >> b->params[i]); i++);
+				newBlocks.push_back(b);
+			}
+			else ok = false;
+		}
+		else if (tag == "connection") {
+			int from, fromIdx, to, toIdx;
+			ok = (in >> from >> fromIdx >> to >> toIdx) &&
+				from >= 0 && from < (int)newBlocks.size() && fromIdx >= 0 && fromIdx < newBlocks[from]->numOutput &&
+				to >= 0 && to < (int)newBlocks.size() && toIdx >= 0 && toIdx < newBlocks[to]->numInput &&
+				!newBlocks[from]->dstBlocks[fromIdx] && !newBlocks[to]->srcBlocks[toIdx];
+			if (ok)
+				newConnections.push_back(new Connection(newBlocks[from], fromIdx, newBlocks[to], toIdx));
+		}
+		else ok = false;
+	}
+
+	if (!ok) {
+		fprintf(stderr, "%s(%d): invalid graph line\n", fileName.c_str(), lineNumber);
+		for (auto it = newConnections.begin(); it != newConnections.end(); ++it) delete *it;
+		for (auto it = newBlocks.begin(); it != newBlocks.end(); ++it) delete *it;
+		return false;
+	}
+
+	// replace the current graph
+	for (auto it = connectionList.begin(); it != connectionList.end(); ++it) delete *it;
+	for (auto it = blockList.begin(); it != blockList.end(); ++it) delete *it;
+	blockList = newBlocks;
+	connectionList = newConnections;
+	setupRenderingInfoCache();
+	return true;
+}
+
+bool BlockGraph::SaveToFile(const std::string &fileName) const {
+	std::ofstream file(fileName.c_str());
+	if (!file.is_open()) {
+		fprintf(stderr, "Impossible to write graph %s\n", fileName.c_str());
+		return false;
+	}
+
+	file << "# RayMarchingCGTool graph\n";
+	for (auto it = blockList.begin(); it != blockList.end(); ++it)
+	{
+		file << "block " << (*it)->GetTypeName() << " " << (*it)->renderRec.pos.x << " " << (*it)->renderRec.pos.y;
+		for (auto p = (*it)->params.begin(); p != (*it)->params.end(); ++p)
+			file << " " << *p;
+		file << "\n";
+	}
+	for (auto it = connectionList.begin(); it != connectionList.end(); ++it) {
+		// half-built connections (port dragging) are not part of the graph
+		if (!(*it)->from || !(*it)->to)
+			continue;
+		file << "connection "
+			<< std::find(blockList.begin(), blockList.end(), (*it)->from) - blockList.begin() << " " << (*it)->fromIdx << " "
+			<< std::find(blockList.begin(), blockList.end(), (*it)->to) - blockList.begin() << " " << (*it)->toIdx << "\n";
+	}
+	return true;
+}
+
+
 void BlockGraph::setupRenderingInfoCache() {
 	blockOrderList.clear();
 	for (auto it = blockList.begin(); it != blockList.end(); ++it) {
@@ -202,12 +343,20 @@ float sdsphere(vec3 p, float r) {
 		)";
 }
 std::string SphereBlock::GenerateCallsite() {
-	return R"(sdsphere(p, 1.0))";
+	return "sdsphere(p, " + GenerateParam(0) + ")";
+}
+float SphereBlock::EstimateCost() {
+	return 5.0f; // dot, sqrt, sub
+}
+std::string SphereBlock::GenerateExpressionValue() {
+	return "sdf::Sphere(" + CodeGenManager::GenerateExpressionLiteral(params[0]) + ", " + std::to_string(id) + ")";
+}
+int SphereBlock::BuildCpuNode(CpuScene &scene) {
+	return scene.AddNode(CpuScene::SPHERE, id, params[0]);
 }
 
-void SphereBlock::DrawIcon() {
-	// draw a character in the center of the block
-	rtText::getInstance().Draw(Vec2(renderRec.pos.x + renderRec.size.x * 0.5, renderRec.pos.y + renderRec.size.y * 0.5), 5, L"", BlockDefaultSize * 0.6);
+void SphereBlock::DrawIcon(Vec2 pos, int align, int size) {
+	rtText::getInstance().Draw(pos, align, L"", size);
 }
 
 
@@ -222,12 +371,20 @@ float sdBox(vec3 p, vec3 b)
 		)";
 }
 std::string BoxBlock::GenerateCallsite() {
-	return R"(sdBox(p, vec3(0.7)))";
+	return "sdBox(p, vec3(" + GenerateParam(0) + "))";
+}
+float BoxBlock::EstimateCost() {
+	return 12.0f;
+}
+std::string BoxBlock::GenerateExpressionValue() {
+	return "sdf::Box(" + CodeGenManager::GenerateExpressionLiteral(params[0]) + ", " + std::to_string(id) + ")";
+}
+int BoxBlock::BuildCpuNode(CpuScene &scene) {
+	return scene.AddNode(CpuScene::BOX, id, params[0]);
 }
 
-void BoxBlock::DrawIcon() {
-	// draw a character in the center of the block
-	rtText::getInstance().Draw(Vec2(renderRec.pos.x + renderRec.size.x * 0.5, renderRec.pos.y + renderRec.size.y * 0.5), 5, L"", BlockDefaultSize * 0.6);
+void BoxBlock::DrawIcon(Vec2 pos, int align, int size) {
+	rtText::getInstance().Draw(pos, align, L"", size);
 }
 
 
@@ -236,12 +393,23 @@ std::string ScreenBlock::GenerateDefinition() {
 	return "";
 }
 std::string ScreenBlock::GenerateCallsite() {
-	return srcBlocks[0]->from->GenerateCallsite();
+	return GenerateInputCallsite(0);
+}
+std::string ScreenBlock::GenerateIdCallsite() {
+	return srcBlocks[0]->from->GenerateIdCallsite();
+}
+std::string ScreenBlock::GenerateExpressionType() {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->GenerateExpressionType() : "sdf::Empty";
+}
+std::string ScreenBlock::GenerateExpressionValue() {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->GenerateExpressionValue() : "sdf::Empty()";
+}
+int ScreenBlock::BuildCpuNode(CpuScene &scene) {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->BuildCpuNode(scene) : -1;
 }
 
-void ScreenBlock::DrawIcon() {
-	// draw a character in the center of the block
-	rtText::getInstance().Draw(Vec2(renderRec.pos.x + renderRec.size.x * 0.5, renderRec.pos.y + renderRec.size.y * 0.5), 5, L"", BlockDefaultSize * 0.6);
+void ScreenBlock::DrawIcon(Vec2 pos, int align, int size) {
+	rtText::getInstance().Draw(pos, align, L"", size);
 }
 
 
@@ -251,14 +419,108 @@ std::string BoolDifferenceBlock::GenerateDefinition() {
 		R"(
 float opS(float d1, float d2){
 	return max(-d1,d2);
+}
+vec2 opSId(vec2 d1, vec2 d2){
+	return (-d1.x > d2.x) ? vec2(-d1.x, d1.y) : d2;
 }
 		)";
 }
 std::string BoolDifferenceBlock::GenerateCallsite() {
-	return "opS(" + srcBlocks[0]->from->GenerateCallsite() + "," + srcBlocks[1]->from->GenerateCallsite() + ")";
+	return "opS(" + GenerateInputCallsite(0) + "," + GenerateInputCallsite(1) + ")";
+}
+std::string BoolDifferenceBlock::GenerateIdCallsite() {
+	return "opSId(" + srcBlocks[0]->from->GenerateIdCallsite() + "," + srcBlocks[1]->from->GenerateIdCallsite() + ")";
+}
+float BoolDifferenceBlock::EstimateCost() {
+	return Block::EstimateCost() + 2.0f;
+}
+std::string BoolDifferenceBlock::GenerateExpressionType() {
+	if (!srcBlocks[0] || !srcBlocks[0]->from || !srcBlocks[1] || !srcBlocks[1]->from)
+		return "sdf::Empty";
+	return "sdf::Difference<" + srcBlocks[0]->from->GenerateExpressionType() + ", " + srcBlocks[1]->from->GenerateExpressionType() + ">";
+}
+std::string BoolDifferenceBlock::GenerateExpressionValue() {
+	if (!srcBlocks[0] || !srcBlocks[0]->from || !srcBlocks[1] || !srcBlocks[1]->from)
+		return "sdf::Empty()";
+	return GenerateExpressionType() + "(" + srcBlocks[0]->from->GenerateExpressionValue() + ", " + srcBlocks[1]->from->GenerateExpressionValue() + ")";
+}
+int BoolDifferenceBlock::BuildCpuNode(CpuScene &scene) {
+	if (!srcBlocks[0] || !srcBlocks[0]->from || !srcBlocks[1] || !srcBlocks[1]->from)
+		return -1;
+	int a = srcBlocks[0]->from->BuildCpuNode(scene);
+	int b = srcBlocks[1]->from->BuildCpuNode(scene);
+	return (a < 0 || b < 0) ? -1 : scene.AddNode(CpuScene::DIFFERENCE, id, 0.0f, a, b);
+}
+
+void BoolDifferenceBlock::DrawIcon(Vec2 pos, int align, int size) {
+	rtText::getInstance().Draw(pos, align, L"", size);
+}
+
+
+
+BakedBlock::~BakedBlock() {
+	BakeScheduler::getInstance().Cancel(id);
+	delete bake;
+}
+
+bool BakedBlock::IsBaked() const {
+	return bake && !bake->IsEmpty();
+}
+
+bool BakedBlock::Bake() {
+	// baked blocks inside the input pass through
+	CpuScene scene;
+	scene.root = (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->BuildCpuNode(scene) : -1;
+	scene.Compile();
+	std::string input = BrickMap::SceneKey(scene, (int)params[0]);
+	if (bake && input == bakedInput)
+		return false;
+
+	if (!bake)
+		bake = new BrickMap();
+	if (BakeScheduler::getInstance().Take(id, input, *bake)) {
+		bakedInput = input;
+		if (IsBaked())
+			bake->PrintStats(id);
+		return IsBaked();
+	}
+	// a stale bake is not sampled while the new one is baking
+	bool wasBaked = IsBaked();
+	*bake = BrickMap();
+	bakedInput.clear();
+	BakeScheduler::getInstance().Request(id, input, scene, (int)params[0]);
+	return wasBaked;
+}
+
+std::string BakedBlock::GenerateDefinition() {
+	return CodeGenManager::GenerateBrickMapLookup();
+}
+std::string BakedBlock::GenerateSubsceneDefinition() {
+	return IsBaked() ? CodeGenManager::GenerateBakedDefinition(id, *bake, GenerateInputCallsite(0)) : "";
+}
+std::string BakedBlock::GenerateNativeSubsceneDefinition() {
+	return IsBaked() ? CodeGenManager::GenerateNativeBakedDefinition(id, GenerateInputCallsite(0)) : "";
+}
+float BakedBlock::EstimateCost() {
+	return IsBaked() ? (float)SampleCost : Block::EstimateCost();
+}
+std::string BakedBlock::GenerateCallsite() {
+	return IsBaked() ? "baked" + std::to_string(id) + "(p)" : GenerateInputCallsite(0);
+}
+std::string BakedBlock::GenerateIdCallsite() {
+	// ids are only read at hits: the analytic input gives them
+	return srcBlocks[0]->from->GenerateIdCallsite();
+}
+std::string BakedBlock::GenerateExpressionType() {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->GenerateExpressionType() : "sdf::Empty";
+}
+std::string BakedBlock::GenerateExpressionValue() {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->GenerateExpressionValue() : "sdf::Empty()";
+}
+int BakedBlock::BuildCpuNode(CpuScene &scene) {
+	return (srcBlocks[0] && srcBlocks[0]->from) ? srcBlocks[0]->from->BuildCpuNode(scene) : -1;
 }
 
-void BoolDifferenceBlock::DrawIcon() {
-	// draw a character in the center of the block
-	rtText::getInstance().Draw(Vec2(renderRec.pos.x + renderRec.size.x * 0.5, renderRec.pos.y + renderRec.size.y * 0.5), 5, L"", BlockDefaultSize * 0.6);
+void BakedBlock::DrawIcon(Vec2 pos, int align, int size) {
+	rtText::getInstance().Draw(pos, align, L"", size);
 }
@@ -17,6 +17,8 @@ public:
 };
 
 class Connection;
+class CpuScene;
+class BrickMap;
 
 class Block : public Renderable{
 
@@ -24,6 +26,7 @@ public:
 	static const int BlockDefaultPortLength = 10;
 	static const int BlockDefaultPortActableRadius = 10;
 	static const int BlockDefaultSize = 100;
+	static const int BlockThumbnailMargin = 10;
 
 	
 	virtual void DrawObject();	
@@ -31,6 +34,24 @@ public:
 
 	virtual std::string GenerateDefinition() = 0;
 	virtual std::string GenerateCallsite() = 0;
+	virtual std::string GenerateIdCallsite(); // vec2(distance, id of the contributing leaf block)
+	virtual std::string GenerateNativeDefinition() { return GenerateDefinition(); } // C++ backend: the GLSL compiles on its prelude
+	// functions calling the callsites of the inputs, emitted after every block definition (inputs first)
+	virtual std::string GenerateSubsceneDefinition() { return ""; }
+	virtual std::string GenerateNativeSubsceneDefinition() { return GenerateSubsceneDefinition(); }
+	virtual std::string GenerateExpressionType() = 0; // sdfexpr.hpp type of the output, e.g. sdf::Difference<sdf::Sphere, sdf::Box>
+	virtual std::string GenerateExpressionValue() = 0; // constexpr constructor call of that type
+	virtual std::string GetTypeName() = 0; // graph file tag
+	virtual int BuildCpuNode(CpuScene &scene) = 0; // CPU counterpart of GenerateCallsite: node index (-1: unconnected input)
+	std::string GenerateParam(int paramIdx); // literal, or the per-instance value in the sweep shader
+	std::string GenerateInputCallsite(int inputIdx); // callsite of an input, or the sample of its auto bake
+
+	// hybrid evaluation (CodeGenManager::UpdateAutoBakes): subtrees reading time stay analytic,
+	// the others may be baked when their estimated per-step cost (~ALU ops) is high
+	virtual bool IsTimeDependent(); // default: through an input
+	virtual float EstimateCost(); // default: sum of the inputs
+
+	static Block *Create(const std::string &typeName); // NULL for unknown types
 
 	void setPosition(Rec newPos);
 	Vec2 GetInputPortPos(int portIdx);
@@ -41,7 +62,10 @@ public:
 //protected:
 	
 	Block(int numIn, int numOut);
+	virtual ~Block() {}
 
+	int id; // unique, written to the G-buffer by the generated shader
+	std::vector<float> params; // tunable constants of the callsite
 	int numInput;
 	std::vector<Connection *> srcBlocks;
 	int numOutput;
@@ -49,45 +73,101 @@ public:
 	Rec renderRec; // = bounding box = actionable area
 
 protected:
-	virtual void DrawIcon(/*args*/) = 0;
+	virtual void DrawIcon(Vec2 pos, int align, int size) = 0; // glyph of the type, placed as rtText::Draw
 
+private:
+	static int nextId;
 };
 
 
 // to consider:  Template?
 class SphereBlock : public Block {
 public:
-	virtual void DrawIcon();
+	virtual void DrawIcon(Vec2 pos, int align, int size);
 	virtual std::string GenerateDefinition();
 	virtual std::string GenerateCallsite();
-	SphereBlock() : Block(0, 1) {}
+	virtual std::string GetTypeName() { return "Sphere"; }
+	virtual std::string GenerateExpressionType() { return "sdf::Sphere"; }
+	virtual std::string GenerateExpressionValue();
+	virtual float EstimateCost();
+	virtual int BuildCpuNode(CpuScene &scene);
+	SphereBlock() : Block(0, 1) { params.push_back(1.0f); } // radius
 };
 
 class BoxBlock : public Block {
 public:
-	virtual void DrawIcon();
+	virtual void DrawIcon(Vec2 pos, int align, int size);
 	virtual std::string GenerateDefinition();
 	virtual std::string GenerateCallsite();
-	BoxBlock() : Block(0, 1) {}
+	virtual std::string GetTypeName() { return "Box"; }
+	virtual std::string GenerateExpressionType() { return "sdf::Box"; }
+	virtual std::string GenerateExpressionValue();
+	virtual float EstimateCost();
+	virtual int BuildCpuNode(CpuScene &scene);
+	BoxBlock() : Block(0, 1) { params.push_back(0.7f); } // half size
 };
 
 class ScreenBlock : public Block {
 public:
-	virtual void DrawIcon();
+	virtual void DrawIcon(Vec2 pos, int align, int size);
 	virtual std::string GenerateDefinition();
 	virtual std::string GenerateCallsite();
+	virtual std::string GenerateIdCallsite();
+	virtual std::string GetTypeName() { return "Screen"; }
+	virtual std::string GenerateExpressionType();
+	virtual std::string GenerateExpressionValue();
+	virtual int BuildCpuNode(CpuScene &scene);
 	ScreenBlock() : Block(1, 0) {}
 };
 
 class BoolDifferenceBlock : public Block {
 public:
 
-	virtual void DrawIcon();
+	virtual void DrawIcon(Vec2 pos, int align, int size);
 	virtual std::string GenerateDefinition();
 	virtual std::string GenerateCallsite();
+	virtual std::string GenerateIdCallsite();
+	virtual std::string GetTypeName() { return "BoolDifference"; }
+	virtual std::string GenerateExpressionType();
+	virtual std::string GenerateExpressionValue();
+	virtual float EstimateCost();
+	virtual int BuildCpuNode(CpuScene &scene);
 	BoolDifferenceBlock() : Block(2, 1) {}
 };
 
+// The input subtree sampled from a BrickMap in the generated shader: trilinear in the narrow band and
+// a distance bound in the empty bricks, both lowered to stay conservative, analytic outside the baked
+// bounds (and on the CPU backends). Analytic as well until the bake of the current input is done.
+class BakedBlock : public Block {
+public:
+	static const int SampleCost = 40; // two dependent texture fetches
+
+	virtual void DrawIcon(Vec2 pos, int align, int size);
+	virtual std::string GenerateDefinition();
+	virtual std::string GenerateNativeDefinition() { return ""; }
+	virtual std::string GenerateSubsceneDefinition();
+	virtual std::string GenerateNativeSubsceneDefinition();
+	virtual std::string GenerateCallsite();
+	virtual std::string GenerateIdCallsite();
+	virtual std::string GetTypeName() { return "Baked"; }
+	virtual std::string GenerateExpressionType();
+	virtual std::string GenerateExpressionValue();
+	virtual float EstimateCost();
+	virtual int BuildCpuNode(CpuScene &scene);
+	BakedBlock() : Block(1, 1), bake(NULL) { params.push_back(64.0f); } // resolution: cells along the longest side
+	virtual ~BakedBlock();
+
+	// main thread, before codegen: takes the finished bake of the input subtree and resolution, or
+	// requests it from BakeScheduler (analytic until then); true when the generated code changes
+	bool Bake();
+	bool IsBaked() const;
+
+	BrickMap *bake; // NULL: never baked
+
+private:
+	std::string bakedInput; // input subtree and resolution of the current bake, empty while analytic
+};
+
 
 class Connection : public Renderable {
 public:
@@ -123,11 +203,17 @@ public:
 
 	// graphics data
 	std::list<Renderable*> blockOrderList; // front() = backmost object
+	int highlightedBlock; // Block::id picked in the display window (-1: none)
 
 	// Euler operations
 	Connection* AddConnection(Block *bFrom, int iFrom, Block *bTo, int iTo);
 	void RemoveConnection(Connection *conn);
 
+	// Graph files: one "block <type> <x> <y> [params]" line per block, then
+	// "connection <from block> <from port> <to block> <to port>" lines (blocks indexed in file order)
+	bool LoadFromFile(const std::string &fileName); // the graph is left untouched on failure
+	bool SaveToFile(const std::string &fileName) const;
+
 private:
 	BlockGraph();
 
@@ -0,0 +1,266 @@
+#include "boundvalidator.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+
+#include "block.hpp"
+#include "codegen.hpp"
+
+const float BoundValidator::MaxStepScale = 2.0f;
+const float BoundValidator::GradientStep = 1e-3f;
+const float BoundValidator::StepTolerance = 1e-3f;
+const float BoundValidator::GradientTolerance = 1e-2f;
+
+BoundValidator::Report::Report() : samples(0), rays(0), crossingRays(0), gradientSum(0.0), gradientMin(INFINITY), gradientMax(0.0f),
+	gradientAbove(0), safeStepScale(MaxStepScale) {}
+
+void BoundValidator::Report::Merge(const Report &other) {
+	samples += other.samples;
+	rays += other.rays;
+	crossingRays += other.crossingRays;
+	gradientSum += other.gradientSum;
+	gradientMin = std::min(gradientMin, other.gradientMin);
+	gradientMax = std::max(gradientMax, other.gradientMax);
+	gradientAbove += other.gradientAbove;
+	safeStepScale = std::min(safeStepScale, other.safeStepScale);
+}
+
+BoundValidator::BoundValidator(const std::vector<Instance> &instances, int samples) :
+	instances(instances), samples(samples), numChunks((samples + ChunkSamples - 1) / ChunkSamples), simdLevel(DetectSimdLevel())
+{
+	// the surface bounds and half their size around them: the far field is marched too
+	for (auto it = instances.begin(); it != instances.end(); ++it) {
+		glm::vec3 min(-1.0f), max(1.0f);
+		it->scene.Bounds(min, max);
+		float margin = 0.5f * std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+		domainMin.push_back(min - margin);
+		domainMax.push_back(max + margin);
+	}
+}
+
+BoundValidator::Report BoundValidator::Validate(const std::vector<Instance> &instances, int samples, WorkerPool &pool) {
+	BoundValidator validator(instances, samples);
+	// per worker, merged at the end
+	int numWorkers = std::max(pool.NumThreads(), 1);
+	std::vector<std::vector<float> > scratch(numWorkers);
+	std::vector<Report> reports(numWorkers);
+	pool.Run(validator.numChunks, [&](int chunk, int worker) {
+		validator.ValidateChunk(chunk, scratch[worker], reports[worker]);
+	});
+
+	Report total;
+	for (auto it = reports.begin(); it != reports.end(); ++it)
+		total.Merge(*it);
+	return total;
+}
+
+void BoundValidator::Distances(const Instance &instance, const float *x, const float *y, const float *z, float *d, int n) const {
+	DistanceBatch(simdLevel, instance.scene, x, y, z, d, n);
+	if (instance.bake.IsEmpty())
+		return;
+	for (int i = 0; i < n; i++) {
+		glm::vec3 p(x[i], y[i], z[i]);
+		d[i] = instance.bake.Contains(p) ? instance.bake.Sample(p) : instance.bake.Outside(d[i]);
+	}
+}
+
+float BoundValidator::Distance(const Instance &instance, const glm::vec3 &p) const {
+	if (instance.bake.IsEmpty())
+		return instance.scene.Distance(p);
+	return instance.bake.Contains(p) ? instance.bake.Sample(p) : instance.bake.Outside(instance.scene.Distance(p));
+}
+
+void BoundValidator::ValidateChunk(int chunk, std::vector<float> &scratch, Report &report) const {
+	// seeded by the chunk: the same points whatever the number of threads
+	std::mt19937 random(chunk + 1);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::normal_distribution<float> normal;
+	int instanceIndex = chunk % (int)instances.size();
+	const Instance &instance = instances[instanceIndex];
+	glm::vec3 lo = domainMin[instanceIndex], size = domainMax[instanceIndex] - lo;
+	int n = std::min(ChunkSamples, samples - chunk * ChunkSamples);
+
+	// the points and the tetrahedron around each, then StepProbes points along each of the 2 rays
+	int m = std::max(5, 2 * StepProbes) * n;
+	scratch.resize(4 * (size_t)m);
+	float *x = &scratch[0], *y = x + m, *z = y + m, *d = z + m;
+	std::vector<glm::vec3> points(n), directions(2 * n);
+	for (int i = 0; i < n; i++) {
+		points[i] = lo + size * glm::vec3(uniform(random), uniform(random), uniform(random));
+		for (int k = 0; k < 5; k++) {
+			glm::vec3 q = k ? points[i] + GradientStep * CpuScene::Tetrahedron[k - 1] : points[i];
+			x[k * n + i] = q.x;
+			y[k * n + i] = q.y;
+			z[k * n + i] = q.z;
+		}
+	}
+	Distances(instance, x, y, z, d, 5 * n);
+
+	std::vector<float> distances(d, d + n);
+	for (int i = 0; i < n; i++) {
+		glm::vec3 gradient = CpuScene::TetrahedronGradient(d + n + i, n, GradientStep);
+		float g = glm::length(gradient);
+		if (std::isfinite(g)) {
+			report.samples++;
+			report.gradientSum += g;
+			report.gradientMin = std::min(report.gradientMin, g);
+			report.gradientMax = std::max(report.gradientMax, g);
+			report.gradientAbove += g > 1.0f + GradientTolerance;
+		}
+
+		// straight to the surface (down the gradient), and any direction
+		glm::vec3 randomDirection;
+		do randomDirection = glm::vec3(normal(random), normal(random), normal(random));
+		while (glm::dot(randomDirection, randomDirection) < 1e-6f);
+		randomDirection = glm::normalize(randomDirection);
+		directions[2 * i] = g > 0.0f && std::isfinite(g) ? gradient * ((distances[i] > 0.0f ? -1.0f : 1.0f) / g) : randomDirection;
+		directions[2 * i + 1] = randomDirection;
+	}
+
+	for (int r = 0; r < 2 * n; r++) {
+		const glm::vec3 &p = points[r / 2];
+		for (int k = 0; k < StepProbes; k++) {
+			glm::vec3 q = p + directions[r] * (std::abs(distances[r / 2]) * MaxStepScale * (k + 1) / StepProbes);
+			x[r * StepProbes + k] = q.x;
+			y[r * StepProbes + k] = q.y;
+			z[r * StepProbes + k] = q.z;
+		}
+	}
+	Distances(instance, x, y, z, d, 2 * StepProbes * n);
+
+	for (int r = 0; r < 2 * n; r++) {
+		float d0 = distances[r / 2];
+		if (!(std::abs(d0) > 1e-6f) || !std::isfinite(d0))
+			continue;
+		report.rays++;
+
+		// on the other side of the surface, beyond the rounding of a distance
+		float side = d0 > 0.0f ? 1.0f : -1.0f, margin = StepTolerance * std::abs(d0);
+		int k = 0;
+		while (k < StepProbes && d[r * StepProbes + k] * side >= -margin)
+			k++;
+		if (k == StepProbes)
+			continue;
+
+		// the first crossing lies between the probes k - 1 and k
+		const glm::vec3 &p = points[r / 2];
+		float step = std::abs(d0) * MaxStepScale / StepProbes;
+		float before = k * step, after = (k + 1) * step;
+		for (int i = 0; i < BisectionSteps; i++) {
+			float t = 0.5f * (before + after);
+			if (Distance(instance, p + directions[r] * t) * side < -margin)
+				after = t;
+			else
+				before = t;
+		}
+		float scale = before / std::abs(d0);
+		report.safeStepScale = std::min(report.safeStepScale, scale);
+		report.crossingRays += scale < 1.0f - StepTolerance;
+	}
+}
+
+void BoundValidator::Print(const std::string &name, const Report &report) {
+	long long samples = std::max(report.samples, 1LL);
+	printf("  %-28s |grad| %.3f..%.3f (mean %.3f, above %.2f at %.3f%% of the points), %.4f%% of the full steps overshoot, safe step scale %.3f%s\n",
+		name.c_str(), report.gradientMin, report.gradientMax, report.gradientSum / samples, 1.0f + GradientTolerance,
+		100.0 * report.gradientAbove / samples, 100.0 * report.crossingRays / std::max(report.rays, 1LL), report.safeStepScale,
+		report.IsSafe() ? "" : "  NOT A DISTANCE BOUND");
+}
+
+bool BoundValidator::Run(int samplesPerFunction, int numThreads) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	WorkerPool pool(numThreads);
+	numThreads = pool.NumThreads();
+	printf("Distance bound validation: %d points per function, %d threads, %s\n", samplesPerFunction, numThreads, SimdLevelName(DetectSimdLevel()));
+	bool ok = true;
+	int numFunctions = 0;
+
+	// block types, on instances of random sizes
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> size(0.2f, 2.0f);
+	std::vector<Instance> spheres(InstancesPerType), boxes(InstancesPerType), differences(InstancesPerType), bakes;
+	for (int i = 0; i < InstancesPerType; i++) {
+		spheres[i].scene.root = spheres[i].scene.AddNode(CpuScene::SPHERE, 0, size(random));
+		spheres[i].scene.Compile();
+		boxes[i].scene.root = boxes[i].scene.AddNode(CpuScene::BOX, 0, size(random));
+		boxes[i].scene.Compile();
+
+		// a sphere carved out of a box, or a box out of a sphere
+		CpuScene &scene = differences[i].scene;
+		int a = scene.AddNode(i % 2 ? CpuScene::BOX : CpuScene::SPHERE, 0, size(random));
+		int b = scene.AddNode(i % 2 ? CpuScene::SPHERE : CpuScene::BOX, 1, size(random));
+		scene.root = scene.AddNode(CpuScene::DIFFERENCE, 2, 0.0f, a, b);
+		scene.Compile();
+	}
+	// the same differences sampled from brick maps, at the resolution of the auto bakes
+	for (int i = 0; i < InstancesPerType; i++) {
+		bakes.push_back(differences[i]);
+		bakes.back().bake.Bake(bakes.back().scene, CodeGenManager::AutoBakeResolution, numThreads);
+	}
+
+	printf("Block types (%d random instances each):\n", InstancesPerType);
+	const char *typeNames[] = { "Sphere", "Box", "BoolDifference", "Baked" };
+	const std::vector<Instance> *types[] = { &spheres, &boxes, &differences, &bakes };
+	for (int i = 0; i < 4; i++) {
+		Report report = Validate(*types[i], samplesPerFunction, pool);
+		Print(typeNames[i], report);
+		ok = ok && report.IsSafe();
+		numFunctions++;
+	}
+
+	// the subtree of every block of the graph (once per distinct subtree), then the whole scene
+	BlockGraph &graph = BlockGraph::getInstance();
+	if (!graph.blockList.empty()) {
+		CodeGenManager::getInstance().FinishBakes();
+		printf("Graph (%d blocks):\n", (int)graph.blockList.size());
+		std::set<std::string> validated;
+		float graphStepScale = MaxStepScale;
+		for (auto it = graph.blockList.begin(); it != graph.blockList.end(); ++it) {
+			if (dynamic_cast<ScreenBlock *>(*it))
+				continue;
+			std::vector<Instance> instance(1);
+			instance[0].scene.root = (*it)->BuildCpuNode(instance[0].scene);
+			if (instance[0].scene.IsEmpty())
+				continue;
+			instance[0].scene.Compile();
+			std::string key = BrickMap::SceneKey(instance[0].scene, 0);
+
+			// baked blocks: what the generated shader samples
+			BakedBlock *baked = dynamic_cast<BakedBlock *>(*it);
+			if (baked && baked->IsBaked()) {
+				instance[0].bake = *baked->bake;
+				key = BrickMap::SceneKey(instance[0].scene, (int)baked->params[0]) + " baked";
+			}
+			if (!validated.insert(key).second)
+				continue;
+
+			Report report = Validate(instance, samplesPerFunction, pool);
+			Print("block " + std::to_string((*it)->id) + " (" + (*it)->GetTypeName() + ")", report);
+			ok = ok && report.IsSafe();
+			numFunctions++;
+			// a sampled subtree replaces the analytic one in the scene the shader marches
+			if (baked && !instance[0].bake.IsEmpty())
+				graphStepScale = std::min(graphStepScale, report.safeStepScale);
+		}
+
+		std::vector<Instance> scene(1);
+		scene[0].scene = CpuScene::FromGraph();
+		if (!scene[0].scene.IsEmpty()) {
+			Report report = Validate(scene, samplesPerFunction, pool);
+			Print("scene", report);
+			ok = ok && report.IsSafe();
+			numFunctions++;
+			graphStepScale = std::min(graphStepScale, report.safeStepScale);
+			printf("Safe step scale of the graph: %.3f\n", graphStepScale);
+		}
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	printf("Validated %d functions in %.0f ms%s\n", numFunctions, ms, ok ? "" : ", some are not distance bounds");
+	return ok;
+}
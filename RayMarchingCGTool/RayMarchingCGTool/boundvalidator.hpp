@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef BOUNDVALIDATOR_HPP
+#define BOUNDVALIDATOR_HPP
+
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+#include "brickmap.hpp"
+#include "raypacket.hpp"
+#include "workerpool.hpp"
+
+// Empirical check that distance functions are distance bounds, as sphere tracing assumes. Random
+// points around the surface are evaluated with their gradient, then probed along two rays (towards
+// the surface and a random direction) at multiples of the distance: the first sign change is the
+// surface, found by bisection. The smallest (crossing distance / distance) over all the points is
+// the safe step scale of the function: the march may multiply its steps by it without overshooting.
+// Block types are checked on random instances, graphs on the subtree of every block.
+class BoundValidator {
+
+public:
+	static const int ChunkSamples = 1024; // points per batch of a worker
+	static const int InstancesPerType = 8;
+	static const int StepProbes = 20; // per ray, up to MaxStepScale times the distance
+	static const int BisectionSteps = 12;
+	static const float MaxStepScale;
+	static const float GradientStep; // of the tetrahedral gradient, world units
+	static const float StepTolerance; // relative to the distance: a full step may end this far beyond the surface
+	static const float GradientTolerance; // |grad| above 1 + this is reported
+
+	// one function to check: samples are spread evenly over its instances
+	struct Instance {
+		CpuScene scene;
+		BrickMap bake; // not empty: sampled inside its bounds, as BakedBlock in the generated shader
+	};
+
+	struct Report {
+		long long samples, rays, crossingRays;
+		double gradientSum;
+		float gradientMin, gradientMax;
+		long long gradientAbove; // samples with |grad| > 1 + GradientTolerance
+		float safeStepScale; // <= MaxStepScale
+		Report();
+		void Merge(const Report &other);
+		bool IsSafe() const { return safeStepScale >= 1.0f - StepTolerance; }
+	};
+
+	// block types, then every block of the loaded graph and the whole scene; false when a function overshoots
+	static bool Run(int samplesPerFunction, int numThreads);
+	static Report Validate(const std::vector<Instance> &instances, int samples, WorkerPool &pool);
+
+private:
+	BoundValidator(const std::vector<Instance> &instances, int samples);
+
+	void ValidateChunk(int chunk, std::vector<float> &scratch, Report &report) const;
+	void Distances(const Instance &instance, const float *x, const float *y, const float *z, float *d, int n) const;
+	float Distance(const Instance &instance, const glm::vec3 &p) const;
+	static void Print(const std::string &name, const Report &report);
+
+	const std::vector<Instance> &instances;
+	std::vector<glm::vec3> domainMin, domainMax; // per instance: the surface bounds with a margin
+	int samples, numChunks;
+	SimdLevel simdLevel;
+};
+
+
+#endif
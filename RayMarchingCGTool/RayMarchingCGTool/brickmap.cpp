@@ -0,0 +1,258 @@
+#include "brickmap.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "sdfquery.hpp"
+
+void BrickMap::Bake(const CpuScene &scene, int resolution, int numThreads) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	*this = BrickMap();
+
+	glm::vec3 min, max;
+	if (!scene.Bounds(min, max))
+		return;
+
+	// a brick of margin: the band and the trilinear footprint of the surface stay inside
+	glm::vec3 size = max - min;
+	cellSize = std::max(size.x, std::max(size.y, size.z)) / std::max(resolution, (int)BrickSize);
+	margin = 0.5f * std::sqrt(3.0f) * cellSize;
+	float brickExtent = BrickSize * cellSize;
+	boundsMin = min - brickExtent;
+	bricks = glm::ivec3(glm::ceil((size + 2.0f * brickExtent) / brickExtent));
+	int numBricks = bricks.x * bricks.y * bricks.z;
+
+	SdfQuery query(numThreads);
+	query.scene = scene;
+
+	// the surface may cross a brick only if |scene(center)| < half diagonal (distance bound)
+	std::vector<glm::vec3> points(numBricks);
+	for (int z = 0, i = 0; z < bricks.z; z++)
+		for (int y = 0; y < bricks.y; y++)
+			for (int x = 0; x < bricks.x; x++, i++)
+				points[i] = boundsMin + (glm::vec3((float)x, (float)y, (float)z) + 0.5f) * brickExtent;
+	std::vector<float> distances(numBricks);
+	query.Evaluate(&points[0], numBricks, &distances[0], NULL);
+
+	float halfDiagonal = 0.5f * std::sqrt(3.0f) * brickExtent;
+	float band = halfDiagonal + BandCells * cellSize;
+	std::vector<int> filled;
+	indirection.resize(numBricks);
+	for (int i = 0; i < numBricks; i++) {
+		float d = distances[i];
+		if (std::abs(d) <= band) {
+			indirection[i] = glm::vec2((float)filled.size(), 0.0f);
+			filled.push_back(i);
+		}
+		else indirection[i] = glm::vec2(-1.0f, d > 0.0f ? d - halfDiagonal - margin : d + halfDiagonal + margin);
+	}
+
+	// atlas: up to MaxAtlasSlots^2 slots per layer
+	int numFilled = (int)filled.size();
+	slots.x = std::max(1, std::min(numFilled, (int)MaxAtlasSlots));
+	slots.y = std::max(1, std::min((numFilled + slots.x - 1) / slots.x, (int)MaxAtlasSlots));
+	slots.z = std::max(1, (numFilled + slots.x * slots.y - 1) / (slots.x * slots.y));
+	atlasSize = slots * (int)BrickSamples;
+	atlas.assign((size_t)atlasSize.x * atlasSize.y * atlasSize.z, 0.0f);
+
+	// corner samples of the filled bricks, a batch at a time
+	const int samplesPerBrick = BrickSamples * BrickSamples * BrickSamples;
+	points.resize(BakeBatchBricks * samplesPerBrick);
+	distances.resize(points.size());
+	for (int first = 0; first < numFilled; first += BakeBatchBricks) {
+		int count = std::min((int)BakeBatchBricks, numFilled - first);
+		for (int k = 0; k < count; k++) {
+			int brick = filled[first + k];
+			glm::vec3 corner = boundsMin + glm::vec3((float)(brick % bricks.x), (float)(brick / bricks.x % bricks.y), (float)(brick / (bricks.x * bricks.y))) * brickExtent;
+			glm::vec3 *p = &points[k * samplesPerBrick];
+			for (int z = 0; z < BrickSamples; z++)
+				for (int y = 0; y < BrickSamples; y++)
+					for (int x = 0; x < BrickSamples; x++)
+						*p++ = corner + glm::vec3((float)x, (float)y, (float)z) * cellSize;
+		}
+		query.Evaluate(&points[0], count * samplesPerBrick, &distances[0], NULL);
+
+		for (int k = 0; k < count; k++) {
+			glm::ivec3 origin = SlotOrigin(first + k);
+			const float *d = &distances[k * samplesPerBrick];
+			for (int z = 0; z < BrickSamples; z++)
+				for (int y = 0; y < BrickSamples; y++, d += BrickSamples)
+					std::copy(d, d + BrickSamples, &atlas[((size_t)(origin.z + z) * atlasSize.y + origin.y + y) * atlasSize.x + origin.x]);
+		}
+	}
+
+	// accuracy of the samples, on points spread over the bounds
+	glm::ivec3 cells = bricks * (int)BrickSize;
+	const int numProbes = 1 << 16;
+	std::vector<glm::vec3> probes(numProbes);
+	std::mt19937 random(1); // bakes run on BakeScheduler's thread: no shared rand() state
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	for (int i = 0; i < numProbes; i++)
+		probes[i] = boundsMin + glm::vec3(uniform(random), uniform(random), uniform(random)) * glm::vec3(cells) * cellSize;
+	stats.maxError = 0.0f;
+	for (int i = 0; i < numProbes; i++) {
+		bool filled;
+		float s = Trilinear(probes[i], filled);
+		if (filled)
+			stats.maxError = std::max(stats.maxError, std::abs(s - scene.Distance(probes[i])));
+	}
+	MeasureLipschitz(numFilled);
+
+	stats.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	stats.numBricks = numBricks;
+	stats.numFilledBricks = numFilled;
+	stats.bytes = atlas.size() * sizeof(float) + indirection.size() * sizeof(glm::vec2);
+	stats.denseBytes = (size_t)(cells.x + 1) * (cells.y + 1) * (cells.z + 1) * sizeof(float);
+
+	// per step cost
+	float sum = 0.0f;
+	auto analyticStart = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numProbes; i++)
+		sum += scene.Distance(probes[i]);
+	auto sampledStart = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numProbes; i++)
+		sum += Sample(probes[i]);
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.analyticNs = std::chrono::duration<double, std::nano>(sampledStart - analyticStart).count() / numProbes;
+	stats.sampledNs = std::chrono::duration<double, std::nano>(endTime - sampledStart).count() / numProbes;
+	volatile float sink = sum; // keeps the loops
+	(void)sink;
+}
+
+void BrickMap::MeasureLipschitz(int numFilled) {
+	// in a cell, each partial derivative of the trilinear interpolant is affine along the other axes, so
+	// |gradient|^2 is convex along each axis: its largest value is at a corner, from the three edges
+	// leaving it. A cell bounds the side of each of its corners.
+	size_t dy = atlasSize.x, dz = (size_t)atlasSize.x * atlasSize.y;
+	lipschitz = glm::vec2(1.0f);
+	for (int slot = 0; slot < numFilled; slot++) {
+		glm::ivec3 origin = SlotOrigin(slot);
+		for (int z = 0; z < BrickSize; z++)
+			for (int y = 0; y < BrickSize; y++)
+				for (int x = 0; x < BrickSize; x++) {
+					const float *s = &atlas[((size_t)(origin.z + z) * atlasSize.y + origin.y + y) * atlasSize.x + origin.x + x];
+					float c[8] = { s[0], s[1], s[dy], s[dy + 1], s[dz], s[dz + 1], s[dz + dy], s[dz + dy + 1] };
+					float bound = 0.0f;
+					bool outside = false, inside = false;
+					for (int k = 0; k < 8; k++) {
+						glm::vec3 edges(c[k ^ 1] - c[k], c[k ^ 2] - c[k], c[k ^ 4] - c[k]);
+						bound = std::max(bound, glm::length(edges) / cellSize);
+						outside = outside || c[k] > 0.0f;
+						inside = inside || c[k] < 0.0f;
+					}
+					if (outside) lipschitz.x = std::max(lipschitz.x, bound);
+					if (inside) lipschitz.y = std::max(lipschitz.y, bound);
+				}
+	}
+}
+
+std::string BrickMap::SceneKey(const CpuScene &scene, int resolution) {
+	std::string key = std::to_string(resolution) + " " + std::to_string(scene.root);
+	char node[128];
+	for (auto it = scene.nodes.begin(); it != scene.nodes.end(); ++it) {
+		snprintf(node, sizeof(node), " %d:%.9g:%d:%d", (int)it->op, it->param, it->a, it->b);
+		key += node;
+	}
+	return key;
+}
+
+void BrickMap::PrintStats(int blockId) const {
+	printf("Baked block %d: %dx%dx%d bricks of %d^3 cells (cell %.4f), %d filled (%.1f%%), %.2f MB (dense grid %.2f MB), %.1f ms\n",
+		blockId, bricks.x, bricks.y, bricks.z, BrickSize, cellSize, stats.numFilledBricks,
+		stats.numBricks ? 100.0 * stats.numFilledBricks / stats.numBricks : 0.0,
+		stats.bytes / 1048576.0, stats.denseBytes / 1048576.0, stats.bakeMs);
+	printf("  per step (CPU): %.1f ns analytic, %.1f ns sampled; max error in the band %.5f, trilinear gradient up to %.3f outside, %.3f inside\n",
+		stats.analyticNs, stats.sampledNs, stats.maxError, lipschitz.x, lipschitz.y);
+}
+
+bool BrickMap::Contains(const glm::vec3 &p) const {
+	glm::vec3 g = (p - boundsMin) / cellSize;
+	glm::vec3 cells = glm::vec3(bricks * (int)BrickSize);
+	return !IsEmpty() && g.x >= 0.0f && g.y >= 0.0f && g.z >= 0.0f && g.x <= cells.x && g.y <= cells.y && g.z <= cells.z;
+}
+
+float BrickMap::Sample(const glm::vec3 &p) const {
+	// same steps as sampleBrickMap() of BakedBlock
+	bool filled;
+	float s = Trilinear(p, filled);
+	if (!filled)
+		return s;
+	// the sampled surface is within margin of the scene's, |s| within margin of the scene distance
+	return s > 0.0f ? std::max(s - 2.0f * margin, s / lipschitz.x) : std::min(s + 2.0f * margin, s / lipschitz.y);
+}
+
+float BrickMap::Trilinear(const glm::vec3 &p, bool &filled) const {
+	glm::vec3 g = (p - boundsMin) / cellSize;
+	glm::ivec3 brick = glm::ivec3(glm::floor(g / (float)BrickSize));
+	brick = glm::ivec3(std::max(0, std::min(brick.x, bricks.x - 1)), std::max(0, std::min(brick.y, bricks.y - 1)), std::max(0, std::min(brick.z, bricks.z - 1)));
+	glm::vec2 entry = indirection[(brick.z * bricks.y + brick.y) * bricks.x + brick.x];
+	filled = entry.x >= 0.0f;
+	if (!filled)
+		return entry.y;
+
+	glm::vec3 local = glm::clamp(g - glm::vec3(brick * (int)BrickSize), 0.0f, (float)BrickSize);
+	glm::ivec3 i0 = glm::ivec3(std::min((int)local.x, BrickSize - 1), std::min((int)local.y, BrickSize - 1), std::min((int)local.z, BrickSize - 1));
+	glm::vec3 f = local - glm::vec3(i0);
+	glm::ivec3 origin = SlotOrigin((int)entry.x) + i0;
+	const float *s = &atlas[((size_t)origin.z * atlasSize.y + origin.y) * atlasSize.x + origin.x];
+	size_t dy = atlasSize.x, dz = (size_t)atlasSize.x * atlasSize.y;
+
+	float x00 = s[0] + (s[1] - s[0]) * f.x, x10 = s[dy] + (s[dy + 1] - s[dy]) * f.x;
+	float x01 = s[dz] + (s[dz + 1] - s[dz]) * f.x, x11 = s[dz + dy] + (s[dz + dy + 1] - s[dz + dy]) * f.x;
+	float y0 = x00 + (x10 - x00) * f.y, y1 = x01 + (x11 - x01) * f.y;
+	return y0 + (y1 - y0) * f.z;
+}
+
+
+void BakedTextures::Upload(const std::vector<BakedVolume> &volumes) {
+	Destroy();
+
+	for (size_t i = 0; i < volumes.size(); i++) {
+		const BrickMap &map = volumes[i].map;
+		if (map.IsEmpty())
+			continue;
+
+		Entry entry = { volumes[i].blockId, 0, 0 };
+		glActiveTexture(GL_TEXTURE0 + FirstTextureUnit + 2 * (int)entries.size());
+		glGenTextures(1, &entry.atlas);
+		glBindTexture(GL_TEXTURE_3D, entry.atlas);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, map.atlasSize.x, map.atlasSize.y, map.atlasSize.z, 0, GL_RED, GL_FLOAT, &map.atlas[0]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		glActiveTexture(GL_TEXTURE0 + FirstTextureUnit + 2 * (int)entries.size() + 1);
+		glGenTextures(1, &entry.indirection);
+		glBindTexture(GL_TEXTURE_3D, entry.indirection);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, map.bricks.x, map.bricks.y, map.bricks.z, 0, GL_RG, GL_FLOAT, &map.indirection[0]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		entries.push_back(entry);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void BakedTextures::SetSamplers(GLuint program) const {
+	for (size_t i = 0; i < entries.size(); i++) {
+		std::string id = std::to_string(entries[i].blockId);
+		glUniform1i(glGetUniformLocation(program, ("bakedAtlas" + id).c_str()), FirstTextureUnit + 2 * (int)i);
+		glUniform1i(glGetUniformLocation(program, ("bakedIndirection" + id).c_str()), FirstTextureUnit + 2 * (int)i + 1);
+	}
+}
+
+void BakedTextures::Destroy() {
+	for (size_t i = 0; i < entries.size(); i++) {
+		glDeleteTextures(1, &entries[i].atlas);
+		glDeleteTextures(1, &entries[i].indirection);
+	}
+	entries.clear();
+}
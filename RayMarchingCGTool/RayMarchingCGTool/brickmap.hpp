@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef BRICKMAP_HPP
+#define BRICKMAP_HPP
+
+#include <vector>
+#include <string>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+
+// Sparse narrow-band sampling of a CpuScene. The bounds of the surface (plus a brick of margin) are
+// split into bricks of BrickSize^3 cells; only the bricks the surface may cross store their corner
+// samples, in the slots of an atlas. The indirection grid maps every brick to its slot, or gives
+// empty bricks a distance bound valid over the whole brick (|d(center)| - half diagonal - margin).
+// Trilinear samples are not a distance bound: their gradient reaches sqrt(3) on the ridges of the
+// scene. The sampled surface lies within margin of the scene's, so Sample() steps by the larger of
+// |trilinear| - 2 margin and |trilinear| / (its measured gradient bound), and the analytic distance
+// outside the bake is lowered by margin (Outside()).
+class BrickMap {
+
+public:
+	static const int BrickSize = 8; // cells per brick edge
+	static const int BrickSamples = BrickSize + 1; // samples per brick edge: neighbours duplicate the shared face
+	static const int BandCells = 2; // extra cells around the surface whose bricks are filled
+	static const int MaxAtlasSlots = 16; // slots per atlas row and per layer
+	static const int BakeBatchBricks = 1024; // filled bricks evaluated per SdfQuery call
+
+	struct Stats {
+		double bakeMs;
+		int numBricks, numFilledBricks;
+		size_t bytes; // atlas and indirection
+		size_t denseBytes; // one float per cell corner of the whole grid
+		double analyticNs, sampledNs; // one CPU distance: scene program, Sample()
+		float maxError; // |trilinear - scene()| in filled bricks: how far the surface moves (<= margin)
+	};
+
+	BrickMap() : cellSize(0.0f), margin(0.0f), lipschitz(1.0f), bricks(0), slots(0), atlasSize(0) { stats = Stats(); }
+
+	// resolution: cells along the longest side of the surface bounds; numThreads: 0 for one per core
+	void Bake(const CpuScene &scene, int resolution, int numThreads);
+	bool IsEmpty() const { return indirection.empty(); }
+	static std::string SceneKey(const CpuScene &scene, int resolution); // equal keys give the same bake
+	void PrintStats(int blockId) const;
+
+	// as the generated shader; only meaningful inside the bake bounds
+	bool Contains(const glm::vec3 &p) const;
+	float Sample(const glm::vec3 &p) const;
+	// outside the bake bounds: the analytic distance of the scene, lowered by margin
+	float Outside(float d) const { return d > 0.0f ? d - margin : d + margin; }
+
+	glm::vec3 boundsMin;
+	float cellSize;
+	float margin; // half cell diagonal: error bound of trilinear samples of a distance bound
+	glm::vec2 lipschitz; // gradient bound of the trilinear samples outside (x) and inside (y) the surface, >= 1
+	glm::ivec3 bricks; // per axis, x fastest in indirection
+	glm::ivec3 slots; // atlas slots per axis (x and y are used by the lookup)
+	glm::ivec3 atlasSize; // samples
+	std::vector<glm::vec2> indirection; // slot (-1: empty brick), distance bound of empty bricks
+	std::vector<float> atlas; // x fastest
+	Stats stats;
+
+private:
+	float Trilinear(const glm::vec3 &p, bool &filled) const; // the value of an empty brick otherwise
+	void MeasureLipschitz(int numFilled);
+
+	glm::ivec3 SlotOrigin(int slot) const {
+		return glm::ivec3(slot % slots.x, (slot / slots.x) % slots.y, slot / (slots.x * slots.y)) * (int)BrickSamples;
+	}
+};
+
+// Brick map of a BakedBlock, as handed to the renderers
+struct BakedVolume {
+	int blockId;
+	BrickMap map;
+};
+
+// GL copies of the bakes of a graph: an atlas (trilinear) and an indirection (texelFetch) 3D texture
+// per bake, bound once on consecutive texture units for the bakedAtlas<id> / bakedIndirection<id> samplers
+class BakedTextures {
+
+public:
+	static const int FirstTextureUnit = 2; // 0 and 1: G-buffer
+
+	BakedTextures() {}
+
+	void Upload(const std::vector<BakedVolume> &volumes); // replaces the previous textures
+	void SetSamplers(GLuint program) const; // the program must be in use
+	void Destroy();
+
+private:
+	struct Entry {
+		int blockId;
+		GLuint atlas, indirection;
+	};
+
+	std::vector<Entry> entries;
+};
+
+
+#endif
@@ -0,0 +1,49 @@
+#include "camera.hpp"
+
+#include <cmath>
+
+// Include GLM
+#include <glm/gtc/type_ptr.hpp>
+
+static float FocalFromFov(float fovYDegrees) {
+	return 0.5f / std::tan(0.5f * fovYDegrees / 180.0f * 3.1415926f);
+}
+
+Camera Camera::Orbit(float time) {
+	// rotation starting from zPos, looking at the origin
+	float c = std::cos(time * 0.09f), s = std::sin(time * 0.09f);
+	Camera camera;
+	camera.position = glm::vec3(0.0f, 5.0f * c, 5.0f * s);
+	camera.basis = glm::mat3(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, s, -c), glm::vec3(0.0f, c, s));
+	camera.focal = FocalFromFov(45.0f);
+	return camera;
+}
+
+Camera Camera::LookAt(glm::vec3 position, glm::vec3 target, glm::vec3 up, float fovYDegrees) {
+	glm::vec3 backward = glm::normalize(position - target);
+	glm::vec3 right = glm::normalize(glm::cross(up, backward));
+	glm::vec3 screenUp = glm::cross(backward, right);
+	Camera camera;
+	camera.position = position;
+	camera.basis = glm::mat3(right, -screenUp, backward); // pt.y grows downwards
+	camera.focal = FocalFromFov(fovYDegrees);
+	return camera;
+}
+
+glm::vec3 Camera::RayDirection(glm::vec2 fragCoord, glm::vec2 resolution) const {
+	glm::vec2 pos = fragCoord / resolution;
+	glm::vec2 pt = -1.0f + 2.0f * glm::vec2(pos.x, 1.0f - pos.y);
+	return glm::normalize(basis * glm::vec3(pt * resolution, -focal * resolution.y));
+}
+
+void CameraUniforms::Locate(GLuint program) {
+	position = glGetUniformLocation(program, "cameraPosition");
+	basis = glGetUniformLocation(program, "cameraBasis");
+	focal = glGetUniformLocation(program, "cameraFocal");
+}
+
+void CameraUniforms::Set(const Camera &camera) const {
+	glUniform3fv(position, 1, glm::value_ptr(camera.position));
+	glUniformMatrix3fv(basis, 1, GL_FALSE, glm::value_ptr(camera.basis));
+	glUniform1f(focal, camera.focal);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+// Pinhole camera of the generated shaders: camera() shoots
+// dir = basis * vec3(pt * resolution, -focal * resolution.y) from position
+struct Camera {
+	glm::vec3 position;
+	glm::mat3 basis; // columns: screen x, screen -y, backward
+	float focal; // 0.5 / tan(fovY / 2)
+
+	// the default camera, circling the origin in the yz plane (time in seconds)
+	static Camera Orbit(float time);
+	static Camera LookAt(glm::vec3 position, glm::vec3 target, glm::vec3 up, float fovYDegrees = 45.0f);
+
+	// CPU counterpart of camera(): normalized direction of the ray through fragCoord
+	glm::vec3 RayDirection(glm::vec2 fragCoord, glm::vec2 resolution) const;
+};
+
+// Locations of the camera uniforms in one program
+struct CameraUniforms {
+	GLint position;
+	GLint basis;
+	GLint focal;
+
+	CameraUniforms() : position(-1), basis(-1), focal(-1) {}
+	void Locate(GLuint program);
+	void Set(const Camera &camera) const; // the program must be in use
+};
+
+
+#endif
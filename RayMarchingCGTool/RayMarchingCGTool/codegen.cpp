@@ -1,24 +1,326 @@
 #include "codegen.hpp"
 
 #include "block.hpp"
+#include "appstate.hpp"
+#include "brickmap.hpp"
+#include "bakescheduler.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+
+const float CodeGenManager::AutoBakeMaxError = 0.5f;
+
+// a time-invariant subtree is taken whole (its inputs are cheaper), time-dependent blocks stay analytic
+static void CollectAutoBakeRoots(Block *block, float minCost, std::vector<Block *> &roots) {
+	if (!block->IsTimeDependent()) {
+		if (block->EstimateCost() > minCost && !dynamic_cast<BakedBlock *>(block))
+			roots.push_back(block);
+		return;
+	}
+	for (auto it = block->srcBlocks.begin(); it != block->srcBlocks.end(); ++it) if (*it && (*it)->from)
+		CollectAutoBakeRoots((*it)->from, minCost, roots);
+}
 
 std::string CodeGenManager::GenerateBlockDefinitions() {
 	std::string impl;
+	std::set<std::string> defined;
 
-	// todo: ظblock
+	// ظblock (same block type used several times)
 	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) {
-		impl += (*it)->GenerateDefinition();
+		std::string definition = (*it)->GenerateDefinition();
+		if (defined.insert(definition).second)
+			impl += definition;
 	}
 
+	// auto bakes (not in the sweep: its params change the subtrees)
+	for (auto it = autoBakes.begin(); it != autoBakes.end() && !paramsFromSweep; ++it)
+		if (!it->second.map.IsEmpty() && defined.insert(GenerateBrickMapLookup()).second)
+			impl += GenerateBrickMapLookup();
+
+	std::set<Block *> visited;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it)
+		AppendSubsceneDefinitions(*it, false, visited, impl);
+
 	return impl;
 }
 
+std::string CodeGenManager::GenerateNativeBlockDefinitions() {
+	std::string impl;
+	std::set<std::string> defined;
+
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) {
+		std::string definition = (*it)->GenerateNativeDefinition();
+		if (defined.insert(definition).second)
+			impl += definition;
+	}
+
+	std::set<Block *> visited;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it)
+		AppendSubsceneDefinitions(*it, true, visited, impl);
+
+	return impl;
+}
+
+void CodeGenManager::AppendSubsceneDefinitions(Block *block, bool native, std::set<Block *> &visited, std::string &impl) {
+	// subscene definitions call the callsites of their inputs, which may be subscenes themselves
+	if (!visited.insert(block).second)
+		return;
+	for (auto it = block->srcBlocks.begin(); it != block->srcBlocks.end(); ++it) if (*it && (*it)->from)
+		AppendSubsceneDefinitions((*it)->from, native, visited, impl);
+	impl += native ? block->GenerateNativeSubsceneDefinition() : block->GenerateSubsceneDefinition();
+
+	auto bake = autoBakes.find(block->id);
+	if (bake == autoBakes.end() || bake->second.map.IsEmpty())
+		return;
+	if (native)
+		impl += GenerateNativeBakedDefinition(block->id, block->GenerateCallsite());
+	else if (!paramsFromSweep)
+		impl += GenerateBakedDefinition(block->id, bake->second.map, block->GenerateCallsite());
+}
+
+std::string CodeGenManager::GenerateParam(const Block *block, int paramIdx) {
+	if (!paramsFromSweep)
+		return GenerateExpressionLiteral(block->params[paramIdx]);
+
+	// index in GetParams() order
+	int index = paramIdx;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); *it != block; ++it)
+		index += (int)(*it)->params.size();
+	return "sweepParam(paramBase + " + std::to_string(index) + ")";
+}
+
+std::vector<float> CodeGenManager::GetParams() {
+	std::vector<float> params;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it)
+		params.insert(params.end(), (*it)->params.begin(), (*it)->params.end());
+	return params;
+}
+
+std::vector<BakedVolume> CodeGenManager::GetBakes() {
+	std::vector<BakedVolume> bakes;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) {
+		BakedBlock *block = dynamic_cast<BakedBlock *>(*it);
+		if (block && block->IsBaked()) {
+			BakedVolume volume = { block->id, *block->bake };
+			bakes.push_back(volume);
+		}
+	}
+	for (auto it = autoBakes.begin(); it != autoBakes.end(); ++it) if (!it->second.map.IsEmpty()) {
+		BakedVolume volume = { it->first, it->second.map };
+		bakes.push_back(volume);
+	}
+	return bakes;
+}
+
+bool CodeGenManager::UpdateAutoBakes() {
+	std::vector<Block *> roots;
+	float minCost = AppState::getInstance().autoBakeCost;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it)
+		if (dynamic_cast<ScreenBlock *>(*it) && minCost > 0.0f && (*it)->srcBlocks[0] && (*it)->srcBlocks[0]->from)
+			CollectAutoBakeRoots((*it)->srcBlocks[0]->from, minCost, roots);
+
+	// unchanged subtrees keep their bake, the others are requested from BakeScheduler (analytic until taken)
+	bool changed = false;
+	std::map<int, AutoBake> bakes;
+	for (auto it = roots.begin(); it != roots.end(); ++it) {
+		CpuScene scene;
+		scene.root = (*it)->BuildCpuNode(scene);
+		scene.Compile();
+		AutoBake &bake = bakes[(*it)->id];
+		bake.key = BrickMap::SceneKey(scene, AutoBakeResolution);
+		bake.done = false;
+
+		auto previous = autoBakes.find((*it)->id);
+		if (previous != autoBakes.end() && previous->second.key == bake.key && previous->second.done) {
+			std::swap(bake, previous->second);
+			continue;
+		}
+		if (!BakeScheduler::getInstance().Take((*it)->id, bake.key, bake.map)) {
+			BakeScheduler::getInstance().Request((*it)->id, bake.key, scene, AutoBakeResolution);
+			continue;
+		}
+		bake.done = true;
+		if (bake.map.IsEmpty())
+			continue;
+		// the sampled surface moves by up to maxError: too coarse for the subtree, it stays analytic
+		if (bake.map.stats.maxError > AutoBakeMaxError * bake.map.cellSize) {
+			printf("Kept block %d analytic: its bake moves the surface by %.2f cells (limit %.2f)\n",
+				(*it)->id, bake.map.stats.maxError / bake.map.cellSize, AutoBakeMaxError);
+			bake.map = BrickMap();
+			continue;
+		}
+		printf("Auto-baked the time-invariant subtree of block %d (estimated cost %.0f)\n", (*it)->id, (*it)->EstimateCost());
+		bake.map.PrintStats((*it)->id);
+		changed = true;
+	}
+	// dropped subtrees: their requests and the bakes sampled so far
+	for (auto it = autoBakes.begin(); it != autoBakes.end(); ++it) {
+		if (!bakes.count(it->first))
+			BakeScheduler::getInstance().Cancel(it->first);
+		changed = changed || !it->second.map.IsEmpty();
+	}
+	autoBakes.swap(bakes);
+	return changed;
+}
+
+std::string CodeGenManager::GenerateCallsite(Block *block) {
+	auto it = autoBakes.find(block->id);
+	if (it == autoBakes.end() || it->second.map.IsEmpty() || paramsFromSweep)
+		return block->GenerateCallsite();
+	return "baked" + std::to_string(block->id) + "(p)";
+}
+
+std::string CodeGenManager::GenerateBrickMapLookup() {
+	std::string brickSize = std::to_string(BrickMap::BrickSize);
+	return
+		R"(
+// baked subtrees: brick map lookup, g in cells from the bake bounds (as BrickMap::Sample)
+// bound: twice the margin of the sampled surface, trilinear gradient bound outside and inside
+float sampleBrickMap(sampler3D atlas, sampler3D indirection, ivec2 slots, vec3 g, vec3 bound)
+{
+	ivec3 brick = clamp(ivec3(floor(g / )" + brickSize + R"(.0)), ivec3(0), textureSize(indirection, 0) - 1);
+	vec2 entry = texelFetch(indirection, brick, 0).xy;
+	if (entry.x < 0.0) return entry.y; // empty brick: distance bound
+	int slot = int(entry.x);
+	vec3 origin = vec3(ivec3(slot % slots.x, (slot / slots.x) % slots.y, slot / (slots.x * slots.y)) * )" + std::to_string(BrickMap::BrickSamples) + R"();
+	vec3 local = clamp(g - vec3(brick * )" + brickSize + R"(), 0.0, )" + brickSize + R"(.0);
+	float s = textureLod(atlas, (origin + local + 0.5) / vec3(textureSize(atlas, 0)), 0.0).x;
+	return s > 0.0 ? max(s - bound.x, s / bound.y) : min(s + bound.x, s / bound.z);
+}
+		)";
+}
+
+std::string CodeGenManager::GenerateBakedDefinition(int id, const BrickMap &map, const std::string &analyticCallsite) {
+	std::string name = std::to_string(id);
+	glm::ivec3 cells = map.bricks * (int)BrickMap::BrickSize;
+	return
+		R"(
+uniform sampler3D bakedAtlas)" + name + R"(;
+uniform sampler3D bakedIndirection)" + name + R"(;
+float baked)" + name + R"((vec3 p)
+{
+	vec3 g = (p - vec3()" + GenerateExpressionLiteral(map.boundsMin.x) + ", " + GenerateExpressionLiteral(map.boundsMin.y) + ", " + GenerateExpressionLiteral(map.boundsMin.z) + R"()) / )" + GenerateExpressionLiteral(map.cellSize) + R"(;
+	if (any(lessThan(g, vec3(0.0))) || any(greaterThan(g, vec3()" + std::to_string(cells.x) + ", " + std::to_string(cells.y) + ", " + std::to_string(cells.z) + R"())))
+	{
+		// lowered by the margin of the sampled surface (BrickMap::Outside)
+		float d = )" + analyticCallsite + R"(;
+		return d - sign(d) * )" + GenerateExpressionLiteral(map.margin) + R"(;
+	}
+	return sampleBrickMap(bakedAtlas)" + name + ", bakedIndirection" + name + ", ivec2(" + std::to_string(map.slots.x) + ", " + std::to_string(map.slots.y) + R"(), g,
+		vec3()" + GenerateExpressionLiteral(2.0f * map.margin) + ", " + GenerateExpressionLiteral(map.lipschitz.x) + ", " + GenerateExpressionLiteral(map.lipschitz.y) + R"());
+}
+		)";
+}
+
+std::string CodeGenManager::GenerateNativeBakedDefinition(int id, const std::string &analyticCallsite) {
+	// the C++ backend stays analytic
+	return
+		R"(
+float baked)" + std::to_string(id) + R"((vec3 p)
+{
+	return )" + analyticCallsite + R"(;
+}
+		)";
+}
+
+std::string CodeGenManager::GenerateSweepFragShader() {
+	// the scene reads its params from the instance's slice of sweepParams
+	paramsFromSweep = true;
+	std::string shader = GenerateSweepFragShaderTemplate() +
+		GenerateBlockDefinitions() +
+		GenerateScene() +
+		GenerateRayMarchingTemplate() +
+		GenerateShadingTemplate() +
+		GenerateSweepMainTemplate();
+	paramsFromSweep = false;
+	return shader;
+}
+
+static bool WriteShaderFile(const std::string &fileName, const std::string &shaderStr)
+{
+	FILE *file;
+	if (fopen_s(&file, fileName.c_str(), "w") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", fileName.c_str());
+		return false;
+	}
+	fprintf(file, "%s", shaderStr.c_str());
+	fclose(file);
+	return true;
+}
+
+bool CodeGenManager::UpdateBakes() {
+	bool changed = false;
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it)
+		if (BakedBlock *block = dynamic_cast<BakedBlock *>(*it))
+			changed = block->Bake() || changed;
+	return UpdateAutoBakes() || changed;
+}
+
+void CodeGenManager::FinishBakes() {
+	UpdateBakes();
+	BakeScheduler::getInstance().Wait();
+	UpdateBakes();
+}
+
+bool CodeGenManager::WriteShaderFiles() {
+	// the generated code samples the finished bakes
+	UpdateBakes();
+
+	bool ok = WriteShaderFile(AppState::OutputShaderName, GenerateFragShader());
+	ok = WriteShaderFile(AppState::OutputMarchShaderName, GenerateMarchShader()) && ok;
+	ok = WriteShaderFile(AppState::OutputComputeShaderName, GenerateComputeShader()) && ok;
+	ok = WriteShaderFile(AppState::OutputSweepVertexShaderName, GenerateSweepVertexShader()) && ok;
+	ok = WriteShaderFile(AppState::OutputSweepShaderName, GenerateSweepFragShader()) && ok;
+	ok = WriteShaderFile(AppState::OutputExpressionHeaderName, GenerateExpressionHeader()) && ok;
+	return ok;
+}
+
+
+std::string CodeGenManager::GenerateExpressionLiteral(float value) {
+	// the shortest of %.6g to %.9g that reads back exactly (9 digits always do)
+	char literal[64];
+	for (int digits = 6; digits <= 9; digits++) {
+		snprintf(literal, sizeof(literal), "%.*g", digits, value);
+		if (strtof(literal, NULL) == value)
+			break;
+	}
+	std::string str = literal;
+	if (str.find_first_of(".e") == std::string::npos)
+		str += ".0";
+	return str + "f";
+}
+
+std::string CodeGenManager::GenerateExpressionHeader() {
+	std::string type = "sdf::Empty", value = "sdf::Empty()";
+
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) if (dynamic_cast<ScreenBlock *>(*it)) {
+		type = (*it)->GenerateExpressionType();
+		value = (*it)->GenerateExpressionValue();
+	}
+
+	return R"(// generated by CodeGenManager::GenerateExpressionHeader()
+#pragma once
+
+#include "sdfexpr.hpp"
+
+namespace GeneratedScene {
+
+	typedef )" + type + R"( Scene;
+
+	// scene(x, y, z), scene.Id(x, y, z), scene.Bound()
+	constexpr Scene scene = )" + value + R"(;
+
+}
+)";
+}
 
 std::string CodeGenManager::GenerateScene() {
-	std::string impl;
+	std::string impl, idImpl;
 
 	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) if (dynamic_cast<ScreenBlock *>(*it)) {
 		impl = (*it)->GenerateCallsite();
+		idImpl = (*it)->GenerateIdCallsite();
 	}
 
 	return R"(
@@ -26,6 +328,12 @@ float scene(vec3 p)
 {
 	return )" + (impl.empty() ? "0.0" : impl) + R"(;
 }
+
+// distance and id of the contributing leaf block
+vec2 sceneId(vec3 p)
+{
+	return )" + (idImpl.empty() ? "vec2(0.0, -1.0)" : idImpl) + R"(;
+}
 )";
 
 }
\ No newline at end of file
@@ -4,9 +4,16 @@
 #define CODEGEN_HPP
 
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 
+#include "brickmap.hpp"
 
 
+class Block;
+
 class CodeGenManager {
 
 public:
@@ -15,11 +22,45 @@ public:
 		return instance;
 	}
 
+	// forward shading: march, light and fog in one program
 	std::string GenerateFragShader() {
 		return GenerateFragShaderTemplate() +
 			GenerateBlockDefinitions() +
 			GenerateScene() +
-			GenerateRayMarchingTemplate();
+			GenerateRayMarchingTemplate() +
+			GenerateShadingTemplate() +
+			GenerateForwardMainTemplate();
+	}
+
+	// deferred shading: march pass writing the G-buffer (lighting is done by Shading.fragmentshader)
+	std::string GenerateMarchShader() {
+		return GenerateMarchShaderTemplate() +
+			GenerateBlockDefinitions() +
+			GenerateScene() +
+			GenerateRayMarchingTemplate() +
+			GenerateMarchMainTemplate();
+	}
+
+	// compute backend (GL 4.3): persistent workgroups pull screen tiles from a queue
+	static const int ComputeTileSize = 8; // = workgroup size
+
+	std::string GenerateComputeShader() {
+		return GenerateComputeShaderTemplate() +
+			GenerateBlockDefinitions() +
+			GenerateScene() +
+			GenerateRayMarchingTemplate() +
+			GenerateShadingTemplate() +
+			GenerateComputeMainTemplate();
+	}
+
+
+	// native backend (NativeScene): scene() and sceneId() in C++ for the system compiler,
+	// the callsites and block definitions are the GLSL ones on a prelude of vec2 / vec3 helpers
+	std::string GenerateNativeSource() {
+		return GenerateNativeTemplate() +
+			GenerateNativeBlockDefinitions() +
+			GenerateScene() +
+			GenerateNativeMainTemplate();
 	}
 
 
@@ -31,13 +72,137 @@ public:
 out vec4 color;
 uniform vec2 resolution;
 uniform float time;
+uniform int aaMode; // 0: single ray, 1: edge-adaptive supersampling
+uniform vec2 jitter; // sub-pixel ray offset (temporal accumulation)
+uniform vec2 tileOrigin; // poster tiles: position of the viewport in the full image (resolution)
 
 
 vec2 pt;
 		)";
 	}
 
+	std::string GenerateMarchShaderTemplate() {
+		return R"(
+#version 330 core
+
+// Ouput data (G-buffer)
+layout(location = 0) out vec4 gPositionDepth; // hit position, hit distance t
+layout(location = 1) out vec4 gNormalId; // surface normal, leaf block id (-1: no hit)
+uniform vec2 resolution;
+uniform float time;
+
+
+vec2 pt;
+		)";
+	}
+
+	std::string GenerateComputeShaderTemplate() {
+		return R"(
+#version 430 core
+
+layout(local_size_x = )" + std::to_string(ComputeTileSize) + ", local_size_y = " + std::to_string(ComputeTileSize) + R"() in;
+
+// Ouput data
+layout(rgba8, binding = 0) uniform writeonly image2D outputImage;
+// Work queue (reset to 0 every frame)
+layout(std430, binding = 0) buffer TileQueue { uint nextTile; };
+uniform ivec2 tileCount;
+uniform vec2 resolution;
+uniform float time;
+
+
+vec2 pt;
+		)";
+	}
+
+	// parameter sweep: a grid of instanced tiles, each rendering the scene with its own block params
+	// (element instance * GetParams().size() + k of sweepParams, see DisplayWindowInfo::RenderSweep)
+	static const int SweepGridX = 4;
+	static const int SweepGridY = 4;
+
+	std::string GenerateSweepFragShader();
+
+	std::string GenerateSweepVertexShader() {
+		return R"(
+#version 330 core
+
+// Input vertex data: the full-screen quad, scaled into the instance's tile
+layout(location = 0) in vec3 vertexPosition_modelspace;
+uniform ivec2 sweepGrid;
+uniform vec2 screenResolution;
+
+flat out int instance;
+flat out vec2 tileOrigin; // pixels
+
+void main(){
+	instance = gl_InstanceID;
+	// instance 0 is the top-left tile
+	vec2 cell = vec2(gl_InstanceID % sweepGrid.x, sweepGrid.y - 1 - gl_InstanceID / sweepGrid.x);
+	vec2 tileSize = 2.0 / vec2(sweepGrid);
+	gl_Position = vec4(-1.0 + (cell + 0.5 * (vertexPosition_modelspace.xy + 1.0)) * tileSize, 0.0, 1.0);
+	tileOrigin = cell * screenResolution / vec2(sweepGrid);
+}
+)";
+	}
+
+	// block params: literals, or sweepParams elements while generating the sweep shader
+	std::string GenerateParam(const Block *block, int paramIdx);
+	std::vector<float> GetParams(); // every block param, in blockList order
+	std::vector<BakedVolume> GetBakes(); // brick map of every baked BakedBlock and auto bake, for the renderers
+
+	// hybrid evaluation: the maximal time-invariant subtrees under the Screen block whose estimated cost
+	// exceeds AppState::autoBakeCost are baked and sampled like a BakedBlock; the rest stays analytic,
+	// as do the subtrees whose bake is too coarse
+	static const int AutoBakeResolution = 128;
+	static const float AutoBakeMaxError; // cells the sampled surface may move
+	bool UpdateAutoBakes(); // main thread; takes the finished bakes of the subtrees and requests the stale ones
+	std::string GenerateCallsite(Block *block); // as seen by its parent: the auto bake sample, if any
+
+	// BakedBlock and auto bakes: float baked<id>(vec3 p), analytic outside the bake bounds
+	static std::string GenerateBrickMapLookup();
+	static std::string GenerateBakedDefinition(int id, const BrickMap &map, const std::string &analyticCallsite);
+	static std::string GenerateNativeBakedDefinition(int id, const std::string &analyticCallsite);
+
+	// BakedBlocks and auto bakes take their finished bakes and request the stale ones (BakeScheduler)
+	bool UpdateBakes(); // main thread; true when the generated code changes
+	void FinishBakes(); // waits for every requested bake (headless, validator)
+
+	// take the finished bakes, run codegen for the current BlockGraph and write every Output* shader file (and the expression header)
+	bool WriteShaderFiles();
+
+	// header-only C++ (sdfexpr.hpp): the graph as a type expression, for embedding fixed scenes
+	std::string GenerateExpressionHeader();
+	static std::string GenerateExpressionLiteral(float value); // float literal that reads back exactly (GLSL and C++)
+
+	std::string GenerateSweepFragShaderTemplate() {
+		int numParams = (int)GetParams().size();
+		return R"(
+#version 330 core
+
+// Ouput data
+out vec4 color;
+flat in int instance;
+flat in vec2 tileOrigin;
+uniform vec2 screenResolution;
+uniform ivec2 sweepGrid;
+uniform float time;
+// packed by 4: float array elements may take a vec4 slot each
+uniform vec4 sweepParams[)" + std::to_string((SweepGridX * SweepGridY * std::max(numParams, 1) + 3) / 4) + R"(];
+
+const int numParams = )" + std::to_string(numParams) + R"(;
+vec2 resolution = vec2(1.0); // of a tile (set by main)
+int paramBase = 0;
+vec2 pt;
+
+float sweepParam(int i)
+{
+	return sweepParams[i / 4][i % 4];
+}
+		)";
+	}
+
 	std::string GenerateBlockDefinitions();
+	std::string GenerateNativeBlockDefinitions();
 
 	std::string GenerateScene();
 
@@ -54,33 +219,43 @@ vec3 norm(vec3 p)
 	return normalize(n);
 }
 
-void main(void)
+// set from a Camera (camera.hpp)
+uniform vec3 cameraPosition;
+uniform mat3 cameraBasis; // columns: screen x, screen -y, backward
+uniform float cameraFocal; // 0.5 / tan(fovY / 2)
+
+void camera(vec2 fragCoord, out vec3 ray, out vec3 dir)
 {
-	vec2 pos = gl_FragCoord.xy / resolution.xy;
+	vec2 pos = fragCoord / resolution.xy;
 	pt = -1.0 + 2.0 * vec2(pos.x, 1.0-pos.y);
 
-	// camera
-	vec3 dir = normalize(vec3(pt * resolution.xy, -0.5 * resolution.y / tan(0.5 * 45.0 / 180.0 * 3.1415926 ))); // looking from zPos
-	vec2 rot = vec2(cos(time * 0.09), sin(time * 0.09)); // rotation starting from zPos
-	vec3 ray = vec3(0.0, rot * 5.0);
-	dir = vec3(dir.x, dot(vec2(dir.z, -dir.y), vec2(rot.x, -rot.y)), dot(vec2(dir.z, -dir.y), rot.yx) );
+	ray = cameraPosition;
+	dir = normalize(cameraBasis * vec3(pt * resolution.xy, -cameraFocal * resolution.y));
+}
 
-	// raymarching
+float march(vec3 ray, vec3 dir)
+{
 	float t = 0.0;
 	for (int i = 0; i < 90; i++)
 	{
 		float k = scene(ray + dir * t);
 		t += k;
 	}
-	vec3 hit = ray + dir * t;
+	return t;
+}
+		)";
+	}
 
+	std::string GenerateShadingTemplate() {
+		return R"(
+vec3 shade(vec3 ray, vec3 hit)
+{
 	// fog
 	float fogFact = clamp(exp(-distance(ray, hit) * 0.3), 0.0, 1.0);
 
 	if (fogFact < 0.05)
 	{
-		color = vec4(0.0, 0.0, 0.0, 1.0);
-		return;
+		return vec3(0.0);
 	}
 
 	// diffuse & specular light
@@ -98,14 +273,255 @@ void main(void)
 	// iq's vignetting
 //	col *= 0.1 + 0.8 * pow(16.0 * pos.x * pos.y * (1.0 - pos.x) * (1.0 - pos.y), 0.1);
 
+	return col;
+}
+		)";
+	}
+
+	std::string GenerateForwardMainTemplate() {
+		return R"(
+// shade the camera ray through fragCoord; t returns the hit distance
+vec3 trace(vec2 fragCoord, out float t)
+{
+	vec3 ray, dir;
+	camera(fragCoord, ray, dir);
+
+	// raymarching
+	t = march(ray, dir);
+
+	return shade(ray, ray + dir * t);
+}
+
+// leaf block the ray through fragCoord hit at distance t, as the G-buffer id (-1: no surface)
+float hitId(vec2 fragCoord, float t)
+{
+	vec3 ray, dir;
+	camera(fragCoord, ray, dir);
+	vec3 hit = ray + dir * t;
+	return abs(scene(hit)) < 0.01 ? sceneId(hit).y : -1.0;
+}
+
+void main(void)
+{
+	vec2 fragCoord = gl_FragCoord.xy + tileOrigin;
+	float t;
+	vec3 col = trace(fragCoord + jitter, t);
+	float id = -1.0;
+	if (aaMode == 1)
+		id = hitId(fragCoord + jitter, t);
+
+	// edge-adaptive supersampling: the 2x2 quad neighbours disagree on the hit distance, or hit
+	// different blocks (a silhouette over a surface at the same depth)
+	if (aaMode == 1 && (abs(dFdx(t)) + abs(dFdy(t)) > 0.05 * t || dFdx(id) != 0.0 || dFdy(id) != 0.0))
+	{
+		// rotated grid
+		float ts;
+		col += trace(fragCoord + vec2( 0.125,  0.375), ts);
+		col += trace(fragCoord + vec2(-0.375,  0.125), ts);
+		col += trace(fragCoord + vec2(-0.125, -0.375), ts);
+		col += trace(fragCoord + vec2( 0.375, -0.125), ts);
+		col *= 0.2;
+	}
+
 	color = vec4(col, 1.0);
 
 }
 		)";
 	}
 
+	std::string GenerateMarchMainTemplate() {
+		return R"(
+void main(void)
+{
+	vec3 ray, dir;
+	camera(gl_FragCoord.xy, ray, dir);
+
+	// raymarching
+	float t = march(ray, dir);
+	vec3 hit = ray + dir * t;
+
+	// the id is only meaningful where the march converged on a surface
+	gPositionDepth = vec4(hit, t);
+	gNormalId = vec4(norm(hit), abs(scene(hit)) < 0.01 ? sceneId(hit).y : -1.0);
+}
+		)";
+	}
+
+	std::string GenerateComputeMainTemplate() {
+		return R"(
+shared uint tileIndex;
+shared float tileStart; // every ray of the tile can start marching here
+
+// march a cone enclosing all rays of the tile; returns a distance safe for each of them
+float coneMarch(vec3 ray, vec3 dir, float slope)
+{
+	float t = 0.0;
+	for (int i = 0; i < 48; i++)
+	{
+		// the cone is (t + step) * slope wide at t + step: the ball free of surface around
+		// the axis point holds it while step + (t + step) * slope <= scene()
+		float step = (scene(ray + dir * t) - t * slope) / (1.0 + slope);
+		if (step < 0.001) break;
+		t += step;
+	}
+	return t;
+}
+
+float marchFrom(vec3 ray, vec3 dir, float t)
+{
+	for (int i = 0; i < 90; i++)
+	{
+		float k = scene(ray + dir * t);
+		t += k;
+		if (abs(k) < 0.00001) break;
+	}
+	return t;
+}
+
+void main(void)
+{
+	uint numTiles = uint(tileCount.x * tileCount.y);
+
+	// persistent threads: the workgroup pulls tiles until the queue is drained,
+	// so an expensive tile only delays its own workgroup
+	while (true)
+	{
+		if (gl_LocalInvocationIndex == 0u)
+		{
+			tileIndex = atomicAdd(nextTile, 1u);
+		}
+		barrier();
+		uint tile = tileIndex;
+		if (tile >= numTiles) break; // uniform: every invocation read the same index
+
+		ivec2 tileOrigin = ivec2(tile % uint(tileCount.x), tile / uint(tileCount.x)) * ivec2(gl_WorkGroupSize.xy);
+
+		// coarse per-tile bound, shared with the whole workgroup
+		if (gl_LocalInvocationIndex == 0u)
+		{
+			vec2 tileSize = vec2(gl_WorkGroupSize.xy);
+			vec3 ray, dir, cornerRay, cornerDir;
+			camera(vec2(tileOrigin) + 0.5 * tileSize, ray, dir);
+			// the widest corner: the projection is not symmetric about the tile center
+			float slope = 0.0;
+			for (int corner = 0; corner < 4; corner++)
+			{
+				camera(vec2(tileOrigin) + tileSize * vec2(corner & 1, corner >> 1), cornerRay, cornerDir);
+				slope = max(slope, length(cornerDir - dir)); // a unit ray strays at most this far from the axis per unit length
+			}
+			tileStart = coneMarch(ray, dir, slope);
+		}
+		barrier();
+
+		ivec2 pixel = tileOrigin + ivec2(gl_LocalInvocationID.xy);
+		if (all(lessThan(pixel, ivec2(resolution))))
+		{
+			vec3 ray, dir;
+			camera(vec2(pixel) + 0.5, ray, dir);
+			float t = marchFrom(ray, dir, tileStart);
+			imageStore(outputImage, pixel, vec4(shade(ray, ray + dir * t), 1.0));
+		}
+		barrier(); // tileIndex / tileStart are rewritten by the next iteration
+	}
+}
+		)";
+	}
+
+	std::string GenerateSweepMainTemplate() {
+		return R"(
+void main(void)
+{
+	resolution = screenResolution / vec2(sweepGrid);
+	paramBase = instance * numParams;
+
+	vec3 ray, dir;
+	camera(gl_FragCoord.xy - tileOrigin, ray, dir);
+
+	// raymarching
+	float t = march(ray, dir);
+
+	color = vec4(shade(ray, ray + dir * t), 1.0);
+}
+		)";
+	}
+
+	std::string GenerateNativeTemplate() {
+		return R"(
+// generated by CodeGenManager::GenerateNativeSource()
+#include <math.h>
+
+#ifdef _WIN32
+#define NATIVE_EXPORT extern "C" __declspec(dllexport)
+#else
+#define NATIVE_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace {
+
+// the subset of GLSL the block definitions use
+struct vec2 {
+	float x, y;
+	vec2(float x, float y) : x(x), y(y) {}
+};
+struct vec3 {
+	float x, y, z;
+	explicit vec3(float v) : x(v), y(v), z(v) {}
+	vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+};
+inline vec3 operator+(vec3 a, vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline vec3 operator-(vec3 a, vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline vec3 operator*(vec3 a, float b) { return vec3(a.x * b, a.y * b, a.z * b); }
+inline float abs(float a) { return fabsf(a); }
+inline vec3 abs(vec3 a) { return vec3(fabsf(a.x), fabsf(a.y), fabsf(a.z)); }
+inline float min(float a, float b) { return a < b ? a : b; }
+inline float max(float a, float b) { return a > b ? a : b; }
+inline vec3 max(vec3 a, float b) { return vec3(max(a.x, b), max(a.y, b), max(a.z, b)); }
+inline float dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(vec3 a) { return sqrtf(dot(a, a)); }
+		)";
+	}
+
+	std::string GenerateNativeMainTemplate() {
+		return R"(
+}
+
+NATIVE_EXPORT float sceneDistance(float x, float y, float z)
+{
+	return scene(vec3(x, y, z));
+}
+
+// the loop the compiler inlines scene() into and vectorizes
+NATIVE_EXPORT void sceneBatch(const float *x, const float *y, const float *z, float *d, int n)
+{
+	for (int i = 0; i < n; i++)
+		d[i] = scene(vec3(x[i], y[i], z[i]));
+}
+
+NATIVE_EXPORT void sceneIdBatch(const float *x, const float *y, const float *z, float *d, float *id, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		vec2 r = sceneId(vec3(x[i], y[i], z[i]));
+		d[i] = r.x;
+		id[i] = r.y;
+	}
+}
+)";
+	}
+
 private:
-	CodeGenManager() { }
+	CodeGenManager() : paramsFromSweep(false) { }
+
+	bool paramsFromSweep;
+
+	void AppendSubsceneDefinitions(Block *block, bool native, std::set<Block *> &visited, std::string &impl);
+
+	struct AutoBake {
+		std::string key; // BrickMap::SceneKey of the subtree
+		bool done; // taken from BakeScheduler: map is empty when rejected
+		BrickMap map;
+	};
+	std::map<int, AutoBake> autoBakes; // by subtree root block id
 };
 
 
@@ -0,0 +1,98 @@
+#include "cpupreview.hpp"
+
+#include <algorithm>
+#include <thread>
+
+CpuPreview::CpuPreview() : nextRow(0), cancelled(false) {
+	mtx_init(&mutex, mtx_plain);
+}
+
+CpuPreview::~CpuPreview() {
+	Stop();
+	mtx_destroy(&mutex);
+}
+
+void CpuPreview::Start(const CpuScene &scene, const Camera &camera, int screenWidth, int screenHeight) {
+	Stop();
+	this->scene = scene;
+	this->camera = camera;
+
+	int w = std::max(1, screenWidth / Downscale), h = std::max(1, screenHeight / Downscale);
+	if (!target.Matches(w, h))
+		target.Setup(w, h);
+	target.Bind();
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	pixels.assign((size_t)w * h * 4, 255);
+	finishedRows.clear();
+
+	// leave a core to the rendering thread
+	nextRow = 0;
+	cancelled = false;
+	int numWorkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	for (int i = 0; i < numWorkers; i++) {
+		thrd_t worker;
+		if (thrd_create(&worker, WorkerThreadMain, this) == thrd_success)
+			workers.push_back(worker);
+	}
+}
+
+void CpuPreview::Stop() {
+	cancelled = true;
+	for (auto it = workers.begin(); it != workers.end(); ++it) {
+		int result;
+		thrd_join(*it, &result);
+	}
+	workers.clear();
+}
+
+void CpuPreview::Destroy() {
+	Stop();
+	target.Destroy();
+}
+
+void CpuPreview::Draw(int screenWidth, int screenHeight) {
+	if (!target.IsValid())
+		return;
+
+	std::vector<int> rows;
+	mtx_lock(&mutex);
+	rows.swap(finishedRows);
+	mtx_unlock(&mutex);
+
+	// stream the new rows, the others keep the clear color
+	glBindTexture(GL_TEXTURE_2D, target.textures[0]);
+	for (auto it = rows.begin(); it != rows.end(); ++it)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, *it, target.Width, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[(size_t)*it * target.Width * 4]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	target.BlitToScreen(screenWidth, screenHeight, GL_LINEAR);
+}
+
+int CpuPreview::WorkerThreadMain(void *data) {
+	CpuPreview *preview = (CpuPreview *)data;
+
+	// rows are handed out one at a time, a row costs about the same everywhere on screen
+	while (!preview->cancelled) {
+		int y = preview->nextRow++;
+		if (y >= preview->target.Height)
+			break;
+		preview->RenderRow(y);
+
+		mtx_lock(&preview->mutex);
+		preview->finishedRows.push_back(y);
+		mtx_unlock(&preview->mutex);
+	}
+	return 0;
+}
+
+void CpuPreview::RenderRow(int y) {
+	glm::vec2 resolution((float)target.Width, (float)target.Height);
+	unsigned char *dst = &pixels[(size_t)y * target.Width * 4];
+	for (int x = 0; x < target.Width; x++) {
+		glm::vec3 col = glm::clamp(scene.Trace(camera, glm::vec2(x + 0.5f, y + 0.5f), resolution), 0.0f, 1.0f);
+		dst[x * 4 + 0] = (unsigned char)(col.r * 255.0f + 0.5f);
+		dst[x * 4 + 1] = (unsigned char)(col.g * 255.0f + 0.5f);
+		dst[x * 4 + 2] = (unsigned char)(col.b * 255.0f + 0.5f);
+	}
+}
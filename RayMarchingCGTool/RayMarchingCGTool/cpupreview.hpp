@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef CPUPREVIEW_HPP
+#define CPUPREVIEW_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <vector>
+#include <atomic>
+#include "tinythread.hpp"
+#include "cpuscene.hpp"
+#include "offscreentarget.hpp"
+
+// Low resolution CPU rendering of a CpuScene on worker threads, streamed row by row into a texture.
+// The display window shows it while the driver compiles the generated program.
+class CpuPreview {
+
+public:
+	static const int Downscale = 4; // one preview pixel covers Downscale x Downscale screen pixels
+
+	CpuPreview();
+	~CpuPreview();
+
+	// GL thread
+	void Start(const CpuScene &scene, const Camera &camera, int screenWidth, int screenHeight);
+	void Draw(int screenWidth, int screenHeight); // upload the rows finished so far, scale to the screen
+	void Destroy(); // stop and release the image
+	bool IsActive() const { return target.IsValid(); } // from Start to Destroy
+
+	// any thread
+	void Stop(); // cancel & join the workers
+
+private:
+	static int WorkerThreadMain(void *data);
+	void RenderRow(int y);
+
+	CpuScene scene;
+	Camera camera;
+	OffscreenTarget target;
+	std::vector<unsigned char> pixels; // RGBA, rows bottom-up as the texture
+
+	std::vector<thrd_t> workers;
+	std::atomic<int> nextRow;
+	std::atomic<bool> cancelled;
+
+	// rows written since the last upload, guarded by mutex
+	mtx_t mutex;
+	std::vector<int> finishedRows;
+};
+
+
+#endif
@@ -0,0 +1,207 @@
+#include "cpurenderer.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// interleave the bits of x and y
+static unsigned int MortonCode(unsigned int x, unsigned int y) {
+	unsigned int code = 0;
+	for (int bit = 0; bit < 16; bit++)
+		code |= ((x >> bit) & 1u) << (2 * bit) | ((y >> bit) & 1u) << (2 * bit + 1);
+	return code;
+}
+
+CpuRenderer::CpuRenderer(int numThreads) :
+	pool(numThreads), simdLevel(DetectSimdLevel()), scene(NULL), width(0), height(0), tilesX(0), antiAliasing(false), pixels(NULL)
+{
+}
+
+CpuRenderer::~CpuRenderer() {
+}
+
+void CpuRenderer::Render(const CpuScene &scene, const Camera &camera, int w, int h, bool antiAliasing, unsigned char *rgba) {
+	if (w <= 0 || h <= 0)
+		return;
+
+	// tiles in Morton order: consecutive tiles are neighbours in both directions
+	tilesX = (w + TileSize - 1) / TileSize;
+	int tilesY = (h + TileSize - 1) / TileSize;
+	if (width != w || height != h) {
+		std::vector<unsigned int> codes(tilesX * tilesY);
+		tileOrder.resize(tilesX * tilesY);
+		for (int i = 0; i < (int)tileOrder.size(); i++) {
+			tileOrder[i] = i;
+			codes[i] = MortonCode(i % tilesX, i / tilesX);
+		}
+		std::sort(tileOrder.begin(), tileOrder.end(), [&codes](int a, int b) { return codes[a] < codes[b]; });
+	}
+
+	this->scene = &scene;
+	this->camera = camera;
+	this->width = w;
+	this->height = h;
+	this->antiAliasing = antiAliasing;
+	this->pixels = rgba;
+	// each worker starts with a compact region of the image
+	pool.Run((int)tileOrder.size(), [this](int chunk, int) { RenderTile(tileOrder[chunk]); });
+}
+
+// edge-adaptive supersampling of the forward shader
+static const glm::vec2 SampleOffsets[4] = {
+	glm::vec2(0.125f, 0.375f), glm::vec2(-0.375f, 0.125f), glm::vec2(-0.125f, -0.375f), glm::vec2(0.375f, -0.125f)
+};
+
+void CpuRenderer::StorePixel(int x, int y, glm::vec3 c) {
+	c = glm::clamp(c, 0.0f, 1.0f);
+	unsigned char *dst = pixels + ((size_t)y * width + x) * 4;
+	dst[0] = (unsigned char)(c.r * 255.0f + 0.5f);
+	dst[1] = (unsigned char)(c.g * 255.0f + 0.5f);
+	dst[2] = (unsigned char)(c.b * 255.0f + 0.5f);
+	dst[3] = 255;
+}
+
+void CpuRenderer::RenderTile(int tile) {
+	if (simdLevel != SIMD_NONE && !scene->program.IsEmpty()) {
+		RenderTilePackets(tile);
+		return;
+	}
+
+	int x0 = (tile % tilesX) * TileSize, y0 = (tile / tilesX) * TileSize;
+	int x1 = std::min(x0 + TileSize, width), y1 = std::min(y0 + TileSize, height);
+	glm::vec2 resolution((float)width, (float)height);
+
+	// 2x2 quads, as the gpu evaluates dFdx / dFdy (tiles start on even pixels)
+	for (int y = y0; y < y1; y += 2) {
+		for (int x = x0; x < x1; x += 2) {
+			glm::vec3 col[2][2];
+			float t[2][2], id[2][2];
+			for (int j = 0; j < 2; j++)
+				for (int i = 0; i < 2; i++) {
+					glm::vec2 fragCoord(x + i + 0.5f, y + j + 0.5f);
+					col[j][i] = scene->Trace(camera, fragCoord, resolution, t[j][i]);
+					if (antiAliasing)
+						id[j][i] = scene->HitId(camera.position + camera.RayDirection(fragCoord, resolution) * t[j][i]);
+				}
+
+			for (int j = 0; j < 2 && y + j < y1; j++) {
+				for (int i = 0; i < 2 && x + i < x1; i++) {
+					glm::vec3 c = col[j][i];
+					glm::vec2 fragCoord(x + i + 0.5f, y + j + 0.5f);
+
+					if (antiAliasing && (std::abs(t[j][1] - t[j][0]) + std::abs(t[1][i] - t[0][i]) > 0.05f * t[j][i] ||
+						id[j][1] != id[j][0] || id[1][i] != id[0][i])) {
+						for (int s = 0; s < 4; s++)
+							c += scene->Trace(camera, fragCoord + SampleOffsets[s], resolution);
+						c *= 0.2f;
+					}
+					StorePixel(x + i, y + j, c);
+				}
+			}
+		}
+	}
+}
+
+void CpuRenderer::RenderTilePackets(int tile) {
+	int x0 = (tile % tilesX) * TileSize, y0 = (tile / tilesX) * TileSize;
+	int x1 = std::min(x0 + TileSize, width), y1 = std::min(y0 + TileSize, height);
+	glm::vec2 resolution((float)width, (float)height);
+	const int rowSize = RayPacket::Size / 2;
+
+	// 2 rows of 8 pixels: four 2x2 quads per packet
+	RayPacket packet, samples;
+	int samplePixels[RayPacket::Size]; // lane of packet each supersample belongs to
+	for (int y = y0; y < y1; y += 2) {
+		for (int x = x0; x < x1; x += rowSize) {
+			for (int lane = 0; lane < RayPacket::Size; lane++) {
+				glm::vec2 fragCoord(x + lane % rowSize + 0.5f, y + lane / rowSize + 0.5f);
+				packet.SetRay(lane, camera.position, camera.RayDirection(fragCoord, resolution));
+			}
+			packet.count = RayPacket::Size;
+			MarchPacket(simdLevel, *scene, packet);
+
+			glm::vec3 col[RayPacket::Size];
+			bool inside[RayPacket::Size];
+			for (int lane = 0; lane < RayPacket::Size; lane++) {
+				inside[lane] = x + lane % rowSize < x1 && y + lane / rowSize < y1;
+				if (inside[lane])
+					col[lane] = scene->Shade(camera.position, camera.position + glm::vec3(packet.dx[lane], packet.dy[lane], packet.dz[lane]) * packet.t[lane]);
+			}
+			if (!antiAliasing) {
+				for (int lane = 0; lane < RayPacket::Size; lane++) if (inside[lane])
+					StorePixel(x + lane % rowSize, y + lane / rowSize, col[lane]);
+				continue;
+			}
+
+			// the supersamples of the edge pixels are marched as packets too
+			auto flushSamples = [&]() {
+				MarchPacket(simdLevel, *scene, samples);
+				for (int s = 0; s < samples.count; s++)
+					col[samplePixels[s]] += scene->Shade(camera.position, camera.position + glm::vec3(samples.dx[s], samples.dy[s], samples.dz[s]) * samples.t[s]);
+				samples.count = 0;
+			};
+			samples.count = 0;
+			float id[RayPacket::Size];
+			for (int lane = 0; lane < RayPacket::Size; lane++)
+				id[lane] = scene->HitId(camera.position + glm::vec3(packet.dx[lane], packet.dy[lane], packet.dz[lane]) * packet.t[lane]);
+			bool edge[RayPacket::Size];
+			for (int lane = 0; lane < RayPacket::Size; lane++) {
+				int i = lane % rowSize, j = lane / rowSize, quad = i & ~1;
+				const float *t = packet.t;
+				edge[lane] = inside[lane] && (std::abs(t[j * rowSize + quad + 1] - t[j * rowSize + quad]) + std::abs(t[rowSize + i] - t[i]) > 0.05f * t[lane] ||
+					id[j * rowSize + quad + 1] != id[j * rowSize + quad] || id[rowSize + i] != id[i]);
+				if (!edge[lane])
+					continue;
+
+				glm::vec2 fragCoord(x + i + 0.5f, y + j + 0.5f);
+				for (int s = 0; s < 4; s++) {
+					samplePixels[samples.count] = lane;
+					samples.SetRay(samples.count++, camera.position, camera.RayDirection(fragCoord + SampleOffsets[s], resolution));
+				}
+				if (samples.count == RayPacket::Size)
+					flushSamples();
+			}
+			if (samples.count > 0)
+				flushSamples();
+
+			for (int lane = 0; lane < RayPacket::Size; lane++) if (inside[lane])
+				StorePixel(x + lane % rowSize, y + lane / rowSize, edge[lane] ? col[lane] * 0.2f : col[lane]);
+		}
+	}
+}
+
+void CpuRenderer::Benchmark(const CpuScene &scene, int w, int h, int maxThreads) {
+	if (maxThreads <= 0)
+		maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	const int numFrames = 4;
+	std::vector<unsigned char> rgba((size_t)w * h * 4);
+
+	printf("CPU raymarcher, %dx%d, %d tiles of %dx%d, %s packets, %d frames per run\n", w, h,
+		((w + TileSize - 1) / TileSize) * ((h + TileSize - 1) / TileSize), TileSize, TileSize, SimdLevelName(DetectSimdLevel()), numFrames);
+	printf("threads  ms/frame  Mpixel/s  speedup  efficiency\n");
+
+	// powers of two, then every core
+	std::vector<int> threadCounts;
+	for (int numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+		threadCounts.push_back(numThreads);
+	threadCounts.push_back(maxThreads);
+
+	double singleThreadMs = 0.0;
+	for (auto it = threadCounts.begin(); it != threadCounts.end(); ++it) {
+		CpuRenderer renderer(*it);
+		renderer.Render(scene, Camera::Orbit(0.0f), w, h, true, &rgba[0]); // warm up the pool
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < numFrames; frame++)
+			renderer.Render(scene, Camera::Orbit(frame * 1.0f), w, h, true, &rgba[0]);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() / numFrames;
+
+		if (*it == 1)
+			singleThreadMs = ms;
+		double speedup = singleThreadMs / ms;
+		printf("%7d  %8.1f  %8.2f  %7.2f  %9.0f%%\n", renderer.NumThreads(), ms, w * h / (ms * 1000.0), speedup, 100.0 * speedup / renderer.NumThreads());
+	}
+}
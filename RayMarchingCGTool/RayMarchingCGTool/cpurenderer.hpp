@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef CPURENDERER_HPP
+#define CPURENDERER_HPP
+
+#include <vector>
+#include <algorithm>
+#include "cpuscene.hpp"
+#include "raypacket.hpp"
+#include "workerpool.hpp"
+
+// Reference raymarcher without GPU, same image as the forward shader (edge-adaptive supersampling included).
+// The image is split into TileSize x TileSize tiles in Morton order, the chunks of a WorkerPool Run:
+// each worker starts on its own compact region and steals from the far end of the others' once it runs dry.
+// Rays are marched in 2x8 pixel packets by the widest SIMD kernel of the cpu.
+class CpuRenderer {
+
+public:
+	static const int TileSize = 32; // 4 KB of RGBA output per tile, stays in L1 while it is shaded
+
+	explicit CpuRenderer(int numThreads); // 0: one per core
+	~CpuRenderer();
+
+	// rgba: w * h pixels, rows bottom-up as glReadPixels
+	void Render(const CpuScene &scene, const Camera &camera, int w, int h, bool antiAliasing, unsigned char *rgba);
+
+	int NumThreads() const { return pool.NumThreads(); }
+
+	// packet kernels of the next frames, lowered to what the cpu supports (SIMD_NONE: one ray at a time)
+	void SetSimdLevel(SimdLevel level) { simdLevel = std::min(level, DetectSimdLevel()); }
+	SimdLevel GetSimdLevel() const { return simdLevel; }
+
+	// frame time from 1 to maxThreads threads (0: one per core), printed as a table
+	static void Benchmark(const CpuScene &scene, int w, int h, int maxThreads);
+
+private:
+	void RenderTile(int tile);
+	void RenderTilePackets(int tile);
+	void StorePixel(int x, int y, glm::vec3 c);
+
+	WorkerPool pool;
+	std::vector<int> tileOrder; // tile index (ty * tilesX + tx) in Morton order
+	SimdLevel simdLevel;
+
+	// current frame, set before the pool runs
+	const CpuScene *scene;
+	Camera camera;
+	int width, height, tilesX;
+	bool antiAliasing;
+	unsigned char *pixels;
+};
+
+
+#endif
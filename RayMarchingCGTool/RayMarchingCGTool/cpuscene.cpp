@@ -0,0 +1,125 @@
+#include "cpuscene.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "block.hpp"
+
+CpuScene CpuScene::FromGraph() {
+	CpuScene scene;
+
+	// same Screen block as GenerateScene()
+	for (auto it = BlockGraph::getInstance().blockList.begin(); it != BlockGraph::getInstance().blockList.end(); ++it) if (dynamic_cast<ScreenBlock *>(*it)) {
+		scene.nodes.clear();
+		scene.root = (*it)->BuildCpuNode(scene);
+	}
+	scene.Compile();
+	return scene;
+}
+
+int CpuScene::AddNode(Op op, int blockId, float param, int a, int b) {
+	Node node = { op, blockId, param, a, b };
+	nodes.push_back(node);
+	return (int)nodes.size() - 1;
+}
+
+bool CpuScene::Bounds(glm::vec3 &min, glm::vec3 &max) const {
+	if (IsEmpty())
+		return false;
+
+	// children come first
+	std::vector<glm::vec3> mins(nodes.size()), maxs(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const Node &node = nodes[i];
+		if (node.op == DIFFERENCE) {
+			// the carved result stays inside b
+			mins[i] = mins[node.b];
+			maxs[i] = maxs[node.b];
+		}
+		else {
+			mins[i] = glm::vec3(-node.param);
+			maxs[i] = glm::vec3(node.param);
+		}
+	}
+	min = mins[root];
+	max = maxs[root];
+	return true;
+}
+
+float CpuScene::Distance(const glm::vec3 &p) const {
+	return program.Evaluate(p);
+}
+
+glm::vec2 CpuScene::DistanceId(const glm::vec3 &p) const {
+	return program.EvaluateId(p);
+}
+
+float CpuScene::HitId(const glm::vec3 &hit) const {
+	glm::vec2 d = DistanceId(hit);
+	return std::abs(d.x) < 0.01f ? d.y : -1.0f;
+}
+
+glm::vec2 CpuScene::DistanceInterval(const glm::vec3 &min, const glm::vec3 &max) const {
+	return program.EvaluateInterval(min, max);
+}
+
+glm::vec3 CpuScene::Normal(const glm::vec3 &p) const {
+	// same differences (and orientation) as norm()
+	const float eps = 0.0001f;
+	glm::vec3 n(
+		Distance(p - glm::vec3(eps, 0.0f, 0.0f)) - Distance(p + glm::vec3(eps, 0.0f, 0.0f)),
+		Distance(p - glm::vec3(0.0f, eps, 0.0f)) - Distance(p + glm::vec3(0.0f, eps, 0.0f)),
+		Distance(p - glm::vec3(0.0f, 0.0f, eps)) - Distance(p + glm::vec3(0.0f, 0.0f, eps)));
+	return glm::normalize(n);
+}
+
+const glm::vec3 CpuScene::Tetrahedron[4] = {
+	glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-1.0f, -1.0f, 1.0f), glm::vec3(-1.0f, 1.0f, -1.0f), glm::vec3(1.0f, 1.0f, 1.0f)
+};
+
+glm::vec3 CpuScene::TetrahedronGradient(const float *d, int stride, float h) {
+	glm::vec3 gradient(0.0f);
+	for (int k = 0; k < 4; k++)
+		gradient += Tetrahedron[k] * d[k * stride];
+	return gradient / (4.0f * h);
+}
+
+float CpuScene::March(const glm::vec3 &ray, const glm::vec3 &dir) const {
+	float t = 0.0f;
+	for (int i = 0; i < 90; i++)
+		t += Distance(ray + dir * t);
+	return t;
+}
+
+glm::vec3 CpuScene::Shade(const glm::vec3 &ray, const glm::vec3 &hit) const {
+	// fog
+	float fogFact = glm::clamp(std::exp(-glm::distance(ray, hit) * 0.3f), 0.0f, 1.0f);
+	if (fogFact < 0.05f)
+		return glm::vec3(0.0f);
+
+	// diffuse & specular light
+	glm::vec3 sun = glm::normalize(glm::vec3(0.1f, 1.0f, 0.2f));
+	glm::vec3 n = Normal(hit);
+	glm::vec3 ref = glm::reflect(glm::normalize(hit - ray), n);
+	float diff = glm::dot(n, sun);
+	float spec = std::pow(std::max(glm::dot(ref, sun), 0.0f), 32.0f);
+	glm::vec3 col = glm::mix(glm::vec3(0.0f, 0.7f, 0.9f), glm::vec3(0.0f, 0.1f, 0.2f), diff);
+
+	return fogFact * (col + spec);
+}
+
+glm::vec3 CpuScene::Trace(const Camera &camera, glm::vec2 fragCoord, glm::vec2 resolution, float &t) const {
+	// the shader's normal is undefined on an empty scene
+	t = 0.0f;
+	if (root < 0)
+		return glm::vec3(0.0f);
+
+	glm::vec3 dir = camera.RayDirection(fragCoord, resolution);
+	t = March(camera.position, dir);
+	return Shade(camera.position, camera.position + dir * t);
+}
+
+glm::vec3 CpuScene::Trace(const Camera &camera, glm::vec2 fragCoord, glm::vec2 resolution) const {
+	float t;
+	return Trace(camera, fragCoord, resolution, t);
+}
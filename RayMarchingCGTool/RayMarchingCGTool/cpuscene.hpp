@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef CPUSCENE_HPP
+#define CPUSCENE_HPP
+
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "sdfprogram.hpp"
+
+// CPU counterpart of the generated scene(), march() and shade(): a snapshot of the BlockGraph
+// that worker threads can evaluate while the graph keeps being edited. The nodes are compiled
+// into an SdfProgram, which every distance below runs.
+class CpuScene {
+
+public:
+	enum Op { SPHERE, BOX, DIFFERENCE };
+
+	struct Node {
+		Op op;
+		int blockId; // leaf blocks: the id returned by sceneId()
+		float param; // SPHERE: radius, BOX: half size
+		int a, b; // DIFFERENCE: a is carved out of b
+	};
+
+	CpuScene() : root(-1) {}
+
+	// main thread (owner of the BlockGraph); an unconnected Screen block gives an empty scene
+	static CpuScene FromGraph();
+
+	int AddNode(Op op, int blockId, float param = 0.0f, int a = -1, int b = -1); // index of the node
+	void Compile() { program = SdfProgram::Compile(*this); } // after the last node
+	bool IsEmpty() const { return root < 0; }
+	bool Bounds(glm::vec3 &min, glm::vec3 &max) const; // box enclosing the surface (as sdf::Bound()); false when empty
+
+	float Distance(const glm::vec3 &p) const; // scene()
+	glm::vec2 DistanceId(const glm::vec3 &p) const; // sceneId()
+	float HitId(const glm::vec3 &hit) const; // hitId(): sceneId().y where a march converged on a surface, else -1
+	glm::vec2 DistanceInterval(const glm::vec3 &min, const glm::vec3 &max) const; // lower and upper bound of scene() over a box
+	glm::vec3 Normal(const glm::vec3 &p) const; // norm()
+
+	// gradient of batched distances (slice view, bound validator): p + h * Tetrahedron[k] around each sample,
+	// d[k * stride] the distance at vertex k; sum(Tetrahedron[k] * d) / (4 * h)
+	static const glm::vec3 Tetrahedron[4];
+	static glm::vec3 TetrahedronGradient(const float *d, int stride, float h);
+	float March(const glm::vec3 &ray, const glm::vec3 &dir) const; // march()
+	glm::vec3 Shade(const glm::vec3 &ray, const glm::vec3 &hit) const; // shade()
+
+	// color of a single ray, as trace() of the forward shader (black for an empty scene); t: hit distance
+	glm::vec3 Trace(const Camera &camera, glm::vec2 fragCoord, glm::vec2 resolution, float &t) const;
+	glm::vec3 Trace(const Camera &camera, glm::vec2 fragCoord, glm::vec2 resolution) const;
+
+	std::vector<Node> nodes; // children before their parents
+	int root; // -1: empty
+	SdfProgram program;
+};
+
+
+#endif
@@ -12,6 +12,7 @@
 #include "appstate.hpp"
 #include "block.hpp"
 #include "renderingtarget.hpp"
+#include "thumbnailcache.hpp"
 
 
 void DiagramWindowInfo::SetupRC()
@@ -29,6 +30,12 @@ void DiagramWindowInfo::SetupRC()
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 }
 
+void DiagramWindowInfo::DestroyRC()
+{
+	ThumbnailCache::getInstance().Stop();
+	WindowInfo::DestroyRC();
+}
+
 void DiagramWindowInfo::RenderInit()
 {
 	glEnable(GL_POLYGON_OFFSET_FILL);
@@ -98,12 +105,17 @@ bool DiagramWindowInfo::needRedraw()
 
 void DiagramWindowInfo::Render()
 {
+	// thumbnails rendered in the background since the last frame
+	if (ThumbnailCache::getInstance().UploadFinished())
+		needRedrawDiagram = true;
+
 	if (needRedraw()){
 		needRedrawDiagram = false;
 
 		glClear(GL_COLOR_BUFFER_BIT);
 		
 		updateMVPIfNeeded();
+		ThumbnailCache::getInstance().BeginRedraw();
 
 		for (auto it = BlockGraph::getInstance().blockOrderList.begin(); it != BlockGraph::getInstance().blockOrderList.end(); ++it) {
 			if (!dynamic_cast<Block*>(*it) || overlaps(DisplayArea, dynamic_cast<Block*>(*it)->renderRec)) {
@@ -19,6 +19,9 @@ void DiagramWindowUserInputManager::key_callback(GLFWwindow* DisplayWindow, int
 		updateInput(COMPILE, DisplayWindow);
 		processInput(CANCEL, DisplayWindow);
 	}
+	else if (key == GLFW_KEY_S && mods == GLFW_MOD_CONTROL && action == GLFW_PRESS) {
+		BlockGraph::getInstance().SaveToFile(AppState::GraphFileName);
+	}
 }
 
 // ص߳нУʱӦglز
@@ -409,18 +412,17 @@ void DiagramWindowUserInputManager::stopPortDragging(GLFWwindow *DisplayWindow)
 
 void DiagramWindowUserInputManager::startCompiling(GLFWwindow *DisplayWindow)
 {
-	std::string fragStr = CodeGenManager::getInstance().GenerateFragShader();
-
-	FILE *file;
-	fopen_s(&file, AppState::OutputShaderName.c_str(), "w");
-	fprintf(file, "%s", fragStr.c_str());
-	fclose(file);
-	DisplayWindowInfo::getInstance().needUpdateShader = true;
+	compileGraph();
 
 	// start to compile!
 	currentUserInputState = COMPILE;
 
 }
+void DiagramWindowUserInputManager::compileGraph()
+{
+	CodeGenManager::getInstance().WriteShaderFiles();
+	DisplayWindowInfo::getInstance().RequestShaderUpdate(CpuScene::FromGraph(), CodeGenManager::getInstance().GetBakes());
+}
 void DiagramWindowUserInputManager::doCompiling(GLFWwindow *DisplayWindow)
 {
 	// NO-OP ϣϣstart
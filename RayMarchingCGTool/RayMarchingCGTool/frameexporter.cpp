@@ -0,0 +1,305 @@
+#include "frameexporter.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static bool EndsWith(const std::string &str, const char *suffix) {
+	size_t n = strlen(suffix);
+	return str.size() >= n && str.compare(str.size() - n, n, suffix) == 0;
+}
+
+FrameExporter::FrameExporter(const std::string &outputPattern, int w, int h, int fps) :
+	Width(w), Height(h), NumCapturedFrames(0),
+	outputPattern(outputPattern), format(PPM), fps(fps), stream(NULL),
+	nextSubmitFrame(0), writers(NULL), nextStreamFrame(0), failed(false)
+{
+	mtx_init(&mutex, mtx_plain);
+	cnd_init(&jobDone);
+}
+
+FrameExporter::~FrameExporter() {
+	delete writers;
+	cnd_destroy(&jobDone);
+	mtx_destroy(&mutex);
+}
+
+bool FrameExporter::Start() {
+	if (EndsWith(outputPattern, ".ppm")) format = PPM;
+	else if (EndsWith(outputPattern, ".png")) format = PNG;
+	else if (EndsWith(outputPattern, ".y4m")) format = Y4M;
+	else {
+		fprintf(stderr, "Unknown export format %s (.ppm, .png or .y4m)\n", outputPattern.c_str());
+		return false;
+	}
+
+	if (format == Y4M) {
+		if (fopen_s(&stream, outputPattern.c_str(), "wb") != 0) {
+			fprintf(stderr, "Impossible to write %s\n", outputPattern.c_str());
+			return false;
+		}
+		fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", Width, Height, fps);
+	}
+
+	// PBO ring
+	slots.resize(RingSize);
+	for (int i = 0; i < RingSize; i++) {
+		glGenBuffers(1, &slots[i].buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, Width * Height * 4, NULL, GL_STREAM_READ);
+		slots[i].fence = 0;
+		slots[i].frame = -1;
+		slots[i].pixels = NULL;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// writers: one per core, the rendering thread mostly waits on the gpu
+	writers = new WorkerPool(0);
+	return writers->NumThreads() > 0;
+}
+
+void FrameExporter::CaptureFrame(GLuint framebuffer) {
+	int frame = NumCapturedFrames++;
+	Slot &slot = slots[frame % RingSize];
+	if (slot.frame >= 0)
+		ReleaseSlot(slot); // backpressure
+
+	// the copy into the PBO is queued behind the frame, glReadPixels returns immediately
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame;
+	glFlush(); // make sure the fence reaches the gpu
+
+	SubmitReadySlots();
+}
+
+bool FrameExporter::Finish() {
+	// the ring in frame order
+	for (int i = 0; i < (int)slots.size(); i++) {
+		Slot &slot = slots[(NumCapturedFrames + i) % RingSize];
+		if (slot.frame >= 0)
+			ReleaseSlot(slot);
+	}
+
+	delete writers;
+	writers = NULL;
+
+	for (auto it = slots.begin(); it != slots.end(); ++it)
+		glDeleteBuffers(1, &it->buffer);
+	slots.clear();
+
+	if (stream) {
+		failed = (fclose(stream) != 0) || failed;
+		stream = NULL;
+	}
+	return !failed;
+}
+
+void FrameExporter::Submit(Slot &slot, bool wait) {
+	if (wait) {
+		while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	slot.pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Width * Height * 4, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	Job job = { slot.frame, slot.pixels };
+	writers->Post([this, job](int) {
+		bool ok = Encode(job);
+
+		mtx_lock(&mutex);
+		failed = !ok || failed;
+		doneFrames.insert(job.frame);
+		cnd_broadcast(&jobDone);
+		mtx_unlock(&mutex);
+	});
+	nextSubmitFrame++;
+}
+
+void FrameExporter::SubmitReadySlots() {
+	// frames are submitted in order (Y4M appends them as they come)
+	while (nextSubmitFrame < NumCapturedFrames) {
+		Slot &slot = slots[nextSubmitFrame % RingSize];
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		Submit(slot, false);
+	}
+}
+
+void FrameExporter::ReleaseSlot(Slot &slot) {
+	while (nextSubmitFrame <= slot.frame)
+		Submit(slots[nextSubmitFrame % RingSize], true);
+
+	mtx_lock(&mutex);
+	while (!doneFrames.count(slot.frame))
+		cnd_wait(&jobDone, &mutex);
+	doneFrames.erase(slot.frame);
+	mtx_unlock(&mutex);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.pixels)
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.pixels = NULL;
+	slot.frame = -1;
+}
+
+
+// PNG without a zlib dependency: deflate "stored" blocks
+struct Crc32Table {
+	unsigned int v[256];
+	Crc32Table() {
+		for (unsigned int i = 0; i < 256; i++) {
+			unsigned int c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			v[i] = c;
+		}
+	}
+};
+
+static unsigned int Crc32(unsigned int crc, const unsigned char *data, size_t size) {
+	static const Crc32Table table; // thread-safe initialization
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.v[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutBigEndian(std::vector<unsigned char> &out, unsigned int v) {
+	out.push_back(v >> 24); out.push_back(v >> 16); out.push_back(v >> 8); out.push_back(v);
+}
+
+static void WritePngChunk(FILE *file, const char *type, const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> chunk;
+	PutBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	PutBigEndian(chunk, Crc32(0, &chunk[4], chunk.size() - 4));
+	fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+static bool WritePng(FILE *file, int w, int h, const std::vector<unsigned char> &rgb) {
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	std::vector<unsigned char> header;
+	PutBigEndian(header, w);
+	PutBigEndian(header, h);
+	header.push_back(8); // bit depth
+	header.push_back(2); // RGB
+	header.push_back(0); header.push_back(0); header.push_back(0);
+	WritePngChunk(file, "IHDR", header);
+
+	// scanlines with filter byte 0
+	std::vector<unsigned char> raw;
+	raw.reserve((w * 3 + 1) * h);
+	for (int y = 0; y < h; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb.begin() + y * w * 3, rgb.begin() + (y + 1) * w * 3);
+	}
+
+	// zlib stream of stored blocks
+	std::vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78); zlib.push_back(0x01);
+	unsigned int a = 1, b = 0;
+	size_t pos = 0;
+	do {
+		size_t len = std::min(raw.size() - pos, (size_t)65535);
+		zlib.push_back(pos + len == raw.size() ? 1 : 0);
+		zlib.push_back(len & 0xff); zlib.push_back(len >> 8);
+		zlib.push_back(~len & 0xff); zlib.push_back((~len >> 8) & 0xff);
+		for (size_t i = pos; i < pos + len; i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+		pos += len;
+	} while (pos < raw.size());
+	PutBigEndian(zlib, (b << 16) | a);
+	WritePngChunk(file, "IDAT", zlib);
+
+	WritePngChunk(file, "IEND", std::vector<unsigned char>());
+	return !ferror(file);
+}
+
+bool FrameExporter::Encode(const Job &job) {
+	int w = Width, h = Height;
+	bool ok = job.pixels != NULL;
+	if (!ok)
+		fprintf(stderr, "Readback of frame %d failed\n", job.frame);
+
+	// RGB rows top to bottom (GL rows start at the bottom), black if the readback failed
+	std::vector<unsigned char> rgb(w * h * 3, 0);
+	if (job.pixels) {
+		for (int y = 0; y < h; y++) {
+			const unsigned char *src = job.pixels + (h - 1 - y) * w * 4;
+			unsigned char *dst = &rgb[y * w * 3];
+			for (int x = 0; x < w; x++) {
+				dst[x * 3 + 0] = src[x * 4 + 0];
+				dst[x * 3 + 1] = src[x * 4 + 1];
+				dst[x * 3 + 2] = src[x * 4 + 2];
+			}
+		}
+	}
+
+	if (format == Y4M) {
+		// 4:2:0, full range BT.601
+		int cw = (w + 1) / 2, ch = (h + 1) / 2;
+		std::vector<unsigned char> yuv(w * h + 2 * cw * ch);
+		unsigned char *yPlane = &yuv[0], *uPlane = yPlane + w * h, *vPlane = uPlane + cw * ch;
+		for (int i = 0; i < w * h; i++) {
+			const unsigned char *p = &rgb[i * 3];
+			yPlane[i] = (unsigned char)(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f);
+		}
+		for (int cy = 0; cy < ch; cy++) for (int cx = 0; cx < cw; cx++) {
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			int n = 0;
+			for (int y = 2 * cy; y < std::min(2 * cy + 2, h); y++) for (int x = 2 * cx; x < std::min(2 * cx + 2, w); x++) {
+				const unsigned char *p = &rgb[(y * w + x) * 3];
+				r += p[0]; g += p[1]; b += p[2]; n++;
+			}
+			r /= n; g /= n; b /= n;
+			uPlane[cy * cw + cx] = (unsigned char)std::min(255.0f, std::max(0.0f, 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b + 0.5f));
+			vPlane[cy * cw + cx] = (unsigned char)std::min(255.0f, std::max(0.0f, 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b + 0.5f));
+		}
+
+		// append in frame order
+		mtx_lock(&mutex);
+		while (nextStreamFrame != job.frame)
+			cnd_wait(&jobDone, &mutex);
+		fputs("FRAME\n", stream);
+		ok = fwrite(&yuv[0], 1, yuv.size(), stream) == yuv.size() && ok;
+		nextStreamFrame++;
+		cnd_broadcast(&jobDone);
+		mtx_unlock(&mutex);
+		return ok;
+	}
+
+	char fileName[1024];
+	snprintf(fileName, sizeof(fileName), outputPattern.c_str(), job.frame);
+	FILE *file;
+	if (fopen_s(&file, fileName, "wb") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", fileName);
+		return false;
+	}
+	if (format == PNG) {
+		ok = WritePng(file, w, h, rgb) && ok;
+	}
+	else {
+		fprintf(file, "P6\n%d %d\n255\n", w, h);
+		ok = fwrite(&rgb[0], 1, rgb.size(), file) == rgb.size() && ok;
+	}
+	return (fclose(file) == 0) && ok;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef FRAMEEXPORTER_HPP
+#define FRAMEEXPORTER_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include "tinythread.hpp"
+
+#include "workerpool.hpp"
+
+// Frame sequence export: readback through a ring of fenced PBOs, the mapped PBOs are handed
+// as-is to a WorkerPool of writers encoding PPM / PNG / Y4M (the format follows the file extension).
+// The ring is the bounded queue: capturing blocks while every slot waits for a writer.
+class FrameExporter {
+
+public:
+	enum Format { PPM, PNG, Y4M };
+	static const int RingSize = 8; // frames between the gpu and the writers
+
+	// outputPattern: printf pattern taking the frame number (PPM, PNG) or a single file (Y4M)
+	FrameExporter(const std::string &outputPattern, int w, int h, int fps);
+	~FrameExporter();
+
+	// GL thread only
+	bool Start(); // false: unknown format or the output can't be written
+	void CaptureFrame(GLuint framebuffer); // queue the readback of the current frame
+	bool Finish(); // flush every captured frame and stop the writers
+
+	int Width;
+	int Height;
+	int NumCapturedFrames;
+
+private:
+	struct Slot {
+		GLuint buffer;
+		GLsync fence;
+		int frame; // -1: free
+		const unsigned char *pixels; // mapped, owned by the writers until the frame is done
+	};
+
+	struct Job {
+		int frame;
+		const unsigned char *pixels; // RGBA, rows bottom-up (NULL: readback failed)
+	};
+
+	bool Encode(const Job &job);
+	void Submit(Slot &slot, bool wait); // map & hand to the writers once the fence is signaled
+	void SubmitReadySlots();
+	void ReleaseSlot(Slot &slot); // wait for the writers, then unmap
+
+	std::string outputPattern;
+	Format format;
+	int fps;
+	FILE *stream; // Y4M: frames are appended in order
+
+	std::vector<Slot> slots;
+	int nextSubmitFrame;
+
+	WorkerPool *writers; // from Start to Finish
+
+	// writer results, guarded by mutex
+	mtx_t mutex;
+	cnd_t jobDone;
+	std::set<int> doneFrames;
+	int nextStreamFrame; // Y4M: next frame to append
+	bool failed;
+};
+
+
+#endif
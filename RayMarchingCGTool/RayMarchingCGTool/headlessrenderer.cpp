@@ -0,0 +1,337 @@
+#include "headlessrenderer.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "appstate.hpp"
+#include "block.hpp"
+#include "codegen.hpp"
+#include "shader.hpp"
+#include "frameexporter.hpp"
+#include "cpuscene.hpp"
+#include "nativescene.hpp"
+#include "cpurenderer.hpp"
+#include "raypacket.hpp"
+#include "sdfquery.hpp"
+#include "meshexporter.hpp"
+#include "volumeexporter.hpp"
+#include "boundvalidator.hpp"
+
+bool HeadlessRenderer::LoadGraph() {
+	AppState &state = AppState::getInstance();
+	return state.graphFile.empty() || BlockGraph::getInstance().LoadFromFile(state.graphFile);
+}
+
+int HeadlessRenderer::Run() {
+	AppState &state = AppState::getInstance();
+
+	// graph & codegen
+	if (!LoadGraph())
+		return EXIT_FAILURE;
+	CodeGenManager::getInstance().FinishBakes(); // a frame samples every bake
+	if (!CodeGenManager::getInstance().WriteShaderFiles())
+		return EXIT_FAILURE;
+
+	if (!SetupRC())
+		return EXIT_FAILURE;
+	if (!RenderInit()) {
+		RenderTerm();
+		DestroyRC();
+		return EXIT_FAILURE;
+	}
+
+	bool ok;
+	auto startTime = std::chrono::system_clock::now();
+	if (state.poster) {
+		ok = RenderPoster();
+		long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startTime).count();
+		printf("Rendered %dx%d poster in %lld ms\n", state.outputWidth, state.outputHeight, elapsedMs);
+	}
+	else {
+		// fixed timestep: the frames don't depend on the rendering speed
+		int fps = std::max(1, (int)(1.0f / state.timeStep + 0.5f));
+		FrameExporter exporter(state.outputPattern, state.outputWidth, state.outputHeight, fps);
+		ok = exporter.Start();
+		for (int frame = 0; ok && frame < state.numFrames; frame++) {
+			RenderFrame(state.startTime + frame * state.timeStep, 0, 0);
+			exporter.CaptureFrame(target.framebuffer);
+		}
+		ok = exporter.Finish() && ok;
+		long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startTime).count();
+		printf("Rendered %d frames (%dx%d) in %lld ms\n", state.numFrames, state.outputWidth, state.outputHeight, elapsedMs);
+	}
+
+	RenderTerm();
+	DestroyRC();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int HeadlessRenderer::RunCpu() {
+	AppState &state = AppState::getInstance();
+	if (!LoadGraph())
+		return EXIT_FAILURE;
+	CpuScene scene = CpuScene::FromGraph();
+
+	if (state.benchmark) {
+		CpuRenderer::Benchmark(scene, state.outputWidth, state.outputHeight, state.numThreads);
+		return EXIT_SUCCESS;
+	}
+	if (state.benchmarkSimd) {
+		BenchmarkRayPackets(scene, state.outputWidth, state.outputHeight);
+		return EXIT_SUCCESS;
+	}
+	if (state.benchmarkQuery) {
+		SdfQuery::Benchmark(1 << 22, state.numThreads);
+		return EXIT_SUCCESS;
+	}
+	if (state.validate)
+		return BoundValidator::Run(state.validateSamples, state.numThreads) ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (!state.volumeFile.empty() && state.volumeRegion[3] > 0) {
+		const int *r = state.volumeRegion;
+		return VolumeExporter::CheckRegion(scene, state.volumeFile, glm::ivec3(r[0], r[1], r[2]), glm::ivec3(r[3], r[4], r[5])) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (!state.volumeFile.empty() || !state.meshFile.empty()) {
+		// exports sample the scene millions of times: worth a compiler run (cached), the SIMD kernels without library
+		NativeScene native;
+		if (!scene.IsEmpty())
+			native.BuildFromGraph();
+		bool ok = !state.volumeFile.empty() ?
+			VolumeExporter::Export(scene, &native, state.volumeResolution, state.numThreads, state.volumeFile) :
+			MeshExporter::Export(scene, &native, state.meshResolution, state.numThreads, state.meshFile, !state.meshDense);
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	CpuRenderer renderer(state.numThreads);
+	if (!state.simd.empty()) {
+		SimdLevel level;
+		if (!ParseSimdLevel(state.simd.c_str(), level)) {
+			fprintf(stderr, "Unknown SIMD kernels %s\n", state.simd.c_str());
+			return EXIT_FAILURE;
+		}
+		renderer.SetSimdLevel(level);
+		if (renderer.GetSimdLevel() != level)
+			fprintf(stderr, "%s is not supported, using %s\n", state.simd.c_str(), SimdLevelName(renderer.GetSimdLevel()));
+	}
+	std::vector<unsigned char> rgba((size_t)state.outputWidth * state.outputHeight * 4);
+	bool ok = true;
+	auto startTime = std::chrono::system_clock::now();
+	for (int frame = 0; ok && frame < state.numFrames; frame++) {
+		float time = state.startTime + frame * state.timeStep;
+		renderer.Render(scene, Camera::Orbit(time), state.outputWidth, state.outputHeight, true, &rgba[0]);
+
+		// PPM only: the encoders of FrameExporter sit behind its PBO ring
+		char fileName[1024];
+		snprintf(fileName, sizeof(fileName), state.outputPattern.c_str(), frame);
+		FILE *file;
+		if (fopen_s(&file, fileName, "wb") != 0) {
+			fprintf(stderr, "Impossible to write %s\n", fileName);
+			return EXIT_FAILURE;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", state.outputWidth, state.outputHeight);
+		std::vector<unsigned char> row(state.outputWidth * 3);
+		for (int y = state.outputHeight - 1; y >= 0; y--) {
+			const unsigned char *src = &rgba[(size_t)y * state.outputWidth * 4];
+			for (int x = 0; x < state.outputWidth; x++) {
+				row[x * 3 + 0] = src[x * 4 + 0];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 2];
+			}
+			ok = fwrite(&row[0], 1, row.size(), file) == row.size() && ok;
+		}
+		ok = (fclose(file) == 0) && ok;
+		if (!ok)
+			fprintf(stderr, "Failed to write %s\n", fileName);
+	}
+	long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startTime).count();
+	printf("Rendered %d frames (%dx%d) on %d threads in %lld ms\n", state.numFrames, state.outputWidth, state.outputHeight, renderer.NumThreads(), elapsedMs);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool HeadlessRenderer::SetupRC() {
+	glfwDefaultWindowHints();
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	// the window is never shown, its framebuffer is not used
+	window = glfwCreateWindow(64, 64, "RaymarchingCGTool", NULL, NULL);
+	if (!window) {
+		fprintf(stderr, "Failed to create the hidden GLFW window\n");
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+
+	glewExperimental = true; // Needed for core profile
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		DestroyRC();
+		return false;
+	}
+	return true;
+}
+
+void HeadlessRenderer::DestroyRC() {
+	glfwMakeContextCurrent(NULL);
+	glfwDestroyWindow(window);
+	window = NULL;
+}
+
+bool HeadlessRenderer::RenderInit() {
+	AppState &state = AppState::getInstance();
+
+	static const GLfloat g_vertex_buffer_data[] = {
+		-1.0f, -1.0f, 0.0f,
+		1.0f, -1.0f, 0.0f,
+		-1.0f, 1.0f, 0.0f,
+		1.0f, 1.0f, 0.0f,
+	};
+
+	// VBO
+	glGenBuffers(1, &vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// VAO
+	glGenVertexArrays(1, &vertexarrayobject);
+	glBindVertexArray(vertexarrayobject);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	if (state.poster)
+		target.Setup(std::min(state.outputWidth, (int)PosterTileWidth), std::min(state.outputHeight, (int)PosterTileHeight), GL_RGBA8);
+	else
+		target.Setup(state.outputWidth, state.outputHeight, GL_RGBA8);
+
+	// Generated program
+	programID = LoadShaders("DisplayWindow.vertexshader", AppState::OutputShaderName.c_str());
+	GLint linked = GL_FALSE;
+	if (programID)
+		glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		fprintf(stderr, "Failed to build %s\n", AppState::OutputShaderName.c_str());
+		return false;
+	}
+	timeID = glGetUniformLocation(programID, "time");
+	resolutionID = glGetUniformLocation(programID, "resolution");
+	aaModeID = glGetUniformLocation(programID, "aaMode");
+	jitterID = glGetUniformLocation(programID, "jitter");
+	tileOriginID = glGetUniformLocation(programID, "tileOrigin");
+	cameraUniforms.Locate(programID);
+
+	// brick maps of the BakedBlocks (baked by codegen)
+	glUseProgram(programID);
+	bakedTextures.Upload(CodeGenManager::getInstance().GetBakes());
+	bakedTextures.SetSamplers(programID);
+	return true;
+}
+
+void HeadlessRenderer::RenderTerm() {
+	target.Destroy();
+	bakedTextures.Destroy();
+	glDeleteProgram(programID);
+	glDeleteBuffers(1, &vertexbuffer);
+	glDeleteVertexArrays(1, &vertexarrayobject);
+	programID = 0;
+}
+
+void HeadlessRenderer::RenderFrame(float time, int tileX, int tileY) {
+	target.Bind();
+	glUseProgram(programID);
+	glUniform2f(resolutionID, AppState::getInstance().outputWidth, AppState::getInstance().outputHeight);
+	glUniform2f(tileOriginID, tileX, tileY);
+	glUniform1f(timeID, time);
+	cameraUniforms.Set(Camera::Orbit(time));
+	glUniform1i(aaModeID, 1); // edge-adaptive supersampling, as in the display window
+	glUniform2f(jitterID, 0.0f, 0.0f);
+
+	glBindVertexArray(vertexarrayobject);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+}
+
+bool HeadlessRenderer::RenderPoster() {
+	AppState &state = AppState::getInstance();
+	int w = state.outputWidth, h = state.outputHeight;
+	int stripHeight = target.Height;
+	int numStrips = (h + stripHeight - 1) / stripHeight;
+
+	FILE *file;
+	if (fopen_s(&file, state.outputPattern.c_str(), "wb") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", state.outputPattern.c_str());
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", w, h);
+
+	// two strip PBOs: the gpu renders a strip while the previous one is written to the file
+	GLuint stripBuffers[2];
+	GLsync stripFences[2] = { 0, 0 };
+	int stripRows[2] = { 0, 0 };
+	glGenBuffers(2, stripBuffers);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, stripBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * stripHeight * 4, NULL, GL_STREAM_READ);
+	}
+	glPixelStorei(GL_PACK_ROW_LENGTH, w); // tiles land side by side in the strip
+
+	std::vector<unsigned char> row(w * 3);
+	bool ok = true;
+	for (int strip = 0; strip <= numStrips; strip++) {
+		if (strip < numStrips) {
+			// strips go top to bottom (file order), GL rows start at the bottom
+			int top = strip * stripHeight;
+			int rows = std::min(stripHeight, h - top);
+			int y0 = h - top - rows;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, stripBuffers[strip % 2]);
+			for (int x0 = 0; x0 < w; x0 += target.Width) {
+				RenderFrame(state.startTime, x0, y0);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, target.framebuffer);
+				glReadPixels(0, 0, std::min(target.Width, w - x0), rows, GL_RGBA, GL_UNSIGNED_BYTE, (void*)((size_t)x0 * 4));
+			}
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			stripFences[strip % 2] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			stripRows[strip % 2] = rows;
+			glFlush();
+		}
+
+		if (strip > 0) {
+			int prev = (strip - 1) % 2;
+			while (glClientWaitSync(stripFences[prev], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+			glDeleteSync(stripFences[prev]);
+			stripFences[prev] = 0;
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, stripBuffers[prev]);
+			const unsigned char *pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)w * stripRows[prev] * 4, GL_MAP_READ_BIT);
+			for (int y = stripRows[prev] - 1; pixels && y >= 0; y--) {
+				const unsigned char *src = pixels + (size_t)y * w * 4;
+				for (int x = 0; x < w; x++) {
+					row[x * 3 + 0] = src[x * 4 + 0];
+					row[x * 3 + 1] = src[x * 4 + 1];
+					row[x * 3 + 2] = src[x * 4 + 2];
+				}
+				ok = fwrite(&row[0], 1, row.size(), file) == row.size() && ok;
+			}
+			ok = pixels && ok;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+	}
+
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glDeleteBuffers(2, stripBuffers);
+	ok = (fclose(file) == 0) && ok;
+	if (!ok)
+		fprintf(stderr, "Failed to write %s\n", state.outputPattern.c_str());
+
+	printf("%d strips of %d tiles, %.1f MB of strip buffers\n", numStrips, (w + target.Width - 1) / target.Width, 2.0 * w * stripHeight * 4 / (1024.0 * 1024.0));
+	return ok;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef HEADLESSRENDERER_HPP
+#define HEADLESSRENDERER_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include "offscreentarget.hpp"
+#include "camera.hpp"
+#include "brickmap.hpp"
+
+// Batch rendering without visible windows: a hidden window only provides the context,
+// frames go to an offscreen target and are exported by a FrameExporter
+class HeadlessRenderer {
+
+public:
+	// poster tiles: the strip height bounds the host memory (two strips of width x PosterTileHeight)
+	static const int PosterTileWidth = 2048;
+	static const int PosterTileHeight = 256;
+
+	static HeadlessRenderer &getInstance() {
+		static HeadlessRenderer instance;
+		return instance;
+	}
+
+	// load the graph and run what the AppState options ask for; return the exit code.
+	// Run: codegen and GL frames or poster, after glfwInit. RunCpu: the cpu paths (CpuRenderer frames as PPM,
+	// exports, validation, benchmarks), no GLFW or GL context
+	int Run();
+	int RunCpu();
+
+private:
+	HeadlessRenderer() : window(NULL), programID(0), vertexbuffer(0), vertexarrayobject(0) {}
+
+	bool SetupRC();
+	void DestroyRC();
+	bool RenderInit();
+	void RenderTerm();
+	void RenderFrame(float time, int tileX, int tileY); // target-sized tile of the output image at (tileX, tileY)
+	bool RenderPoster();
+	bool LoadGraph(); // --graph, if given
+
+	GLFWwindow *window;
+	GLuint programID;
+	GLuint timeID;
+	GLuint resolutionID;
+	GLuint aaModeID;
+	GLuint jitterID;
+	GLuint tileOriginID;
+	CameraUniforms cameraUniforms;
+	GLuint vertexbuffer;
+	GLuint vertexarrayobject;
+	OffscreenTarget target;
+	BakedTextures bakedTextures;
+};
+
+
+#endif
@@ -13,6 +13,9 @@
 #include "block.hpp"
 #include "windowinfo.hpp"
 #include "appstate.hpp"
+#include "headlessrenderer.hpp"
+#include "codegen.hpp"
+#include "bakescheduler.hpp"
 #include <cstring>
 #include <chrono>
 #include <vector>
@@ -73,8 +76,84 @@ void DestroyUIThread() {
 }
 
 
+static void PrintUsage() {
+	fprintf(stderr,
+		"Usage: RayMarchingCGTool [options]\n"
+		"  --graph <file>     load a block graph at startup\n"
+		"  --auto-bake <cost> bake time-invariant subtrees above this estimated per-step cost, e.g. 200 (default 0: off)\n"
+		"  --headless         render frames to files without opening windows\n"
+		"  --poster           render a single frame of any size in tiles, to a PPM file (headless)\n"
+		"  --cpu              render PPM frames with the CPU reference raymarcher, no GPU needed (headless)\n"
+		"  --threads <n>      CPU rendering threads, 0 for one per core (cpu)\n"
+		"  --benchmark        print the CPU raymarcher scaling from 1 to --threads threads (cpu)\n"
+		"  --simd <isa>       CPU ray packet kernels: none, sse, avx2 or avx512 (cpu, default: best supported)\n"
+		"  --benchmark-simd   print the ray packet kernels throughput against the scalar march (cpu)\n"
+		"  --benchmark-query  print the batched distance / gradient queries throughput up to --threads threads (cpu)\n"
+		"  --mesh <file>      export the graph as a marching cubes mesh: .stl, .ply or .obj (cpu)\n"
+		"  --mesh-resolution <n> mesh cells along the longest side of the scene (cpu, default 256)\n"
+		"  --mesh-dense       sample every grid corner, without the interval octree (cpu, baseline)\n"
+		"  --volume <file>    export the distance field as a chunked compressed volume (cpu)\n"
+		"  --volume-resolution <n> volume samples along the longest side of the scene (cpu, default 512)\n"
+		"  --volume-region <x,y,z,w,h,d> read this region of the --volume file back and check it against the graph (cpu)\n"
+		"  --validate         check that the block types and graph blocks are distance bounds, fails on overshoot (cpu)\n"
+		"  --validate-samples <n> random points per validated function (cpu, default 2097152)\n"
+		"  --width <w>        output width (headless)\n"
+		"  --height <h>       output height (headless)\n"
+		"  --frames <n>       number of frames (headless)\n"
+		"  --time <t>         scene time of the first frame (headless)\n"
+		"  --dt <t>           scene time step between frames (headless)\n"
+		"  --out <pattern>    printf pattern of the output files, e.g. frame_%%04d.ppm (headless)\n");
+}
+
+static bool ParseCommandLine(int argc, char *argv[]) {
+	AppState &state = AppState::getInstance();
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--headless")) state.headless = true;
+		else if (!strcmp(argv[i], "--poster")) state.headless = state.poster = true;
+		else if (!strcmp(argv[i], "--cpu")) state.headless = state.cpu = true;
+		else if (!strcmp(argv[i], "--benchmark")) state.headless = state.cpu = state.benchmark = true;
+		else if (!strcmp(argv[i], "--threads") && hasValue) state.numThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--simd") && hasValue) state.simd = argv[++i];
+		else if (!strcmp(argv[i], "--benchmark-simd")) state.headless = state.cpu = state.benchmarkSimd = true;
+		else if (!strcmp(argv[i], "--benchmark-query")) state.headless = state.cpu = state.benchmarkQuery = true;
+		else if (!strcmp(argv[i], "--mesh") && hasValue) { state.headless = state.cpu = true; state.meshFile = argv[++i]; }
+		else if (!strcmp(argv[i], "--mesh-resolution") && hasValue) state.meshResolution = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--mesh-dense")) state.meshDense = true;
+		else if (!strcmp(argv[i], "--volume") && hasValue) { state.headless = state.cpu = true; state.volumeFile = argv[++i]; }
+		else if (!strcmp(argv[i], "--volume-resolution") && hasValue) state.volumeResolution = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--volume-region") && hasValue) {
+			int *r = state.volumeRegion;
+			if (sscanf(argv[++i], "%d,%d,%d,%d,%d,%d", &r[0], &r[1], &r[2], &r[3], &r[4], &r[5]) != 6 || r[3] <= 0 || r[4] <= 0 || r[5] <= 0)
+				return false;
+		}
+		else if (!strcmp(argv[i], "--validate")) state.headless = state.cpu = state.validate = true;
+		else if (!strcmp(argv[i], "--validate-samples") && hasValue) state.validateSamples = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--graph") && hasValue) state.graphFile = argv[++i];
+		else if (!strcmp(argv[i], "--auto-bake") && hasValue) state.autoBakeCost = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--width") && hasValue) state.outputWidth = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && hasValue) state.outputHeight = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--frames") && hasValue) state.numFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--time") && hasValue) state.startTime = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--dt") && hasValue) state.timeStep = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--out") && hasValue) state.outputPattern = argv[++i];
+		else return false;
+	}
+	return state.outputWidth > 0 && state.outputHeight > 0 && state.numFrames >= 0 && state.meshResolution > 0 && state.volumeResolution > 1 && state.validateSamples > 0;
+}
+
+
 int main(int argc, char *argv[])
 {
+	if (!ParseCommandLine(argc, argv)) {
+		PrintUsage();
+		exit(EXIT_FAILURE);
+	}
+
+	// CPU paths: no GL, they run without a display
+	if (AppState::getInstance().headless && AppState::getInstance().cpu)
+		return HeadlessRenderer::getInstance().RunCpu();
+
 	// Initialise GLFW
 	if (!glfwInit()) {
 		fprintf(stderr, "Failed to initialize GLFW\n");
@@ -82,6 +161,14 @@ int main(int argc, char *argv[])
 	}
 	glfwSetErrorCallback(AppState::getInstance().error_callback);
 
+	if (AppState::getInstance().headless) {
+		int result = HeadlessRenderer::getInstance().Run();
+		glfwTerminate();
+		return result;
+	}
+
+	if (!AppState::getInstance().graphFile.empty())
+		BlockGraph::getInstance().LoadFromFile(AppState::getInstance().graphFile);
 
 	AppState::getInstance().isRunning = true;
 	AppState::getInstance().resetTimer();
@@ -92,11 +179,16 @@ int main(int argc, char *argv[])
 	while (AppState::getInstance().isRunning) {
 		// Poll events
 		glfwPollEvents();
+
+		// bakes finish in the background: compile again to sample them
+		if (BakeScheduler::getInstance().PollFinished() && CodeGenManager::getInstance().UpdateBakes())
+			DiagramWindowUserInputManager::compileGraph();
 	}
 
 
 	// Close Display thead and terminate GLFW
 	DestroyUIThread(); 
+	BakeScheduler::getInstance().Stop();
 	glfwTerminate();
 
 
@@ -0,0 +1,312 @@
+#include "meshexporter.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+	// Marching cubes cases, derived from the cell faces instead of typed in. Corner i of a cell is at
+	// (i & 1, i >> 1 & 1, i >> 2 & 1), edge e starts at corner edgeCorner[e] and follows axis e / 4.
+	// On every face the surface crossings are joined so that the inside corners stay apart (the
+	// decision only depends on the face, so neighbour cells agree and the mesh is closed), the
+	// segments are chained into loops around the cell and the loops are fanned into triangles.
+	struct CaseTable {
+		static const int MaxEdges = 12 * 3 + 1;
+
+		int edgeCorner[12];
+		signed char triangles[256][MaxEdges]; // edge triples, -1 terminated
+
+		CaseTable() {
+			int edgeIndex[8][3];
+			for (int axis = 0, e = 0; axis < 3; axis++)
+				for (int corner = 0; corner < 8; corner++)
+					if (!(corner >> axis & 1)) {
+						edgeCorner[e] = corner;
+						edgeIndex[corner][axis] = e++;
+					}
+
+			// corners counter-clockwise seen from outside the cell
+			int faces[6][4];
+			for (int axis = 0; axis < 3; axis++)
+				for (int side = 0; side < 2; side++) {
+					int u = 1 << (axis + 1) % 3, v = 1 << (axis + 2) % 3, base = side << axis;
+					int *f = faces[2 * axis + side];
+					f[0] = base; f[2] = base | u | v;
+					f[1] = side ? base | u : base | v;
+					f[3] = side ? base | v : base | u;
+				}
+
+			for (int mask = 0; mask < 256; mask++) {
+				// next[e]: the segment leaving the crossing of edge e
+				int next[12];
+				std::fill(next, next + 12, -1);
+				for (int f = 0; f < 6; f++) {
+					bool in[4];
+					int edge[4];
+					for (int i = 0; i < 4; i++) {
+						int p = faces[f][i], q = faces[f][(i + 1) % 4];
+						in[i] = (mask >> p & 1) != 0;
+						int axis = (p ^ q) == 1 ? 0 : (p ^ q) == 2 ? 1 : 2;
+						edge[i] = edgeIndex[std::min(p, q)][axis];
+					}
+					// leaving an inside run, go back to where the same run was entered
+					for (int i = 0; i < 4; i++) {
+						if (!in[i] || in[(i + 1) % 4])
+							continue;
+						int j = i;
+						do j = (j + 3) % 4; while (in[j] || !in[(j + 1) % 4]);
+						next[edge[i]] = edge[j];
+					}
+				}
+
+				// the loops turn clockwise seen from outside the surface: reversed fans
+				signed char *out = triangles[mask];
+				bool used[12] = {};
+				for (int start = 0; start < 12; start++) {
+					if (next[start] < 0 || used[start])
+						continue;
+					int loop[12], n = 0;
+					for (int e = start; !used[e]; e = next[e]) {
+						used[e] = true;
+						loop[n++] = e;
+					}
+					for (int k = 1; k + 1 < n; k++) {
+						*out++ = (signed char)loop[0];
+						*out++ = (signed char)loop[k + 1];
+						*out++ = (signed char)loop[k];
+					}
+				}
+				*out = -1;
+			}
+		}
+	};
+
+	const CaseTable &Cases() {
+		static const CaseTable table;
+		return table;
+	}
+
+}
+
+MeshExporter::MeshExporter(const CpuScene &scene, const NativeScene *native, int resolution, bool prune) :
+	scene(scene), native((native && native->IsNative()) ? native : NULL), simdLevel(DetectSimdLevel()), prune(prune), cellSize(0.0f), numChunks(0),
+	maxChunksAhead(1), peakSeams(0)
+{
+	// two cells of margin: the border samples are outside, the surface is closed
+	glm::vec3 min, max;
+	scene.Bounds(min, max);
+	glm::vec3 size = max - min;
+	cellSize = std::max(std::max(size.x, std::max(size.y, size.z)) / std::max(resolution, 1), 1e-6f);
+	origin = min - 2.0f * cellSize;
+	cells = glm::ivec3(glm::ceil(size / cellSize)) + 4;
+	chunks = (cells + (int)ChunkSize - 1) / (int)ChunkSize;
+	numChunks = chunks.x * chunks.y * chunks.z;
+	done.assign(numChunks, NULL);
+}
+
+MeshExporter::~MeshExporter() {
+	for (size_t i = 0; i < done.size(); i++)
+		delete done[i];
+}
+
+bool MeshExporter::Export(const CpuScene &scene, const NativeScene *native, int resolution, int numThreads, const std::string &fileName, bool prune) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	glm::vec3 min, max;
+	if (!scene.Bounds(min, max)) {
+		fprintf(stderr, "Nothing to export, the scene is empty\n");
+		return false;
+	}
+	MeshWriter writer(fileName);
+	if (!writer.Start())
+		return false;
+
+	MeshExporter exporter(scene, native, resolution, prune);
+	WorkerPool pool(numThreads);
+	numThreads = pool.NumThreads();
+	exporter.maxChunksAhead = std::max(numThreads, 1) * ChunksAheadPerThread;
+	std::vector<Scratch> scratch(std::max(numThreads, 1));
+
+	// the chunks are written in order, whichever worker finishes first
+	long long samples = 0, denseSamples = 0, intervals = 0;
+	pool.Run(exporter.numChunks, [&exporter, &scratch](int chunk, int worker) {
+		exporter.done[chunk] = exporter.Polygonize(chunk, scratch[worker]);
+	}, [&](int chunk) {
+		ChunkMesh *mesh = exporter.done[chunk];
+		exporter.done[chunk] = NULL;
+		exporter.Write(chunk, *mesh, writer);
+		samples += mesh->samples;
+		denseSamples += mesh->denseSamples;
+		intervals += mesh->intervals;
+		delete mesh;
+	}, exporter.maxChunksAhead);
+	bool ok = writer.Finish();
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	printf("Exported %s: %u triangles, %u vertices from %dx%dx%d cells (%d chunks, %d threads, %s) in %.0f ms, %.2f Mcells/s\n",
+		fileName.c_str(), writer.NumTriangles, writer.NumVertices, exporter.cells.x, exporter.cells.y, exporter.cells.z,
+		exporter.numChunks, numThreads, exporter.native ? "native" : SimdLevelName(exporter.simdLevel), ms,
+		(double)exporter.cells.x * exporter.cells.y * exporter.cells.z / (ms * 1000.0));
+	printf("  sampled %lld of %lld cell corners (%.2f%%), %lld octree boxes bounded\n",
+		samples, denseSamples, 100.0 * samples / std::max(denseSamples, 1LL), intervals);
+	printf("  at most %d chunks in flight, %zu seam vertices held\n", exporter.maxChunksAhead, exporter.peakSeams);
+	return ok;
+}
+
+MeshExporter::ChunkMesh *MeshExporter::Polygonize(int chunk, Scratch &scratch) const {
+	const CaseTable &table = Cases();
+	glm::ivec3 first = ChunkCoords(chunk) * (int)ChunkSize;
+	glm::ivec3 size(std::min((int)ChunkSize, cells.x - first.x), std::min((int)ChunkSize, cells.y - first.y), std::min((int)ChunkSize, cells.z - first.z));
+	glm::ivec3 samples = size + 1;
+	int numSamples = samples.x * samples.y * samples.z;
+	const int dy = samples.x, dz = samples.x * samples.y;
+	const int axisStep[3] = { 1, dy, dz };
+	const int cornerOffset[8] = { 0, 1, dy, 1 + dy, dz, 1 + dz, dy + dz, 1 + dy + dz };
+
+	ChunkMesh *mesh = new ChunkMesh();
+	mesh->samples = 0;
+	mesh->denseSamples = numSamples;
+	mesh->intervals = 0;
+
+	// the cells the surface may cross
+	scratch.leaves.clear();
+	if (prune) {
+		SurfaceOctree octree(scene, origin, cellSize);
+		octree.Collect(first, size, scratch.leaves);
+		mesh->intervals = octree.stats.intervals;
+	}
+	else {
+		SurfaceOctree::Leaf all = { first, size };
+		scratch.leaves.push_back(all);
+	}
+	if (scratch.leaves.empty())
+		return mesh;
+
+	scratch.active.assign((size_t)size.x * size.y * size.z, 0);
+	scratch.needed.assign(numSamples, 0);
+	for (auto leaf = scratch.leaves.begin(); leaf != scratch.leaves.end(); ++leaf) {
+		glm::ivec3 from = leaf->first - first, to = from + leaf->size;
+		for (int k = from.z; k <= to.z; k++)
+			for (int j = from.y; j <= to.y; j++)
+				for (int i = from.x; i <= to.x; i++) {
+					scratch.needed[(k * samples.y + j) * samples.x + i] = 1;
+					if (i < to.x && j < to.y && k < to.z)
+						scratch.active[(k * size.y + j) * size.x + i] = 1;
+				}
+	}
+
+	// their corners, SoA
+	scratch.sampled.clear();
+	for (int s = 0; s < numSamples; s++)
+		if (scratch.needed[s]) scratch.sampled.push_back(s);
+	int n = (int)scratch.sampled.size();
+	scratch.points.resize(4 * (size_t)n);
+	float *x = &scratch.points[0], *y = x + n, *z = y + n, *dn = z + n;
+	for (int m = 0; m < n; m++) {
+		int s = scratch.sampled[m];
+		x[m] = origin.x + (first.x + s % samples.x) * cellSize;
+		y[m] = origin.y + (first.y + s / samples.x % samples.y) * cellSize;
+		z[m] = origin.z + (first.z + s / dz) * cellSize;
+	}
+	if (native)
+		native->Evaluate(x, y, z, dn, n);
+	else DistanceBatch(simdLevel, scene, x, y, z, dn, n);
+	mesh->samples = n;
+	scratch.distances.resize(numSamples);
+	float *d = &scratch.distances[0];
+	for (int m = 0; m < n; m++)
+		d[scratch.sampled[m]] = dn[m];
+
+	// edgeSlots: per corner and axis, vertex of the edge starting there (-1: none yet)
+	std::vector<int> &edgeSlots = scratch.edgeSlots;
+	edgeSlots.assign(3 * (size_t)numSamples, -1);
+	for (int k = 0, cell = 0; k < size.z; k++)
+		for (int j = 0; j < size.y; j++)
+			for (int i = 0; i < size.x; i++, cell++) {
+				if (!scratch.active[cell])
+					continue;
+				int s = (k * samples.y + j) * samples.x + i;
+				int mask = 0;
+				for (int c = 0; c < 8; c++)
+					if (d[s + cornerOffset[c]] < 0.0f) mask |= 1 << c;
+				if (mask == 0 || mask == 255)
+					continue;
+
+				for (const signed char *e = table.triangles[mask]; *e >= 0; e++) {
+					int corner = table.edgeCorner[*e], axis = *e / 4;
+					int s0 = s + cornerOffset[corner];
+					int &slot = edgeSlots[3 * s0 + axis];
+					if (slot < 0) {
+						slot = (int)mesh->positions.size();
+						float t = d[s0] / (d[s0] - d[s0 + axisStep[axis]]);
+						glm::ivec3 g = first + glm::ivec3(i + (corner & 1), j + (corner >> 1 & 1), k + (corner >> 2 & 1));
+						glm::vec3 p = origin + glm::vec3(g) * cellSize;
+						p[axis] += t * cellSize;
+						mesh->edges.push_back(EdgeId(g, axis));
+						mesh->positions.push_back(p);
+					}
+					mesh->triangles.push_back(slot);
+				}
+			}
+	return mesh;
+}
+
+void MeshExporter::Write(int chunk, const ChunkMesh &mesh, MeshWriter &writer) {
+	glm::ivec3 coords = ChunkCoords(chunk);
+	size_t numVertices = mesh.positions.size();
+	std::vector<unsigned> indices(numVertices);
+	std::vector<glm::vec3> positions(mesh.positions);
+
+	for (size_t v = 0; v < numVertices; v++) {
+		unsigned long long id = mesh.edges[v];
+		int axis = (int)(id % 3);
+		unsigned long long point = id / 3;
+		glm::ivec3 g((int)(point % (cells.x + 1)), (int)(point / (cells.x + 1) % (cells.y + 1)), (int)(point / ((unsigned long long)(cells.x + 1) * (cells.y + 1))));
+
+		// chunks of the cells around the edge: the first one in writing order owns the vertex
+		glm::ivec3 owner;
+		int sharing = 1;
+		for (int b = 0; b < 3; b++) {
+			if (b == axis) {
+				owner[b] = g[b] / ChunkSize;
+				continue;
+			}
+			int low = std::max(g[b] - 1, 0) / ChunkSize, high = std::min(g[b], cells[b] - 1) / ChunkSize;
+			owner[b] = low;
+			sharing *= high - low + 1;
+		}
+
+		if (sharing == 1)
+			indices[v] = writer.AddVertex(positions[v]);
+		else if (owner == coords) {
+			indices[v] = writer.AddVertex(positions[v]);
+			SeamVertex seam = { indices[v], positions[v], sharing - 1 };
+			seams[id] = seam;
+			peakSeams = std::max(peakSeams, seams.size());
+		}
+		else {
+			auto it = seams.find(id);
+			if (it == seams.end()) {
+				// the owner saw no crossing (distances differing across chunks), keep the mesh valid
+				indices[v] = writer.AddVertex(positions[v]);
+				continue;
+			}
+			indices[v] = it->second.index;
+			positions[v] = it->second.position;
+			if (--it->second.remainingChunks == 0)
+				seams.erase(it);
+		}
+	}
+
+	for (size_t t = 0; t + 2 < mesh.triangles.size(); t += 3) {
+		unsigned index[3];
+		glm::vec3 position[3];
+		for (int k = 0; k < 3; k++) {
+			index[k] = indices[mesh.triangles[t + k]];
+			position[k] = positions[mesh.triangles[t + k]];
+		}
+		writer.AddTriangle(index, position);
+	}
+}
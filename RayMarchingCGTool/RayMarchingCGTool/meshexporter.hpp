@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef MESHEXPORTER_HPP
+#define MESHEXPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+#include "nativescene.hpp"
+#include "raypacket.hpp"
+#include "meshwriter.hpp"
+#include "surfaceoctree.hpp"
+#include "workerpool.hpp"
+
+// Marching cubes mesh export. The grid over the scene bounds is split into chunks of ChunkSize^3
+// cells: the workers of an ordered WorkerPool Run sample and polygonize chunks, the calling thread
+// streams them in order to a MeshWriter. Vertices live on grid edges and are shared: inside a chunk
+// through the edge slots, across seams through a table holding the seam vertices until every chunk
+// sharing their edge is written. Memory stays bounded by the chunks in flight and the seams of the current front.
+// A SurfaceOctree per chunk drops the empty and full boxes: only the corners of its leaves are sampled,
+// by the native backend of the same graph when it is loaded, else by the SIMD kernels.
+class MeshExporter {
+
+public:
+	static const int ChunkSize = 32; // cells per chunk edge
+	static const int ChunksAheadPerThread = 4; // polygonized chunks waiting for the writer
+
+	// native: scene() of the same graph as machine code (NULL or without library: the SIMD kernels);
+	// resolution: cells along the longest side of the surface bounds; numThreads: 0 for one per core;
+	// prune: false samples every cell corner (the dense baseline, same mesh)
+	static bool Export(const CpuScene &scene, const NativeScene *native, int resolution, int numThreads, const std::string &fileName, bool prune = true);
+
+private:
+	struct ChunkMesh {
+		std::vector<unsigned long long> edges; // per vertex: grid edge id
+		std::vector<glm::vec3> positions;
+		std::vector<int> triangles; // local vertex indices
+		long long samples, denseSamples, intervals; // distances evaluated, cell corners, octree boxes bounded
+	};
+
+	// per worker
+	struct Scratch {
+		std::vector<float> points; // x, y, z of the sampled corners (SoA), then their distances
+		std::vector<float> distances; // per cell corner of the chunk
+		std::vector<unsigned char> needed; // per cell corner: a corner of an octree leaf
+		std::vector<int> sampled; // indices of the needed corners
+		std::vector<unsigned char> active; // per cell: in an octree leaf
+		std::vector<int> edgeSlots;
+		std::vector<SurfaceOctree::Leaf> leaves;
+	};
+
+	struct SeamVertex {
+		unsigned index;
+		glm::vec3 position;
+		int remainingChunks; // sharing chunks not written yet
+	};
+
+	MeshExporter(const CpuScene &scene, const NativeScene *native, int resolution, bool prune);
+	~MeshExporter();
+
+	ChunkMesh *Polygonize(int chunk, Scratch &scratch) const;
+	void Write(int chunk, const ChunkMesh &mesh, MeshWriter &writer);
+	unsigned long long EdgeId(const glm::ivec3 &g, int axis) const {
+		return (((unsigned long long)g.z * (cells.y + 1) + g.y) * (cells.x + 1) + g.x) * 3 + axis;
+	}
+	glm::ivec3 ChunkCoords(int chunk) const {
+		return glm::ivec3(chunk % chunks.x, chunk / chunks.x % chunks.y, chunk / (chunks.x * chunks.y));
+	}
+
+	const CpuScene &scene;
+	const NativeScene *native; // NULL: DistanceBatch
+	SimdLevel simdLevel;
+	bool prune;
+	glm::vec3 origin; // grid point 0
+	float cellSize;
+	glm::ivec3 cells, chunks; // per axis
+	int numChunks;
+
+	int maxChunksAhead;
+	std::vector<ChunkMesh *> done; // per chunk, from the worker that polygonizes it to the writer
+
+	// writer thread only
+	std::unordered_map<unsigned long long, SeamVertex> seams;
+	size_t peakSeams;
+};
+
+
+#endif
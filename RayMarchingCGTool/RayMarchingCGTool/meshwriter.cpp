@@ -0,0 +1,141 @@
+#include "meshwriter.hpp"
+
+// Include standard headers
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+
+static bool HasExtension(const std::string &str, const char *extension) {
+	size_t n = strlen(extension);
+	if (str.size() < n)
+		return false;
+	for (size_t i = 0; i < n; i++)
+		if (tolower((unsigned char)str[str.size() - n + i]) != extension[i])
+			return false;
+	return true;
+}
+
+MeshWriter::MeshWriter(const std::string &fileName) :
+	NumVertices(0), NumTriangles(0),
+	fileName(fileName), format(STL), stream(NULL), faces(NULL),
+	vertexCountOffset(0), faceCountOffset(0), failed(false)
+{
+}
+
+MeshWriter::~MeshWriter() {
+	if (faces) fclose(faces);
+	if (stream) fclose(stream);
+}
+
+bool MeshWriter::Start() {
+	if (HasExtension(fileName, ".stl")) format = STL;
+	else if (HasExtension(fileName, ".ply")) format = PLY;
+	else if (HasExtension(fileName, ".obj")) format = OBJ;
+	else {
+		fprintf(stderr, "Unknown mesh format %s (.stl, .ply or .obj)\n", fileName.c_str());
+		return false;
+	}
+
+	if (fopen_s(&stream, fileName.c_str(), "wb") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", fileName.c_str());
+		return false;
+	}
+
+	// fixed width counts, rewritten in place once known
+	switch (format) {
+	case STL: {
+		char header[80] = "RayMarchingCGTool marching cubes";
+		unsigned count = 0;
+		fwrite(header, 1, sizeof(header), stream);
+		vertexCountOffset = faceCountOffset = ftell(stream);
+		fwrite(&count, 4, 1, stream);
+		break;
+	}
+	case PLY:
+		// little endian, as every target of the tool
+		fprintf(stream, "ply\nformat binary_little_endian 1.0\ncomment RayMarchingCGTool marching cubes\nelement vertex ");
+		vertexCountOffset = ftell(stream);
+		fprintf(stream, "%010u\nproperty float x\nproperty float y\nproperty float z\nelement face ", 0u);
+		faceCountOffset = ftell(stream);
+		fprintf(stream, "%010u\nproperty list uchar int vertex_indices\nend_header\n", 0u);
+		faces = tmpfile();
+		if (!faces) {
+			fprintf(stderr, "Impossible to create a temporary file for the faces of %s\n", fileName.c_str());
+			return false;
+		}
+		break;
+	case OBJ:
+		fprintf(stream, "# RayMarchingCGTool marching cubes\n");
+		break;
+	}
+	return !ferror(stream);
+}
+
+unsigned MeshWriter::AddVertex(const glm::vec3 &p) {
+	if (format == PLY)
+		fwrite(&p.x, 4, 3, stream);
+	else if (format == OBJ)
+		fprintf(stream, "v %.7g %.7g %.7g\n", p.x, p.y, p.z);
+	return NumVertices++;
+}
+
+void MeshWriter::AddTriangle(const unsigned index[3], const glm::vec3 position[3]) {
+	NumTriangles++;
+	if (format == STL) {
+		float record[12];
+		glm::vec3 n = glm::cross(position[1] - position[0], position[2] - position[0]);
+		float length = glm::length(n);
+		n = length > 0.0f ? n / length : glm::vec3(0.0f);
+		memcpy(record, &n.x, 12);
+		for (int k = 0; k < 3; k++)
+			memcpy(record + 3 + 3 * k, &position[k].x, 12);
+		unsigned short attributes = 0;
+		fwrite(record, 4, 12, stream);
+		fwrite(&attributes, 2, 1, stream);
+	}
+	else if (format == PLY) {
+		unsigned char record[13];
+		record[0] = 3;
+		memcpy(record + 1, index, 12);
+		fwrite(record, 1, sizeof(record), faces);
+	}
+	else fprintf(stream, "f %u %u %u\n", index[0] + 1, index[1] + 1, index[2] + 1);
+}
+
+bool MeshWriter::Finish() {
+	if (!stream)
+		return false;
+
+	if (format == PLY) {
+		// append the spooled faces
+		std::vector<char> buffer(1 << 20);
+		rewind(faces);
+		size_t n;
+		while ((n = fread(&buffer[0], 1, buffer.size(), faces)) > 0)
+			if (fwrite(&buffer[0], 1, n, stream) != n) failed = true;
+		if (ferror(faces)) failed = true;
+		fclose(faces);
+		faces = NULL;
+	}
+
+	if (format == STL) {
+		fseek(stream, faceCountOffset, SEEK_SET);
+		fwrite(&NumTriangles, 4, 1, stream);
+	}
+	else if (format == PLY) {
+		char count[11];
+		snprintf(count, sizeof(count), "%010u", NumVertices);
+		fseek(stream, vertexCountOffset, SEEK_SET);
+		fwrite(count, 1, 10, stream);
+		snprintf(count, sizeof(count), "%010u", NumTriangles);
+		fseek(stream, faceCountOffset, SEEK_SET);
+		fwrite(count, 1, 10, stream);
+	}
+
+	if (ferror(stream)) failed = true;
+	if (fclose(stream) != 0) failed = true;
+	stream = NULL;
+	if (failed)
+		fprintf(stderr, "Error while writing %s\n", fileName.c_str());
+	return !failed;
+}
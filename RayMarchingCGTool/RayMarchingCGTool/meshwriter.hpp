@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef MESHWRITER_HPP
+#define MESHWRITER_HPP
+
+#include <stdio.h>
+#include <string>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+// Streaming indexed triangle mesh output: binary STL, binary PLY or OBJ (the format follows the
+// file extension). Nothing is kept in memory: every vertex must be added before the triangles
+// referencing it, the counts of the headers are patched by Finish().
+class MeshWriter {
+
+public:
+	enum Format { STL, PLY, OBJ };
+
+	explicit MeshWriter(const std::string &fileName);
+	~MeshWriter();
+
+	bool Start(); // false: unknown format or the output can't be written
+	unsigned AddVertex(const glm::vec3 &p); // index of the vertex
+	void AddTriangle(const unsigned index[3], const glm::vec3 position[3]); // counter-clockwise seen from outside
+	bool Finish(); // false if any write failed
+
+	unsigned NumVertices;
+	unsigned NumTriangles;
+
+private:
+	std::string fileName;
+	Format format;
+	FILE *stream;
+	FILE *faces; // PLY: the faces element follows every vertex, spooled to a temporary file
+	long vertexCountOffset, faceCountOffset; // header fields patched by Finish()
+	bool failed;
+};
+
+
+#endif
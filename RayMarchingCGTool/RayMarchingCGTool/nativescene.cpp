@@ -0,0 +1,141 @@
+#include "nativescene.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "appstate.hpp"
+#include "codegen.hpp"
+#include "cpuscene.hpp"
+
+// source, library, log; contraction stays off so that results match the interpreter bit for bit
+#ifdef _WIN32
+static const char *CompileCommand = "cl /nologo /O2 /fp:precise /LD \"%s\" /Fe\"%s\" /Fo\"%s.obj\" > \"%s\" 2>&1";
+static const char *LibraryExtension = ".dll";
+#else
+static const char *CompileCommand = "c++ -O3 -march=native -ffp-contract=off -fno-math-errno -fPIC -shared \"%s\" -o \"%s\" > \"%s\" 2>&1";
+static const char *LibraryExtension = ".so";
+#endif
+
+// FNV-1a: the cache key of a generated source (and of the command building it)
+static unsigned long long HashString(const std::string &str, unsigned long long hash = 14695981039346656037ull) {
+	for (size_t i = 0; i < str.size(); i++)
+		hash = (hash ^ (unsigned char)str[i]) * 1099511628211ull;
+	return hash;
+}
+
+static bool FileExists(const std::string &fileName) {
+	FILE *file;
+	if (fopen_s(&file, fileName.c_str(), "rb") != 0)
+		return false;
+	fclose(file);
+	return true;
+}
+
+bool NativeScene::BuildFromGraph() {
+	Unload();
+	program = CpuScene::FromGraph().program;
+
+	std::string source = CodeGenManager::getInstance().GenerateNativeSource();
+	char hash[32];
+	snprintf(hash, sizeof(hash), "%016llx", HashString(CompileCommand, HashString(source)));
+	std::string baseName = AppState::NativeScenePrefix + hash;
+	std::string fileName = baseName + LibraryExtension;
+
+	// a graph seen before is loaded without running the compiler
+	if (!FileExists(fileName) && !Compile(source, baseName))
+		return false;
+
+#ifdef _WIN32
+	library = (void *)LoadLibraryA(fileName.c_str());
+	if (library) {
+		batch = (BatchFunction)GetProcAddress((HMODULE)library, "sceneBatch");
+		idBatch = (IdBatchFunction)GetProcAddress((HMODULE)library, "sceneIdBatch");
+	}
+#else
+	library = dlopen(("./" + fileName).c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (library) {
+		batch = (BatchFunction)dlsym(library, "sceneBatch");
+		idBatch = (IdBatchFunction)dlsym(library, "sceneIdBatch");
+	}
+#endif
+	if (!batch || !idBatch) {
+		fprintf(stderr, "Impossible to load %s, using the interpreter\n", fileName.c_str());
+		Unload();
+		return false;
+	}
+	libraryName = fileName;
+	return true;
+}
+
+bool NativeScene::Compile(const std::string &source, const std::string &baseName) {
+	std::string sourceName = baseName + ".cpp", logName = baseName + ".log";
+	std::string tempName = baseName + ".tmp" + LibraryExtension, fileName = baseName + LibraryExtension;
+
+	FILE *file;
+	if (fopen_s(&file, sourceName.c_str(), "w") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", sourceName.c_str());
+		return false;
+	}
+	fprintf(file, "%s", source.c_str());
+	fclose(file);
+
+	char command[4096];
+#ifdef _WIN32
+	snprintf(command, sizeof(command), CompileCommand, sourceName.c_str(), tempName.c_str(), baseName.c_str(), logName.c_str());
+#else
+	snprintf(command, sizeof(command), CompileCommand, sourceName.c_str(), tempName.c_str(), logName.c_str());
+#endif
+
+	// built under a temporary name: a library in the cache is always complete
+	auto startTime = std::chrono::system_clock::now();
+	if (system(command) != 0 || rename(tempName.c_str(), fileName.c_str()) != 0) {
+		fprintf(stderr, "Native scene build failed (see %s), using the interpreter\n", logName.c_str());
+		remove(tempName.c_str());
+		return false;
+	}
+	long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startTime).count();
+	printf("Compiled %s in %lld ms\n", fileName.c_str(), elapsedMs);
+	return true;
+}
+
+void NativeScene::Unload() {
+	if (library) {
+#ifdef _WIN32
+		FreeLibrary((HMODULE)library);
+#else
+		dlclose(library);
+#endif
+	}
+	library = NULL;
+	batch = NULL;
+	idBatch = NULL;
+	libraryName.clear();
+}
+
+void NativeScene::Evaluate(const float *x, const float *y, const float *z, float *d, int n) const {
+	if (batch)
+		batch(x, y, z, d, n);
+	else
+		program.Evaluate(x, y, z, d, n);
+}
+
+void NativeScene::EvaluateId(const float *x, const float *y, const float *z, float *d, float *id, int n) const {
+	if (idBatch) {
+		idBatch(x, y, z, d, id, n);
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		glm::vec2 r = program.EvaluateId(glm::vec3(x[i], y[i], z[i]));
+		d[i] = r.x;
+		id[i] = r.y;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef NATIVESCENE_HPP
+#define NATIVESCENE_HPP
+
+#include <string>
+#include "sdfprogram.hpp"
+
+// scene() as machine code: CodeGenManager::GenerateNativeSource() built by the system compiler into
+// a shared library, cached in the working directory by source hash and loaded at runtime.
+// The SdfProgram of the same graph is the fallback when the library can't be built.
+class NativeScene {
+
+public:
+	typedef void (*BatchFunction)(const float *x, const float *y, const float *z, float *d, int n);
+	typedef void (*IdBatchFunction)(const float *x, const float *y, const float *z, float *d, float *id, int n);
+
+	NativeScene() : library(NULL), batch(NULL), idBatch(NULL) {}
+	~NativeScene() { Unload(); }
+
+	// main thread (owner of the BlockGraph); false: no library, Evaluate runs the interpreter
+	bool BuildFromGraph();
+	void Unload();
+	bool IsNative() const { return batch != NULL; }
+
+	// thread safe between builds; scene() / sceneId() at n points (SoA)
+	void Evaluate(const float *x, const float *y, const float *z, float *d, int n) const;
+	void EvaluateId(const float *x, const float *y, const float *z, float *d, float *id, int n) const;
+
+	SdfProgram program; // interpreter of the same graph
+	std::string libraryName; // empty without library
+
+private:
+	// owns the library handle
+	NativeScene(const NativeScene &);
+	NativeScene &operator=(const NativeScene &);
+
+	bool Compile(const std::string &source, const std::string &baseName);
+
+	void *library;
+	BatchFunction batch;
+	IdBatchFunction idBatch;
+};
+
+
+#endif
@@ -0,0 +1,58 @@
+#include "offscreentarget.hpp"
+
+#include <cassert>
+
+void OffscreenTarget::Setup(int w, int h, GLenum internalFormat, int numColorAttachments) {
+	assert(numColorAttachments > 0 && numColorAttachments <= MaxColorAttachments);
+	Destroy();
+
+	Width = w;
+	Height = h;
+
+	// color textures
+	textures.resize(numColorAttachments);
+	glGenTextures(numColorAttachments, &textures[0]);
+	for (int i = 0; i < numColorAttachments; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// FBO
+	GLenum drawBuffers[MaxColorAttachments];
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	for (int i = 0; i < numColorAttachments; i++) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(numColorAttachments, drawBuffers);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OffscreenTarget::Destroy() {
+	if (framebuffer) {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures((GLsizei)textures.size(), &textures[0]);
+	}
+	framebuffer = 0;
+	textures.clear();
+	Width = Height = 0;
+}
+
+void OffscreenTarget::Bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, Width, Height);
+}
+
+void OffscreenTarget::BlitToScreen(int dstWidth, int dstHeight, GLenum filter) const {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, Width, Height, 0, 0, dstWidth, dstHeight, GL_COLOR_BUFFER_BIT, filter);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
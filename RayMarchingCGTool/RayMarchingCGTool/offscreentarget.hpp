@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef OFFSCREENTARGET_HPP
+#define OFFSCREENTARGET_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <vector>
+
+// Framebuffer with texture color attachments, owned by the context that created it
+class OffscreenTarget {
+
+public:
+	static const int MaxColorAttachments = 4;
+
+	OffscreenTarget() : framebuffer(0), Width(0), Height(0) {}
+
+	// (re)allocate the target; all attachments share the same internal format
+	void Setup(int w, int h, GLenum internalFormat = GL_RGBA8, int numColorAttachments = 1);
+	void Destroy();
+
+	bool IsValid() const { return framebuffer != 0; }
+	bool Matches(int w, int h) const { return framebuffer != 0 && Width == w && Height == h; }
+
+	void Bind() const; // as draw & read framebuffer, viewport covers the target
+	void BlitToScreen(int dstWidth, int dstHeight, GLenum filter = GL_NEAREST) const;
+
+	GLuint framebuffer;
+	std::vector<GLuint> textures;
+	int Width;
+	int Height;
+};
+
+
+#endif
@@ -0,0 +1,207 @@
+#include "raypacket.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// raypacketsse.cpp, raypacketavx2.cpp, raypacketavx512.cpp
+void MarchPacketSse(const CpuScene &scene, RayPacket &packet);
+void MarchPacketAvx2(const CpuScene &scene, RayPacket &packet);
+void MarchPacketAvx512(const CpuScene &scene, RayPacket &packet);
+void DistanceBatchSse(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n);
+void DistanceBatchAvx2(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n);
+void DistanceBatchAvx512(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n);
+
+// exp(-0.3 * t) < 0.05
+const float RayPacket::FarDistance = 10.0f;
+
+namespace {
+
+	// one lane: SIMD_NONE, with the early exits of the kernels
+	struct ScalarLanes {
+		typedef float F;
+		typedef bool M;
+		static const int Count = 1;
+
+		static F Set(float v) { return v; }
+		static F Load(const float *p) { return *p; }
+		static void Store(float *p, F v) { *p = v; }
+		static F Add(F a, F b) { return a + b; }
+		static F Sub(F a, F b) { return a - b; }
+		static F Mul(F a, F b) { return a * b; }
+		static F Min(F a, F b) { return std::min(a, b); }
+		static F Max(F a, F b) { return std::max(a, b); }
+		static F Sqrt(F a) { return std::sqrt(a); }
+		static F Abs(F a) { return std::abs(a); }
+
+		static M Less(F a, F b) { return a < b; }
+		static M FirstLanes(int n) { return n > 0; }
+		static M AndNot(M a, M b) { return a && !b; }
+		static M Or(M a, M b) { return a || b; }
+		static bool Any(M m) { return m; }
+		static F Select(M m, F a, F b) { return m ? a : b; }
+	};
+
+}
+
+#include "raypacketkernels.hpp"
+
+static void CpuId(int leaf, int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+	__cpuidex((int *)regs, leaf, subleaf);
+#else
+	if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+// register state the os saves on a context switch (XCR0)
+static unsigned long long OsSavedState() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+SimdLevel DetectSimdLevel() {
+	unsigned int regs[4];
+	CpuId(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+
+	// AVX needs xgetbv and the os saving the ymm (and zmm) registers
+	CpuId(1, 0, regs);
+	if (!(regs[2] & (1u << 27)) || maxLeaf < 7)
+		return SIMD_SSE;
+	unsigned long long state = OsSavedState();
+
+	CpuId(7, 0, regs);
+	if ((regs[1] & (1u << 16)) && (state & 0xe6) == 0xe6)
+		return SIMD_AVX512;
+	if ((regs[1] & (1u << 5)) && (state & 0x6) == 0x6)
+		return SIMD_AVX2;
+	return SIMD_SSE;
+}
+
+int SimdLanes(SimdLevel level) {
+	static const int lanes[] = { 1, 4, 8, 16 };
+	return lanes[level];
+}
+
+const char *SimdLevelName(SimdLevel level) {
+	static const char *names[] = { "none", "sse", "avx2", "avx512" };
+	return names[level];
+}
+
+bool ParseSimdLevel(const char *name, SimdLevel &level) {
+	for (int i = SIMD_NONE; i <= SIMD_AVX512; i++) if (strcmp(name, SimdLevelName((SimdLevel)i)) == 0) {
+		level = (SimdLevel)i;
+		return true;
+	}
+	return false;
+}
+
+void MarchPacket(SimdLevel level, const CpuScene &scene, RayPacket &packet) {
+	if (scene.program.IsEmpty()) {
+		std::fill(packet.t, packet.t + packet.count, 0.0f);
+		return;
+	}
+
+	switch (level) {
+	case SIMD_SSE: MarchPacketSse(scene, packet); break;
+	case SIMD_AVX2: MarchPacketAvx2(scene, packet); break;
+	case SIMD_AVX512: MarchPacketAvx512(scene, packet); break;
+	default: RayPacketKernels::MarchPacket<ScalarLanes>(scene, packet);
+	}
+}
+
+void DistanceBatch(SimdLevel level, const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n) {
+	if (scene.program.IsEmpty()) {
+		std::fill(d, d + n, 0.0f);
+		return;
+	}
+
+	switch (level) {
+	case SIMD_SSE: DistanceBatchSse(scene, x, y, z, d, n); break;
+	case SIMD_AVX2: DistanceBatchAvx2(scene, x, y, z, d, n); break;
+	case SIMD_AVX512: DistanceBatchAvx512(scene, x, y, z, d, n); break;
+	default:
+		scene.program.Evaluate(x, y, z, d, n);
+	}
+}
+
+void BenchmarkRayPackets(const CpuScene &scene, int w, int h) {
+	// the primary rays of the first benchmark frame, in 2x8 pixel packets as CpuRenderer
+	Camera camera = Camera::Orbit(0.0f);
+	glm::vec2 resolution((float)w, (float)h);
+	std::vector<RayPacket> packets;
+	for (int y = 0; y < h; y += 2) {
+		for (int x = 0; x < w; x += RayPacket::Size / 2) {
+			RayPacket packet;
+			for (int lane = 0; lane < RayPacket::Size; lane++) {
+				glm::vec2 fragCoord(x + lane % (RayPacket::Size / 2) + 0.5f, y + lane / (RayPacket::Size / 2) + 0.5f);
+				packet.SetRay(lane, camera.position, camera.RayDirection(fragCoord, resolution));
+			}
+			packet.count = RayPacket::Size;
+			packets.push_back(packet);
+		}
+	}
+	double numRays = (double)packets.size() * RayPacket::Size;
+	std::vector<float> reference(packets.size() * RayPacket::Size);
+
+	printf("Packet march, %dx%d primary rays, %d nodes, one thread\n", w, h, (int)scene.nodes.size());
+	printf("kernel  lanes  Mray/s  vs march  vs scalar  max |t - march t| (t < %.0f)\n", RayPacket::FarDistance);
+
+	// march: the 90 fixed steps of CpuScene::March, scalar (SIMD_NONE): one lane with the early exits of the kernels
+	SimdLevel best = DetectSimdLevel();
+	double marchMs = 0.0, scalarMs = 0.0;
+	for (int level = -1; level <= best; level++) {
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (auto it = packets.begin(); it != packets.end(); ++it) {
+			if (level < 0) {
+				for (int lane = 0; lane < it->count; lane++)
+					it->t[lane] = scene.March(glm::vec3(it->ox[lane], it->oy[lane], it->oz[lane]), glm::vec3(it->dx[lane], it->dy[lane], it->dz[lane]));
+			}
+			else
+				MarchPacket((SimdLevel)level, scene, *it);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		// retired lanes stop short of the 90 steps; only visible distances matter
+		float maxError = 0.0f;
+		for (size_t i = 0; i < packets.size(); i++) {
+			for (int lane = 0; lane < RayPacket::Size; lane++) {
+				float &t = reference[i * RayPacket::Size + lane];
+				if (level < 0)
+					t = packets[i].t[lane];
+				else if (t < RayPacket::FarDistance)
+					maxError = std::max(maxError, std::abs(packets[i].t[lane] - t));
+			}
+		}
+
+		if (level < 0) {
+			marchMs = ms;
+			continue; // printed with the scalar ratio
+		}
+		if (level == SIMD_NONE) {
+			scalarMs = ms;
+			printf("march       1  %6.2f  %8.2f  %9.2f  0\n", numRays / (marchMs * 1000.0), 1.0, scalarMs / marchMs);
+			printf("scalar      1  %6.2f  %8.2f  %9.2f  %g\n", numRays / (ms * 1000.0), marchMs / ms, 1.0, maxError);
+			continue;
+		}
+		printf("%-6s  %5d  %6.2f  %8.2f  %9.2f  %g\n", SimdLevelName((SimdLevel)level), SimdLanes((SimdLevel)level),
+			numRays / (ms * 1000.0), marchMs / ms, scalarMs / ms, maxError);
+	}
+}
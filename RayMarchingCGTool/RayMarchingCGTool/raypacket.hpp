@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef RAYPACKET_HPP
+#define RAYPACKET_HPP
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+
+// Instruction sets of the packet kernels, picked at runtime (SIMD_NONE: one lane at a time)
+enum SimdLevel { SIMD_NONE, SIMD_SSE, SIMD_AVX2, SIMD_AVX512 };
+
+SimdLevel DetectSimdLevel(); // best level of this cpu & os
+int SimdLanes(SimdLevel level); // rays per instruction: 1, 4, 8 or 16
+const char *SimdLevelName(SimdLevel level);
+bool ParseSimdLevel(const char *name, SimdLevel &level);
+
+// Rays marched together, structure of arrays. The kernels work on 4, 8 or 16 lanes at a time
+// and retire the lanes that converged (or left the fog) with masks.
+struct RayPacket {
+	static const int Size = 16;
+	// beyond this distance shade() returns black (fog factor < 0.05)
+	static const float FarDistance;
+
+	float ox[Size], oy[Size], oz[Size]; // origins
+	float dx[Size], dy[Size], dz[Size]; // normalized directions
+	float t[Size]; // hit distances, written by MarchPacket
+	int count; // used lanes
+
+	RayPacket() : count(0) {}
+	void SetRay(int lane, const glm::vec3 &origin, const glm::vec3 &dir) {
+		ox[lane] = origin.x; oy[lane] = origin.y; oz[lane] = origin.z;
+		dx[lane] = dir.x; dy[lane] = dir.y; dz[lane] = dir.z;
+	}
+};
+
+// CpuScene::March for every ray of the packet; a lane stops once |scene()| < 1e-5 (as the compute backend)
+void MarchPacket(SimdLevel level, const CpuScene &scene, RayPacket &packet);
+
+// scene() at n points (SoA); SIMD_NONE runs the batch interpreter of SdfProgram
+void DistanceBatch(SimdLevel level, const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n);
+
+// single thread rays per second of the scalar march and of every supported packet kernel
+void BenchmarkRayPackets(const CpuScene &scene, int w, int h);
+
+
+#endif
@@ -0,0 +1,46 @@
+#include "raypacket.hpp"
+
+// only called after DetectSimdLevel() found AVX2; every other header comes before the switch
+// so that no inline function shared with other files is compiled for AVX2
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+#include <immintrin.h>
+
+namespace {
+
+	struct Avx2Lanes {
+		typedef __m256 F;
+		typedef __m256 M;
+		static const int Count = 8;
+
+		static F Set(float v) { return _mm256_set1_ps(v); }
+		static F Load(const float *p) { return _mm256_loadu_ps(p); }
+		static void Store(float *p, F v) { _mm256_storeu_ps(p, v); }
+		static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+		static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+		static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+		static F Min(F a, F b) { return _mm256_min_ps(a, b); }
+		static F Max(F a, F b) { return _mm256_max_ps(a, b); }
+		static F Sqrt(F a) { return _mm256_sqrt_ps(a); }
+		static F Abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+		static M Less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static M FirstLanes(int n) { return _mm256_cmp_ps(_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f), _mm256_set1_ps((float)n), _CMP_LT_OQ); }
+		static M AndNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+		static M Or(M a, M b) { return _mm256_or_ps(a, b); }
+		static bool Any(M m) { return _mm256_movemask_ps(m) != 0; }
+		static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+	};
+
+}
+
+#include "raypacketkernels.hpp"
+
+void MarchPacketAvx2(const CpuScene &scene, RayPacket &packet) {
+	RayPacketKernels::MarchPacket<Avx2Lanes>(scene, packet);
+}
+
+void DistanceBatchAvx2(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n) {
+	RayPacketKernels::DistanceBatch<Avx2Lanes>(scene, x, y, z, d, n);
+}
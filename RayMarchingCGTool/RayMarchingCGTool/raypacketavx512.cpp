@@ -0,0 +1,47 @@
+#include "raypacket.hpp"
+
+// only called after DetectSimdLevel() found AVX-512F; every other header comes before the switch
+// so that no inline function shared with other files is compiled for AVX-512
+#if defined(__GNUC__) && !defined(__AVX512F__)
+#pragma GCC target("avx512f")
+#endif
+#include <immintrin.h>
+
+namespace {
+
+	// masks are k registers instead of vectors
+	struct Avx512Lanes {
+		typedef __m512 F;
+		typedef __mmask16 M;
+		static const int Count = 16;
+
+		static F Set(float v) { return _mm512_set1_ps(v); }
+		static F Load(const float *p) { return _mm512_loadu_ps(p); }
+		static void Store(float *p, F v) { _mm512_storeu_ps(p, v); }
+		static F Add(F a, F b) { return _mm512_add_ps(a, b); }
+		static F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+		static F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+		static F Min(F a, F b) { return _mm512_min_ps(a, b); }
+		static F Max(F a, F b) { return _mm512_max_ps(a, b); }
+		static F Sqrt(F a) { return _mm512_sqrt_ps(a); }
+		static F Abs(F a) { return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+
+		static M Less(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+		static M FirstLanes(int n) { return n >= Count ? (M)0xffff : (M)((1u << n) - 1); }
+		static M AndNot(M a, M b) { return (M)(a & ~b); }
+		static M Or(M a, M b) { return (M)(a | b); }
+		static bool Any(M m) { return m != 0; }
+		static F Select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+	};
+
+}
+
+#include "raypacketkernels.hpp"
+
+void MarchPacketAvx512(const CpuScene &scene, RayPacket &packet) {
+	RayPacketKernels::MarchPacket<Avx512Lanes>(scene, packet);
+}
+
+void DistanceBatchAvx512(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n) {
+	RayPacketKernels::DistanceBatch<Avx512Lanes>(scene, x, y, z, d, n);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#ifndef RAYPACKETKERNELS_HPP
+#define RAYPACKETKERNELS_HPP
+
+#include "raypacket.hpp"
+
+// Packet kernels, written once against a lane type L and instantiated by raypacketsse.cpp,
+// raypacketavx2.cpp and raypacketavx512.cpp (each compiled for its own instruction set).
+// L provides:
+//   F, M: a register of L::Count floats and a lane mask
+//   Set, Load, Store, Add, Sub, Mul, Min, Max, Sqrt, Abs
+//   Less(a, b), FirstLanes(n) (lanes below n), AndNot(a, b) (a and not b), Or, Any, Select(m, a, b) (m ? a : b)
+// Only include this after the instruction set has been enabled, and after every other header.
+namespace RayPacketKernels {
+
+	// scene() at Count points: the SdfProgram interpreter with a register per lane group
+	template <class L>
+	static typename L::F Distance(const SdfProgram &program, typename L::F x, typename L::F y, typename L::F z) {
+		typedef typename L::F F;
+		F regs[SdfProgram::MaxRegisters], zero = L::Set(0.0f);
+		const float *c = &program.constants[0];
+		for (auto in = program.code.begin(); in != program.code.end(); ++in) {
+			switch (in->op) {
+			case SdfProgram::OP_SPHERE:
+				regs[in->dst] = L::Sub(L::Sqrt(L::Add(L::Add(L::Mul(x, x), L::Mul(y, y)), L::Mul(z, z))), L::Set(c[in->constant]));
+				break;
+			case SdfProgram::OP_BOX: {
+				F size = L::Set(c[in->constant]);
+				F dx = L::Sub(L::Abs(x), size), dy = L::Sub(L::Abs(y), size), dz = L::Sub(L::Abs(z), size);
+				F inside = L::Min(L::Max(dx, L::Max(dy, dz)), zero);
+				dx = L::Max(dx, zero); dy = L::Max(dy, zero); dz = L::Max(dz, zero);
+				regs[in->dst] = L::Add(inside, L::Sqrt(L::Add(L::Add(L::Mul(dx, dx), L::Mul(dy, dy)), L::Mul(dz, dz))));
+				break;
+			}
+			default: // OP_DIFFERENCE
+				regs[in->dst] = L::Max(L::Sub(zero, regs[in->a]), regs[in->b]);
+			}
+		}
+		return regs[program.result];
+	}
+
+	template <class L>
+	static void MarchPacket(const CpuScene &scene, RayPacket &packet) {
+		typedef typename L::F F;
+		typedef typename L::M M;
+
+		for (int base = 0; base < packet.count; base += L::Count) {
+			F ox = L::Load(packet.ox + base), oy = L::Load(packet.oy + base), oz = L::Load(packet.oz + base);
+			F dx = L::Load(packet.dx + base), dy = L::Load(packet.dy + base), dz = L::Load(packet.dz + base);
+			F t = L::Set(0.0f), zero = L::Set(0.0f);
+			F eps = L::Set(0.00001f), far = L::Set(RayPacket::FarDistance);
+
+			// padding lanes past count start retired: their t stays 0 and they never hold the packet up
+			M active = L::FirstLanes(packet.count - base);
+			for (int i = 0; i < 90; i++) {
+				F k = Distance<L>(scene.program, L::Add(ox, L::Mul(dx, t)), L::Add(oy, L::Mul(dy, t)), L::Add(oz, L::Mul(dz, t)));
+				t = L::Add(t, L::Select(active, k, zero));
+
+				// retired lanes keep their t; the packet stops with its last lane
+				active = L::AndNot(active, L::Or(L::Less(L::Abs(k), eps), L::Less(far, t)));
+				if (!L::Any(active))
+					break;
+			}
+			L::Store(packet.t + base, t);
+		}
+	}
+
+	template <class L>
+	static void DistanceBatch(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n) {
+		int i = 0;
+		for (; i + L::Count <= n; i += L::Count)
+			L::Store(d + i, Distance<L>(scene.program, L::Load(x + i), L::Load(y + i), L::Load(z + i)));
+
+		// tail through a padded copy
+		if (i < n) {
+			float px[L::Count] = {}, py[L::Count] = {}, pz[L::Count] = {}, pd[L::Count];
+			for (int j = i; j < n; j++) {
+				px[j - i] = x[j]; py[j - i] = y[j]; pz[j - i] = z[j];
+			}
+			L::Store(pd, Distance<L>(scene.program, L::Load(px), L::Load(py), L::Load(pz)));
+			for (int j = i; j < n; j++)
+				d[j] = pd[j - i];
+		}
+	}
+
+}
+
+
+#endif
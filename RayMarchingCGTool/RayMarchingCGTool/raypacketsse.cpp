@@ -0,0 +1,42 @@
+#include "raypacket.hpp"
+
+// SSE2 is part of x64, no instruction set switch needed
+#include <emmintrin.h>
+
+namespace {
+
+	struct SseLanes {
+		typedef __m128 F;
+		typedef __m128 M;
+		static const int Count = 4;
+
+		static F Set(float v) { return _mm_set1_ps(v); }
+		static F Load(const float *p) { return _mm_loadu_ps(p); }
+		static void Store(float *p, F v) { _mm_storeu_ps(p, v); }
+		static F Add(F a, F b) { return _mm_add_ps(a, b); }
+		static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+		static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+		static F Min(F a, F b) { return _mm_min_ps(a, b); }
+		static F Max(F a, F b) { return _mm_max_ps(a, b); }
+		static F Sqrt(F a) { return _mm_sqrt_ps(a); }
+		static F Abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+		static M Less(F a, F b) { return _mm_cmplt_ps(a, b); }
+		static M FirstLanes(int n) { return _mm_cmplt_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_set1_ps((float)n)); }
+		static M AndNot(M a, M b) { return _mm_andnot_ps(b, a); }
+		static M Or(M a, M b) { return _mm_or_ps(a, b); }
+		static bool Any(M m) { return _mm_movemask_ps(m) != 0; }
+		static F Select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	};
+
+}
+
+#include "raypacketkernels.hpp"
+
+void MarchPacketSse(const CpuScene &scene, RayPacket &packet) {
+	RayPacketKernels::MarchPacket<SseLanes>(scene, packet);
+}
+
+void DistanceBatchSse(const CpuScene &scene, const float *x, const float *y, const float *z, float *d, int n) {
+	RayPacketKernels::DistanceBatch<SseLanes>(scene, x, y, z, d, n);
+}
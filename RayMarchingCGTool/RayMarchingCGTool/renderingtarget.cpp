@@ -12,6 +12,7 @@ const double PI = 3.141592653589793238463;
 const float rtConstants::backgroundColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 const float rtConstants::normalLineColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 const float rtConstants::normalFillColor[4] = { 0.2f, 0.4f, 0.8f, 0.5f };
+const float rtConstants::highlightFillColor[4] = { 0.9f, 0.6f, 0.1f, 0.7f };
 const std::string rtConstants::IconFontFile = std::string("msyhbd.ttf");
 
 void rtUtil::setColor(const float color[4]) {
@@ -224,6 +225,80 @@ rtArrow::~rtArrow() {
 
 
 
+rtImage &rtImage::getInstance() {
+	// singleton: only initiated in the diagramWindow context
+	assert(glfwGetCurrentContext() == DiagramWindowInfo::getInstance().window);
+	static rtImage instance;
+	return instance;
+}
+
+void rtImage::Draw(Rec position, GLuint texture, Rec uv, float zVal) {
+	const GLfloat image_data[] = {
+		// FILL
+		position.pos.x, position.pos.y, zVal,
+		position.pos.x + position.size.x, position.pos.y, zVal,
+		position.pos.x, position.pos.y + position.size.y, zVal,
+		position.pos.x + position.size.x, position.pos.y + position.size.y, zVal,
+	};
+
+	const GLfloat image_texcoord_data[] = {
+		uv.pos.x, uv.pos.y,
+		uv.pos.x + uv.size.x, uv.pos.y,
+		uv.pos.x, uv.pos.y + uv.size.y,
+		uv.pos.x + uv.size.x, uv.pos.y + uv.size.y,
+	};
+
+	// VBO
+	glBindBuffer(GL_ARRAY_BUFFER, imageVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(image_data), image_data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, imageTexCoordBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(image_texcoord_data), image_texcoord_data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// draw image
+	glActiveTexture(GL_TEXTURE0); // select 0
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindVertexArray(imageVertexArrayObject);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glUniform1i(DiagramWindowInfo::getInstance().shadertypeID, 2);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // draw quad (2 triangles)
+	glUniform1i(DiagramWindowInfo::getInstance().shadertypeID, 0);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+rtImage::rtImage() {
+	// VBO
+	glGenBuffers(1, &imageVertexBuffer);
+	glGenBuffers(1, &imageTexCoordBuffer);
+
+	// VAO
+	glGenVertexArrays(1, &imageVertexArrayObject);
+	glBindVertexArray(imageVertexArrayObject);
+	{
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, imageVertexBuffer);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0); // position
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, imageTexCoordBuffer);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0); // UV
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glBindVertexArray(0);
+}
+
+rtImage::~rtImage() {
+	glDeleteBuffers(1, &imageVertexBuffer);
+	glDeleteBuffers(1, &imageTexCoordBuffer);
+	glDeleteVertexArrays(1, &imageVertexArrayObject);
+}
+
+
+
 rtText &rtText::getInstance() {
 	// singleton: only initiated in the diagramWindow context
 	assert(glfwGetCurrentContext() == DiagramWindowInfo::getInstance().window);
@@ -33,6 +33,7 @@ public:
 	static const int ArrowAngle = 15; // half of the triangle apex angle
 	static const float normalLineColor[4]; // block border
 	static const float normalFillColor[4]; // block fill
+	static const float highlightFillColor[4]; // fill of the block picked in the display window
 	static const float backgroundColor[4]; // diagram window background
 	static const int TextFontSize = 40;
 	static const std::string IconFontFile;
@@ -87,6 +88,21 @@ private:
 	GLuint arrowVertexArrayObject;
 };
 
+class rtImage
+{
+public:
+	static rtImage &getInstance();
+	void Draw(Rec pos, GLuint texture, Rec uv, float zVal = 0.0f); // uv: the part of the RGBA texture drawn
+
+private:
+	rtImage(); // setup VAO
+	~rtImage(); // destroy VAO
+
+	GLuint imageVertexBuffer;
+	GLuint imageTexCoordBuffer;
+	GLuint imageVertexArrayObject;
+};
+
 class rtText
 {
 public:
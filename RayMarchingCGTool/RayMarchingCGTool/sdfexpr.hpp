@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef SDFEXPR_HPP
+#define SDFEXPR_HPP
+
+#include <cmath>
+
+// Header-only SDF expressions: one type per block type, a scene is a type such as
+// Difference<Sphere, Box> that the compiler inlines completely. No dependency but <cmath>,
+// so fixed scenes can be embedded anywhere. CodeGenManager::GenerateExpressionHeader() exports
+// the current BlockGraph in this form.
+// Evaluation follows the generated GLSL operation by operation (sdsphere, sdBox, opS, opSId);
+// bounds are computed at compile time.
+namespace sdf {
+
+	// axis aligned box enclosing the surface and the interior
+	struct Bounds {
+		float min[3], max[3];
+
+		constexpr Bounds(float minX, float minY, float minZ, float maxX, float maxY, float maxZ) :
+			min{ minX, minY, minZ }, max{ maxX, maxY, maxZ } {}
+		static constexpr Bounds Cube(float halfSize) { return Bounds(-halfSize, -halfSize, -halfSize, halfSize, halfSize, halfSize); }
+		constexpr bool IsEmpty() const { return min[0] > max[0] || min[1] > max[1] || min[2] > max[2]; }
+	};
+
+	// sceneId(): distance and the leaf block it comes from
+	struct Hit {
+		float distance;
+		int id;
+	};
+
+	// GLSL min / max (the second operand when the comparison fails)
+	inline float Min(float a, float b) { return b < a ? b : a; }
+	inline float Max(float a, float b) { return a < b ? b : a; }
+
+	// unconnected Screen block: scene() returns 0.0
+	struct Empty {
+		static constexpr int NodeCount = 0;
+
+		constexpr Empty() {}
+		float operator()(float, float, float) const { return 0.0f; }
+		Hit Id(float, float, float) const { return Hit{ 0.0f, -1 }; }
+		constexpr Bounds Bound() const { return Bounds(1.0f, 1.0f, 1.0f, -1.0f, -1.0f, -1.0f); }
+	};
+
+	// SphereBlock: sdsphere(p, r)
+	struct Sphere {
+		static constexpr int NodeCount = 1;
+		float r;
+		int id;
+
+		constexpr explicit Sphere(float r, int id = -1) : r(r), id(id) {}
+		float operator()(float x, float y, float z) const { return std::sqrt(x * x + y * y + z * z) - r; }
+		Hit Id(float x, float y, float z) const { return Hit{ (*this)(x, y, z), id }; }
+		constexpr Bounds Bound() const { return Bounds::Cube(r); }
+	};
+
+	// BoxBlock: sdBox(p, vec3(b))
+	struct Box {
+		static constexpr int NodeCount = 1;
+		float b;
+		int id;
+
+		constexpr explicit Box(float b, int id = -1) : b(b), id(id) {}
+		float operator()(float x, float y, float z) const {
+			float dx = std::abs(x) - b, dy = std::abs(y) - b, dz = std::abs(z) - b;
+			float inside = Min(Max(dx, Max(dy, dz)), 0.0f);
+			dx = Max(dx, 0.0f); dy = Max(dy, 0.0f); dz = Max(dz, 0.0f);
+			return inside + std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		Hit Id(float x, float y, float z) const { return Hit{ (*this)(x, y, z), id }; }
+		constexpr Bounds Bound() const { return Bounds::Cube(b); }
+	};
+
+	// BoolDifferenceBlock: opS(a, b), a carved out of b
+	template <class A, class B>
+	struct Difference {
+		static constexpr int NodeCount = A::NodeCount + B::NodeCount + 1;
+		A a;
+		B b;
+
+		constexpr Difference(const A &a, const B &b) : a(a), b(b) {}
+		float operator()(float x, float y, float z) const { return Max(-a(x, y, z), b(x, y, z)); }
+		Hit Id(float x, float y, float z) const {
+			Hit d1 = a.Id(x, y, z), d2 = b.Id(x, y, z);
+			return (-d1.distance > d2.distance) ? Hit{ -d1.distance, d1.id } : d2;
+		}
+		constexpr Bounds Bound() const { return b.Bound(); } // the carved result stays inside b
+	};
+
+	// any vector type with x, y, z members (glm::vec3 ...)
+	template <class Scene, class V>
+	inline float Distance(const Scene &scene, const V &p) { return scene(p.x, p.y, p.z); }
+
+}
+
+
+#endif
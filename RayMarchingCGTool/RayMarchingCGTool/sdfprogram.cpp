@@ -0,0 +1,185 @@
+#include "sdfprogram.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <map>
+
+#include "cpuscene.hpp"
+
+SdfProgram SdfProgram::Compile(const CpuScene &scene) {
+	SdfProgram program;
+	if (scene.IsEmpty())
+		return program;
+
+	// registers needed by each subtree (nodes come children first)
+	std::vector<int> need(scene.nodes.size(), 1);
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const CpuScene::Node &n = scene.nodes[i];
+		if (n.op == CpuScene::DIFFERENCE)
+			need[i] = need[n.a] == need[n.b] ? need[n.a] + 1 : std::max(need[n.a], need[n.b]);
+	}
+
+	// pool: one entry per distinct value
+	std::map<float, int> pool;
+	std::vector<int> constantIndices(scene.nodes.size(), -1);
+	for (size_t i = 0; i < scene.nodes.size(); i++) if (scene.nodes[i].op != CpuScene::DIFFERENCE) {
+		auto it = pool.find(scene.nodes[i].param);
+		if (it == pool.end()) {
+			it = pool.insert(std::make_pair(scene.nodes[i].param, (int)program.constants.size())).first;
+			program.constants.push_back(scene.nodes[i].param);
+		}
+		constantIndices[i] = it->second;
+	}
+
+	std::vector<int> freeRegisters;
+	program.result = program.Emit(scene, scene.root, need, freeRegisters, constantIndices);
+	return program;
+}
+
+int SdfProgram::Emit(const CpuScene &scene, int node, const std::vector<int> &need, std::vector<int> &freeRegisters, std::vector<int> &constantIndices) {
+	const CpuScene::Node &n = scene.nodes[node];
+	Instruction instruction = { 0, 0, 0, 0, -1 };
+
+	switch (n.op) {
+	case CpuScene::SPHERE:
+	case CpuScene::BOX:
+		instruction.op = (unsigned char)(n.op == CpuScene::SPHERE ? OP_SPHERE : OP_BOX);
+		instruction.constant = constantIndices[node];
+		break;
+	default: { // DIFFERENCE
+		int a, b;
+		if (need[n.a] >= need[n.b]) {
+			a = Emit(scene, n.a, need, freeRegisters, constantIndices);
+			b = Emit(scene, n.b, need, freeRegisters, constantIndices);
+		}
+		else {
+			b = Emit(scene, n.b, need, freeRegisters, constantIndices);
+			a = Emit(scene, n.a, need, freeRegisters, constantIndices);
+		}
+		instruction.op = OP_DIFFERENCE;
+		instruction.a = (unsigned char)a;
+		instruction.b = (unsigned char)b;
+		freeRegisters.push_back(b);
+		freeRegisters.push_back(a);
+	}
+	}
+
+	// the last freed register (an operand) is reused first
+	int dst;
+	if (!freeRegisters.empty()) {
+		dst = freeRegisters.back();
+		freeRegisters.pop_back();
+	}
+	else {
+		dst = numRegisters++;
+	}
+	instruction.dst = (unsigned char)dst;
+	code.push_back(instruction);
+	blockIds.push_back(n.blockId);
+	return dst;
+}
+
+// the leaf opcodes, with the arithmetic of sdSphere() and sdBox()
+static inline float EvaluateLeaf(const SdfProgram::Instruction &in, const float *c, float x, float y, float z) {
+	if (in.op == SdfProgram::OP_SPHERE)
+		return std::sqrt(x * x + y * y + z * z) - c[in.constant];
+
+	float dx = std::abs(x) - c[in.constant], dy = std::abs(y) - c[in.constant], dz = std::abs(z) - c[in.constant];
+	float inside = std::min(std::max(dx, std::max(dy, dz)), 0.0f);
+	dx = std::max(dx, 0.0f); dy = std::max(dy, 0.0f); dz = std::max(dz, 0.0f);
+	return inside + std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+float SdfProgram::Evaluate(const glm::vec3 &p) const {
+	if (code.empty())
+		return 0.0f;
+
+	float regs[MaxRegisters];
+	const float *c = constants.empty() ? NULL : &constants[0];
+	for (auto in = code.begin(); in != code.end(); ++in) {
+		if (in->op == OP_DIFFERENCE)
+			regs[in->dst] = std::max(-regs[in->a], regs[in->b]);
+		else
+			regs[in->dst] = EvaluateLeaf(*in, c, p.x, p.y, p.z);
+	}
+	return regs[result];
+}
+
+glm::vec2 SdfProgram::EvaluateId(const glm::vec3 &p) const {
+	if (code.empty())
+		return glm::vec2(0.0f, -1.0f);
+
+	// opSId(): the id follows the operand the difference returns
+	float regs[MaxRegisters];
+	int ids[MaxRegisters];
+	const float *c = constants.empty() ? NULL : &constants[0];
+	for (size_t i = 0; i < code.size(); i++) {
+		const Instruction &in = code[i];
+		if (in.op != OP_DIFFERENCE) {
+			regs[in.dst] = EvaluateLeaf(in, c, p.x, p.y, p.z);
+			ids[in.dst] = blockIds[i];
+		}
+		else if (-regs[in.a] > regs[in.b]) {
+			regs[in.dst] = -regs[in.a];
+			ids[in.dst] = ids[in.a];
+		}
+		else {
+			regs[in.dst] = regs[in.b];
+			ids[in.dst] = ids[in.b];
+		}
+	}
+	return glm::vec2(regs[result], (float)ids[result]);
+}
+
+glm::vec2 SdfProgram::EvaluateInterval(const glm::vec3 &min, const glm::vec3 &max) const {
+	if (code.empty())
+		return glm::vec2(0.0f);
+
+	// |p| per axis lies in [closest, farthest] over the box; sdSphere() and sdBox() are non-decreasing
+	// in every |p| component, so the leaf bounds are their values at both ends
+	glm::vec3 closest = glm::max(glm::max(min, -max), glm::vec3(0.0f));
+	glm::vec3 farthest = glm::max(glm::abs(min), glm::abs(max));
+	float lo[MaxRegisters], hi[MaxRegisters];
+	const float *c = constants.empty() ? NULL : &constants[0];
+	for (auto in = code.begin(); in != code.end(); ++in) {
+		if (in->op == OP_DIFFERENCE) {
+			// max(-a, b): negation swaps the bounds of a, max is monotonic
+			float l = std::max(-hi[in->a], lo[in->b]), h = std::max(-lo[in->a], hi[in->b]);
+			lo[in->dst] = l;
+			hi[in->dst] = h;
+		}
+		else {
+			lo[in->dst] = EvaluateLeaf(*in, c, closest.x, closest.y, closest.z);
+			hi[in->dst] = EvaluateLeaf(*in, c, farthest.x, farthest.y, farthest.z);
+		}
+	}
+	return glm::vec2(lo[result], hi[result]);
+}
+
+void SdfProgram::Evaluate(const float *x, const float *y, const float *z, float *d, int n) const {
+	if (code.empty()) {
+		std::fill(d, d + n, 0.0f);
+		return;
+	}
+
+	// one instruction over BatchSize points at a time: decoding is amortized and the inner loops vectorize
+	float regs[MaxRegisters][BatchSize];
+	const float *c = constants.empty() ? NULL : &constants[0];
+	for (int base = 0; base < n; base += BatchSize) {
+		int count = std::min(BatchSize, n - base);
+		const float *px = x + base, *py = y + base, *pz = z + base;
+		for (auto in = code.begin(); in != code.end(); ++in) {
+			float *dst = regs[in->dst];
+			if (in->op == OP_DIFFERENCE) {
+				const float *a = regs[in->a], *b = regs[in->b];
+				for (int i = 0; i < count; i++)
+					dst[i] = std::max(-a[i], b[i]);
+			}
+			else {
+				for (int i = 0; i < count; i++)
+					dst[i] = EvaluateLeaf(*in, c, px[i], py[i], pz[i]);
+			}
+		}
+		std::copy(regs[result], regs[result] + count, d + base);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef SDFPROGRAM_HPP
+#define SDFPROGRAM_HPP
+
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+class CpuScene;
+
+// Flat register bytecode of a CpuScene, the single evaluation engine of the CPU consumers
+// (CpuScene, the ray packet kernels, batch queries). Instructions are in topological order,
+// refer to registers and pooled constants by index, and the interpreter is a switch loop.
+class SdfProgram {
+
+public:
+	enum Opcode { OP_SPHERE, OP_BOX, OP_DIFFERENCE };
+
+	struct Instruction {
+		unsigned char op;
+		unsigned char dst; // register written
+		unsigned char a, b; // OP_DIFFERENCE: registers read, a is carved out of b
+		int constant; // OP_SPHERE, OP_BOX: index in constants (radius, half size)
+	};
+
+	// children are emitted larger register need first (Sethi-Ullman):
+	// 32 registers hold any graph of less than 2^31 leaves
+	static const int MaxRegisters = 32;
+	static const int BatchSize = 64; // points per interpreter pass of Evaluate(x, y, z, d, n)
+
+	SdfProgram() : numRegisters(0), result(0) {}
+
+	static SdfProgram Compile(const CpuScene &scene);
+	bool IsEmpty() const { return code.empty(); }
+
+	float Evaluate(const glm::vec3 &p) const; // scene(), 0 when empty
+	glm::vec2 EvaluateId(const glm::vec3 &p) const; // sceneId(), (0, -1) when empty
+	void Evaluate(const float *x, const float *y, const float *z, float *d, int n) const; // scene() at n points (SoA)
+	glm::vec2 EvaluateInterval(const glm::vec3 &min, const glm::vec3 &max) const; // bounds of scene() over a box, (0, 0) when empty
+
+	std::vector<Instruction> code;
+	std::vector<float> constants;
+	std::vector<int> blockIds; // per instruction: the leaf block sceneId() returns
+	int numRegisters;
+	int result; // register holding scene() after the last instruction
+
+private:
+	int Emit(const CpuScene &scene, int node, const std::vector<int> &need, std::vector<int> &freeRegisters, std::vector<int> &constantIndices);
+};
+
+
+#endif
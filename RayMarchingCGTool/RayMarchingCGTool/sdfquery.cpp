@@ -0,0 +1,153 @@
+#include "sdfquery.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+// 1e-3: the float cancellation of the differences stays below 1e-4 of the gradient
+const float SdfQuery::GradientStep = 0.001f;
+const float SdfQuery::HitDistance = 0.01f;
+
+SdfQuery::SdfQuery(int numThreads) : pool(numThreads), engine(SIMD), simdLevel(DetectSimdLevel()) {
+	scratch.assign(std::max(pool.NumThreads(), 1), std::vector<float>(6 * ChunkSize));
+}
+
+void SdfQuery::BuildFromGraph(bool native) {
+	scene = CpuScene::FromGraph();
+	this->native.Unload();
+	if (native)
+		this->native.BuildFromGraph();
+	SetEngine(native ? NATIVE : SIMD);
+}
+
+void SdfQuery::SetEngine(Engine engine) {
+	this->engine = (engine == NATIVE && !native.IsNative()) ? SIMD : engine;
+}
+
+void SdfQuery::Evaluate(const glm::vec3 *points, int n, float *distances, glm::vec3 *gradients) {
+	if (n <= 0)
+		return;
+	pool.Run((n + ChunkSize - 1) / ChunkSize, [=](int chunk, int worker) {
+		int first = chunk * ChunkSize;
+		EvaluateChunk(scratch[worker], points + first, std::min(ChunkSize, n - first), distances + first, gradients ? gradients + first : NULL);
+	});
+}
+
+void SdfQuery::RayCast(const glm::vec3 *origins, const glm::vec3 *directions, int n, RayHit *hits) {
+	if (n <= 0)
+		return;
+	pool.Run((n + RayChunkSize - 1) / RayChunkSize, [=](int chunk, int) {
+		int first = chunk * RayChunkSize;
+		RayCastChunk(origins + first, directions + first, std::min(RayChunkSize, n - first), hits + first);
+	});
+}
+
+void SdfQuery::EvaluateChunk(std::vector<float> &scratch, const glm::vec3 *p, int count, float *distances, glm::vec3 *gradients) const {
+	float *x = &scratch[0], *y = x + ChunkSize, *z = y + ChunkSize;
+	for (int i = 0; i < count; i++) {
+		x[i] = p[i].x; y[i] = p[i].y; z[i] = p[i].z;
+	}
+	EvaluateBatch(x, y, z, distances, count);
+	if (!gradients)
+		return;
+
+	// one axis at a time: the other two coordinates stay in place
+	float *offset = z + ChunkSize, *minus = offset + ChunkSize, *plus = minus + ChunkSize;
+	glm::vec3 *g = gradients;
+	for (int axis = 0; axis < 3; axis++) {
+		float *coords[3] = { x, y, z };
+		const float *original = coords[axis];
+		coords[axis] = offset;
+		for (int i = 0; i < count; i++)
+			offset[i] = original[i] - GradientStep;
+		EvaluateBatch(coords[0], coords[1], coords[2], minus, count);
+		for (int i = 0; i < count; i++)
+			offset[i] = original[i] + GradientStep;
+		EvaluateBatch(coords[0], coords[1], coords[2], plus, count);
+		for (int i = 0; i < count; i++)
+			g[i][axis] = (plus[i] - minus[i]) * (0.5f / GradientStep);
+	}
+}
+
+void SdfQuery::RayCastChunk(const glm::vec3 *origins, const glm::vec3 *directions, int count, RayHit *hits) const {
+	SimdLevel level = engine == INTERPRETER ? SIMD_NONE : simdLevel;
+	RayPacket packet;
+	for (int base = 0; base < count; base += RayPacket::Size) {
+		packet.count = std::min(RayPacket::Size, count - base);
+		for (int lane = 0; lane < packet.count; lane++)
+			packet.SetRay(lane, origins[base + lane], directions[base + lane]);
+		MarchPacket(level, scene, packet);
+
+		for (int lane = 0; lane < packet.count; lane++) {
+			RayHit &hit = hits[base + lane];
+			hit.t = packet.t[lane];
+			hit.position = origins[base + lane] + directions[base + lane] * hit.t;
+			glm::vec2 d = scene.DistanceId(hit.position);
+			if (!scene.IsEmpty() && hit.t < RayPacket::FarDistance && std::abs(d.x) < HitDistance) {
+				hit.normal = scene.Normal(hit.position);
+				hit.blockId = (int)d.y;
+			}
+			else {
+				hit.normal = glm::vec3(0.0f);
+				hit.blockId = -1;
+			}
+		}
+	}
+}
+
+void SdfQuery::EvaluateBatch(const float *x, const float *y, const float *z, float *d, int n) const {
+	switch (engine) {
+	case NATIVE: native.Evaluate(x, y, z, d, n); break;
+	case SIMD: DistanceBatch(simdLevel, scene, x, y, z, d, n); break;
+	default: scene.program.Evaluate(x, y, z, d, n);
+	}
+}
+
+void SdfQuery::Benchmark(int numPoints, int maxThreads) {
+	if (maxThreads <= 0)
+		maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// uniform in the box the default camera looks at
+	std::vector<glm::vec3> points(numPoints);
+	srand(1);
+	for (int i = 0; i < numPoints; i++)
+		points[i] = glm::vec3((float)rand(), (float)rand(), (float)rand()) * (4.0f / RAND_MAX) - 2.0f;
+	std::vector<float> distances(numPoints);
+	std::vector<glm::vec3> gradients(numPoints);
+
+	std::vector<int> threadCounts;
+	for (int numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+		threadCounts.push_back(numThreads);
+	threadCounts.push_back(maxThreads);
+
+	SdfQuery query(maxThreads);
+	query.BuildFromGraph(true);
+	printf("SDF queries, %d points, %d nodes, chunks of %d, %s packets%s\n", numPoints, (int)query.scene.nodes.size(), ChunkSize,
+		SimdLevelName(query.simdLevel), query.native.IsNative() ? "" : ", no native library");
+	printf("engine       threads  Mpoint/s  Mpoint/s with gradients\n");
+
+	static const char *engineNames[] = { "interpreter", "simd", "native" };
+	for (int engine = INTERPRETER; engine <= NATIVE; engine++) {
+		if (engine == NATIVE && !query.native.IsNative())
+			continue;
+		for (auto it = threadCounts.begin(); it != threadCounts.end(); ++it) {
+			SdfQuery pool(*it);
+			pool.scene = query.scene;
+			if (engine == NATIVE)
+				pool.native.BuildFromGraph(); // cached: loads the same library
+			pool.SetEngine((Engine)engine);
+
+			double ms[2];
+			for (int withGradients = 0; withGradients < 2; withGradients++) {
+				auto startTime = std::chrono::high_resolution_clock::now();
+				pool.Evaluate(&points[0], numPoints, &distances[0], withGradients ? &gradients[0] : NULL);
+				ms[withGradients] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+			}
+			printf("%-11s  %7d  %8.1f  %8.1f\n", engineNames[engine], pool.NumThreads(), numPoints / (ms[0] * 1000.0), numPoints / (ms[1] * 1000.0));
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef SDFQUERY_HPP
+#define SDFQUERY_HPP
+
+#include <vector>
+#include "cpuscene.hpp"
+#include "nativescene.hpp"
+#include "raypacket.hpp"
+#include "workerpool.hpp"
+
+// Result of a ray cast: a hit is a surface point closer than RayPacket::FarDistance (the fog)
+struct RayHit {
+	float t; // marched distance, also for misses
+	glm::vec3 position;
+	glm::vec3 normal; // norm() at position; zero for misses
+	int blockId; // leaf block sceneId() returns (-1: no hit)
+};
+
+// Bulk distance (and gradient) queries and ray casts on a snapshot of the BlockGraph, for collision,
+// placement, point cloud or visibility tools. The input is cut into chunks for the workers of a
+// WorkerPool; a chunk of points is converted to SoA in the worker's scratch and evaluated in one
+// batch call, a chunk of rays is marched in RayPackets.
+class SdfQuery {
+
+public:
+	enum Engine { INTERPRETER, SIMD, NATIVE }; // SdfProgram, ray packet kernels, NativeScene
+
+	static const int ChunkSize = 4096; // the 6 SoA arrays of a chunk fit in L2
+	static const int RayChunkSize = 64; // rays cost ~100 distances: small chunks keep the workers balanced
+	static const float GradientStep; // central differences
+	static const float HitDistance; // |scene()| below which a march converged on a surface (as the G-buffer)
+
+	explicit SdfQuery(int numThreads); // 0: one per core
+
+	// main thread (owner of the BlockGraph); native: also build the C++ backend (NATIVE when it loads, else SIMD)
+	void BuildFromGraph(bool native);
+	void SetEngine(Engine engine); // NATIVE falls back to SIMD without library
+	Engine GetEngine() const { return engine; }
+	int NumThreads() const { return pool.NumThreads(); }
+
+	// distances[i] = scene(points[i]); gradients (may be NULL): unnormalized gradient of scene()
+	void Evaluate(const glm::vec3 *points, int n, float *distances, glm::vec3 *gradients);
+
+	// march() along each ray (normalized directions); the engine only picks the packet kernels (INTERPRETER: scalar)
+	void RayCast(const glm::vec3 *origins, const glm::vec3 *directions, int n, RayHit *hits);
+
+	// points per second of every engine from 1 to maxThreads threads (0: one per core), printed as a table
+	static void Benchmark(int numPoints, int maxThreads);
+
+	CpuScene scene;
+	NativeScene native;
+
+private:
+	void EvaluateChunk(std::vector<float> &scratch, const glm::vec3 *points, int count, float *distances, glm::vec3 *gradients) const;
+	void RayCastChunk(const glm::vec3 *origins, const glm::vec3 *directions, int count, RayHit *hits) const;
+	void EvaluateBatch(const float *x, const float *y, const float *z, float *d, int n) const;
+
+	WorkerPool pool;
+	std::vector<std::vector<float> > scratch; // per worker: x, y, z, then the offset coordinate and the two distances of the gradients
+	Engine engine;
+	SimdLevel simdLevel;
+};
+
+
+#endif
@@ -2,6 +2,7 @@
 #define SHADER_HPP
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+GLuint LoadComputeShader(const char * compute_file_path); // GL 4.3
 
 
 #endif
@@ -0,0 +1,278 @@
+#include "sliceview.hpp"
+
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+const float SliceView::GradientStep = 1e-3f;
+
+glm::vec3 SlicePlane::Point(glm::vec2 pixel, int width, int height) const {
+	glm::vec2 uv = center + (pixel - 0.5f * glm::vec2((float)width, (float)height)) * pixelSize;
+	if (axis == 0) return glm::vec3(offset, uv.x, uv.y);
+	if (axis == 1) return glm::vec3(uv.x, offset, uv.y);
+	return glm::vec3(uv.x, uv.y, offset);
+}
+
+SliceView::SliceView() : simdLevel(DetectSimdLevel()), colorMode(DISTANCE), workers(NULL), stopping(false), requestedColorMode(DISTANCE),
+	restart(true), cell(CoarsestCell), nextRow(0), pendingRows(0)
+{
+	mtx_init(&mutex, mtx_plain);
+}
+
+SliceView::~SliceView() {
+	Stop();
+	mtx_destroy(&mutex);
+}
+
+void SliceView::SetScene(const CpuScene &scene) {
+	mtx_lock(&mutex);
+	this->scene = scene;
+	restart = true;
+	mtx_unlock(&mutex);
+}
+
+void SliceView::SetPlane(const SlicePlane &plane) {
+	mtx_lock(&mutex);
+	this->plane = plane;
+	restart = true;
+	mtx_unlock(&mutex);
+}
+
+SlicePlane SliceView::GetPlane() {
+	mtx_lock(&mutex);
+	SlicePlane result = plane;
+	mtx_unlock(&mutex);
+	return result;
+}
+
+void SliceView::SetColorMode(ColorMode mode) {
+	mtx_lock(&mutex);
+	requestedColorMode = mode;
+	mtx_unlock(&mutex);
+}
+
+SliceView::ColorMode SliceView::GetColorMode() {
+	mtx_lock(&mutex);
+	ColorMode result = requestedColorMode;
+	mtx_unlock(&mutex);
+	return result;
+}
+
+void SliceView::Stop() {
+	mtx_lock(&mutex);
+	stopping = true;
+	mtx_unlock(&mutex);
+	// the tasks left return at once
+	delete workers;
+	workers = NULL;
+
+	// may be started again
+	mtx_lock(&mutex);
+	stopping = false;
+	current.reset();
+	finished.clear();
+	restart = true;
+	mtx_unlock(&mutex);
+}
+
+void SliceView::Destroy() {
+	Stop();
+	target.Destroy();
+}
+
+void SliceView::Restart(int width, int height) {
+	restart = false;
+	finished.clear();
+	cell = CoarsestCell;
+	nextRow = 0;
+	pendingRows = 0;
+	current.reset();
+	if (scene.IsEmpty())
+		return;
+
+	std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+	frame->scene = scene;
+	frame->plane = plane;
+	frame->width = width;
+	frame->height = height;
+	current = frame;
+	PostRows();
+}
+
+void SliceView::PostRows() {
+	for (int i = 0; i < std::max(1, workers->NumThreads()); i++)
+		workers->Post([this](int worker) { EvaluateRows(worker); });
+}
+
+void SliceView::Draw(int screenWidth, int screenHeight) {
+	if (screenWidth <= 0 || screenHeight <= 0)
+		return;
+
+	bool resized = !target.Matches(screenWidth, screenHeight);
+	if (resized) {
+		target.Setup(screenWidth, screenHeight);
+		values.assign((size_t)screenWidth * screenHeight, glm::vec2(0.0f));
+		pixels.assign((size_t)screenWidth * screenHeight * 4, 0);
+	}
+	if (!workers) {
+		// leave a core to the rendering thread
+		workers = new WorkerPool(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+		scratch.resize(std::max(1, workers->NumThreads()));
+	}
+
+	std::deque<Row> rows;
+	bool recolor = resized;
+	mtx_lock(&mutex);
+	if (restart || resized) {
+		// the previous image stays until the first level covers it
+		Restart(screenWidth, screenHeight);
+		shownPlane = plane;
+		if (!current) {
+			values.assign(values.size(), glm::vec2(0.0f));
+			recolor = true;
+		}
+	}
+	if (requestedColorMode != colorMode) {
+		colorMode = requestedColorMode;
+		recolor = true;
+	}
+	rows.swap(finished);
+	mtx_unlock(&mutex);
+
+	// spread the new samples over their cells, then recolor the rows they cover
+	int firstRow = recolor ? 0 : screenHeight, lastRow = recolor ? screenHeight - 1 : -1;
+	for (auto it = rows.begin(); it != rows.end(); ++it) {
+		Apply(*it);
+		firstRow = std::min(firstRow, it->y);
+		lastRow = std::max(lastRow, std::min(it->y + it->cell, screenHeight) - 1);
+		if (it->last)
+			PrintStats();
+	}
+	if (firstRow <= lastRow) {
+		Colorize(firstRow, lastRow);
+		glBindTexture(GL_TEXTURE_2D, target.textures[0]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, target.Width, lastRow - firstRow + 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[(size_t)firstRow * target.Width * 4]);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	target.BlitToScreen(screenWidth, screenHeight, GL_NEAREST);
+}
+
+void SliceView::EvaluateRows(int worker) {
+	mtx_lock(&mutex);
+	// a level is handed out once the previous one is finished: its rows come first in finished
+	while (!stopping && current && nextRow * cell < current->height) {
+		std::shared_ptr<const Frame> frame = current;
+		Row row;
+		row.cell = cell;
+		row.y = nextRow++ * cell;
+		row.last = false;
+		// the first level samples every cell, the next ones skip the samples of the previous level
+		bool firstLevel = cell == CoarsestCell;
+		row.firstX = (!firstLevel && row.y % (2 * cell) == 0) ? cell : 0;
+		row.stepX = (!firstLevel && row.y % (2 * cell) == 0) ? 2 * cell : cell;
+		pendingRows++;
+		mtx_unlock(&mutex);
+
+		Evaluate(*frame, row, scratch[worker]);
+
+		mtx_lock(&mutex);
+		// stale: the plane moved meanwhile
+		if (frame != current)
+			continue;
+		pendingRows--;
+		if (nextRow * cell >= frame->height && pendingRows == 0) {
+			if (cell > 1) {
+				cell /= 2;
+				nextRow = 0;
+				PostRows();
+			}
+			else row.last = true;
+		}
+		finished.push_back(std::move(row));
+	}
+	mtx_unlock(&mutex);
+}
+
+void SliceView::Evaluate(const Frame &frame, Row &row, std::vector<float> &scratch) const {
+	int n = std::max(0, (frame.width - row.firstX + row.stepX - 1) / row.stepX);
+	row.samples.resize(n);
+	if (n == 0)
+		return;
+
+	// the sample and the four tetrahedron points around it, one batch
+	int m = 5 * n;
+	scratch.resize(4 * (size_t)m);
+	float *x = &scratch[0], *y = x + m, *z = y + m, *d = z + m;
+	for (int i = 0; i < n; i++) {
+		glm::vec3 p = frame.plane.Point(glm::vec2(row.firstX + i * row.stepX + 0.5f, row.y + 0.5f), frame.width, frame.height);
+		for (int k = 0; k < 5; k++) {
+			glm::vec3 q = k ? p + GradientStep * CpuScene::Tetrahedron[k - 1] : p;
+			x[k * n + i] = q.x;
+			y[k * n + i] = q.y;
+			z[k * n + i] = q.z;
+		}
+	}
+	DistanceBatch(simdLevel, frame.scene, x, y, z, d, m);
+
+	for (int i = 0; i < n; i++)
+		row.samples[i] = glm::vec2(d[i], glm::length(CpuScene::TetrahedronGradient(d + n + i, n, GradientStep)));
+}
+
+void SliceView::Apply(const Row &row) {
+	int w = target.Width, h = target.Height;
+	int y1 = std::min(row.y + row.cell, h);
+	for (size_t i = 0; i < row.samples.size(); i++) {
+		int x0 = row.firstX + (int)i * row.stepX, x1 = std::min(x0 + row.cell, w);
+		for (int y = row.y; y < y1; y++)
+			std::fill(&values[(size_t)y * w + x0], &values[(size_t)y * w + x1], row.samples[i]);
+	}
+}
+
+void SliceView::Colorize(int firstRow, int lastRow) {
+	// iso-distance bands 10^k world units apart, 8 to 80 pixels on screen
+	float pixelSize = shownPlane.pixelSize;
+	float spacing = std::pow(10.0f, std::ceil(std::log10(8.0f * pixelSize)));
+	const float twoPi = 6.2831853f;
+
+	for (size_t i = (size_t)firstRow * target.Width; i < (size_t)(lastRow + 1) * target.Width; i++) {
+		float d = values[i].x, g = values[i].y;
+		glm::vec3 col;
+		if (colorMode == DISTANCE) {
+			// outside warm, inside cold, darker close to the surface
+			col = d > 0.0f ? glm::vec3(0.9f, 0.6f, 0.3f) : glm::vec3(0.65f, 0.85f, 1.0f);
+			col *= 1.0f - 0.6f * std::exp(-std::abs(d) / spacing);
+			col *= 0.8f + 0.2f * std::cos(twoPi * d / spacing);
+		}
+		else {
+			// exact distance green, conservative bound blue, overestimate (overshooting march) red
+			float t = glm::clamp((g - 1.0f) * 2.0f, -1.0f, 1.0f);
+			col = t > 0.0f ? glm::mix(glm::vec3(0.2f, 0.7f, 0.3f), glm::vec3(1.0f, 0.1f, 0.1f), t) : glm::mix(glm::vec3(0.2f, 0.7f, 0.3f), glm::vec3(0.2f, 0.3f, 1.0f), -t);
+			col *= 0.85f + 0.15f * std::cos(twoPi * d / spacing);
+		}
+		// the surface, a pixel wide: d / |grad d| is the distance to the zero contour
+		if (std::abs(d) < pixelSize * std::max(g, 1e-3f))
+			col = glm::vec3(1.0f);
+
+		pixels[i * 4 + 0] = (unsigned char)(glm::clamp(col.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+		pixels[i * 4 + 1] = (unsigned char)(glm::clamp(col.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+		pixels[i * 4 + 2] = (unsigned char)(glm::clamp(col.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+		pixels[i * 4 + 3] = 255;
+	}
+}
+
+void SliceView::PrintStats() const {
+	if (values.empty())
+		return;
+	glm::vec2 lo = values[0], hi = values[0];
+	size_t over = 0;
+	for (auto it = values.begin(); it != values.end(); ++it) {
+		lo = glm::min(lo, *it);
+		hi = glm::max(hi, *it);
+		over += it->y > 1.01f;
+	}
+	static const char axisNames[3] = { 'x', 'y', 'z' };
+	printf("Slice %c = %.4f: distance in [%g, %g], gradient magnitude in [%.3f, %.3f], above 1.01 on %.2f%% of the pixels\n",
+		axisNames[shownPlane.axis], shownPlane.offset, lo.x, hi.x, lo.y, hi.y, 100.0 * over / values.size());
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#ifndef SLICEVIEW_HPP
+#define SLICEVIEW_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include "tinythread.hpp"
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+#include "raypacket.hpp"
+#include "offscreentarget.hpp"
+#include "workerpool.hpp"
+
+// Axis aligned plane through the scene, as seen in the display window
+struct SlicePlane {
+	int axis; // of the normal: 0 x, 1 y, 2 z (screen x and y are the other two, in order)
+	float offset; // along the normal
+	glm::vec2 center; // plane coordinates at the center of the window
+	float pixelSize; // world units per pixel
+
+	SlicePlane() : axis(2), offset(0.0f), center(0.0f), pixelSize(0.005f) {}
+	glm::vec3 Point(glm::vec2 pixel, int width, int height) const; // pixel: from the bottom-left corner
+};
+
+// Cross-section of the distance field, evaluated on the CPU by a WorkerPool. The image is refined
+// coarse to fine: one sample per CoarsestCell^2 pixels first, then each level samples the centers
+// left by the previous one (a quadtree level), so a new plane shows at once and sharpens. Moving
+// the plane or changing the scene starts over; the rows of the previous plane are discarded.
+// Each sample keeps its distance and gradient magnitude, the colors are computed on the GL thread.
+class SliceView {
+
+public:
+	enum ColorMode { DISTANCE, GRADIENT };
+	static const int CoarsestCell = 16; // pixels per sample edge of the first level
+	static const float GradientStep; // of the tetrahedral gradient, world units
+
+	SliceView();
+	~SliceView();
+
+	// any thread: the refinement restarts at the next Draw
+	void SetScene(const CpuScene &scene);
+	void SetPlane(const SlicePlane &plane);
+	SlicePlane GetPlane();
+	void SetColorMode(ColorMode mode);
+	ColorMode GetColorMode();
+
+	// GL thread
+	void Draw(int screenWidth, int screenHeight); // apply the rows finished so far, scale to the screen
+	void Destroy(); // stop and release the image
+	bool IsActive() const { return workers != NULL; } // from the first Draw to Stop
+
+	// any thread
+	void Stop(); // cancel & join the workers
+
+private:
+	// one plane of one scene at one size: the unit of cancellation
+	struct Frame {
+		CpuScene scene;
+		SlicePlane plane;
+		int width, height;
+	};
+	// samples of one row of cells of a level
+	struct Row {
+		int cell; // pixels per sample edge
+		int y, firstX, stepX; // sample i is at pixel (firstX + i * stepX, y)
+		std::vector<glm::vec2> samples; // distance, gradient magnitude
+		bool last; // the image is complete
+	};
+
+	void PostRows(); // mutex held: one task per worker, each evaluates rows while the level has some
+	void EvaluateRows(int worker);
+	void Evaluate(const Frame &frame, Row &row, std::vector<float> &scratch) const;
+	void Restart(int width, int height); // mutex held
+	void Apply(const Row &row); // GL thread
+	void Colorize(int firstRow, int lastRow); // GL thread
+	void PrintStats() const;
+
+	SimdLevel simdLevel;
+	OffscreenTarget target;
+
+	// GL thread: the samples spread over their cells, and their colors (rows bottom-up as the texture)
+	std::vector<glm::vec2> values;
+	std::vector<unsigned char> pixels;
+	ColorMode colorMode;
+	SlicePlane shownPlane;
+
+	WorkerPool *workers;
+	std::vector<std::vector<float> > scratch; // per worker
+
+	// guarded by mutex
+	mtx_t mutex;
+	bool stopping;
+	CpuScene scene;
+	SlicePlane plane;
+	ColorMode requestedColorMode;
+	bool restart;
+	std::shared_ptr<const Frame> current; // NULL: nothing to evaluate
+	int cell; // of the level being handed out
+	int nextRow, pendingRows; // rows of cells of that level: next one, handed out but not finished
+	std::deque<Row> finished; // in level order, until applied
+};
+
+
+#endif
@@ -0,0 +1,39 @@
+#include "surfaceoctree.hpp"
+
+const float SurfaceOctree::Tolerance = 1e-5f;
+
+void SurfaceOctree::Collect(const glm::ivec3 &first, const glm::ivec3 &size, std::vector<Leaf> &leaves) {
+	stats.cells += (long long)size.x * size.y * size.z;
+	Subdivide(first, size, leaves);
+}
+
+void SurfaceOctree::Subdivide(const glm::ivec3 &first, const glm::ivec3 &size, std::vector<Leaf> &leaves) {
+	stats.intervals++;
+	glm::vec2 range = scene.DistanceInterval(origin + glm::vec3(first) * cellSize, origin + glm::vec3(first + size) * cellSize);
+	if (range.x > Tolerance || range.y < -Tolerance)
+		return;
+
+	if (size.x <= LeafCells && size.y <= LeafCells && size.z <= LeafCells) {
+		Leaf leaf = { first, size };
+		leaves.push_back(leaf);
+		stats.leafCells += (long long)size.x * size.y * size.z;
+		return;
+	}
+
+	// halves rounded up to whole leaves, axes already at leaf size are not split
+	glm::ivec3 half;
+	for (int i = 0; i < 3; i++)
+		half[i] = size[i] <= LeafCells ? size[i] : ((size[i] + 1) / 2 + LeafCells - 1) / LeafCells * LeafCells;
+	for (int child = 0; child < 8; child++) {
+		glm::ivec3 childFirst = first, childSize = half;
+		bool valid = true;
+		for (int i = 0; i < 3; i++)
+			if (child >> i & 1) {
+				childFirst[i] += half[i];
+				childSize[i] = size[i] - half[i];
+				valid = valid && childSize[i] > 0;
+			}
+		if (valid)
+			Subdivide(childFirst, childSize, leaves);
+	}
+}
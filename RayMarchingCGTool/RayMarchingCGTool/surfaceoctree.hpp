@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef SURFACEOCTREE_HPP
+#define SURFACEOCTREE_HPP
+
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+
+// Interval octree over a region of grid cells: a box whose distance interval (CpuScene::DistanceInterval)
+// excludes 0 is entirely empty or entirely full and is dropped whole. What remains are the leaves,
+// boxes of at most LeafCells^3 cells the surface may cross, the only cells a consumer needs to sample.
+class SurfaceOctree {
+
+public:
+	static const int LeafCells = 4; // cells per leaf edge
+	static const float Tolerance; // intervals reaching this close to 0 are kept (rounding of the float bounds)
+
+	struct Leaf {
+		glm::ivec3 first, size; // cells
+	};
+
+	struct Stats {
+		long long intervals; // boxes bounded
+		long long cells; // cells of the regions
+		long long leafCells; // cells of the leaves
+	};
+
+	// cell (i, j, k) spans origin + [i, i + 1] * cellSize
+	SurfaceOctree(const CpuScene &scene, const glm::vec3 &origin, float cellSize) :
+		scene(scene), origin(origin), cellSize(cellSize) { stats = Stats(); }
+
+	// appends the leaves of the cells [first, first + size) to leaves
+	void Collect(const glm::ivec3 &first, const glm::ivec3 &size, std::vector<Leaf> &leaves);
+
+	Stats stats; // accumulated over every Collect()
+
+private:
+	void Subdivide(const glm::ivec3 &first, const glm::ivec3 &size, std::vector<Leaf> &leaves);
+
+	const CpuScene &scene;
+	glm::vec3 origin;
+	float cellSize;
+};
+
+
+#endif
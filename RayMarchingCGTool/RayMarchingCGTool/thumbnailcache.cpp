@@ -0,0 +1,184 @@
+#include "thumbnailcache.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "block.hpp"
+#include "brickmap.hpp"
+#include "renderingtarget.hpp"
+
+ThumbnailCache::ThumbnailCache() : slotKeys(AtlasSlots * AtlasSlots), redraw(0), atlas(0), stopping(false), workers(NULL) {
+	mtx_init(&mutex, mtx_plain);
+}
+
+ThumbnailCache::~ThumbnailCache() {
+	Stop();
+	mtx_destroy(&mutex);
+}
+
+void ThumbnailCache::Stop() {
+	mtx_lock(&mutex);
+	stopping = true;
+	jobs.clear();
+	mtx_unlock(&mutex);
+	// the tasks left find no job
+	delete workers;
+	workers = NULL;
+}
+
+bool ThumbnailCache::UploadFinished() {
+	std::vector<Result> finished;
+	mtx_lock(&mutex);
+	finished.swap(results);
+	mtx_unlock(&mutex);
+	if (finished.empty())
+		return false;
+
+	if (!atlas) {
+		int size = AtlasSlots * ThumbnailSize;
+		glGenTextures(1, &atlas);
+		glBindTexture(GL_TEXTURE_2D, atlas);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	bool uploaded = false;
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	for (auto it = finished.begin(); it != finished.end(); ++it) {
+		// dropped while rendering
+		auto entry = entries.find(it->key);
+		if (entry == entries.end() || entry->second.slot >= 0)
+			continue;
+		// no room: the image is dropped with its entry, the block asks again when drawn
+		int slot = AllocateSlot();
+		if (slot < 0) {
+			entries.erase(entry);
+			continue;
+		}
+		entry->second.slot = slot;
+		slotKeys[slot] = it->key;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, slot % AtlasSlots * ThumbnailSize, slot / AtlasSlots * ThumbnailSize,
+			ThumbnailSize, ThumbnailSize, GL_RGBA, GL_UNSIGNED_BYTE, &it->pixels[0]);
+		uploaded = true;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return uploaded;
+}
+
+int ThumbnailCache::AllocateSlot() {
+	int oldest = -1;
+	for (int slot = 0; slot < (int)slotKeys.size(); slot++) {
+		if (slotKeys[slot].empty())
+			return slot;
+		unsigned lastDrawn = entries[slotKeys[slot]].lastDrawn;
+		if (lastDrawn != redraw && (oldest < 0 || lastDrawn < entries[slotKeys[oldest]].lastDrawn))
+			oldest = slot;
+	}
+	// least recently drawn: a block edited since, or scrolled out of the diagram
+	if (oldest >= 0) {
+		entries.erase(slotKeys[oldest]);
+		slotKeys[oldest].clear();
+	}
+	return oldest;
+}
+
+void ThumbnailCache::BeginRedraw() {
+	redraw++;
+}
+
+bool ThumbnailCache::Draw(Block *block, Rec area) {
+	CpuScene scene;
+	scene.root = block->BuildCpuNode(scene);
+	if (scene.root < 0)
+		return false;
+
+	std::string key = BrickMap::SceneKey(scene, ThumbnailSize);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		Entry &entry = entries[key];
+		entry.slot = -1;
+		entry.lastDrawn = redraw;
+		Queue(key, scene);
+		return false;
+	}
+	it->second.lastDrawn = redraw;
+	if (it->second.slot < 0)
+		return false;
+
+	float texel = 1.0f / (AtlasSlots * ThumbnailSize);
+	Rec uv((it->second.slot % AtlasSlots) * ThumbnailSize * texel, (it->second.slot / AtlasSlots) * ThumbnailSize * texel,
+		ThumbnailSize * texel, ThumbnailSize * texel);
+	rtImage::getInstance().Draw(area, atlas, uv);
+	return true;
+}
+
+void ThumbnailCache::Queue(const std::string &key, const CpuScene &scene) {
+	mtx_lock(&mutex);
+	if (stopping) {
+		mtx_unlock(&mutex);
+		return;
+	}
+	if ((int)jobs.size() >= MaxQueuedJobs) {
+		entries.erase(jobs.front().key);
+		jobs.pop_front();
+	}
+	Job job;
+	job.key = key;
+	job.scene = scene;
+	jobs.push_back(job);
+	mtx_unlock(&mutex);
+
+	// started with the first request, leaving the cores to the rendering thread and the CPU preview
+	if (!workers)
+		workers = new WorkerPool(std::min((int)MaxWorkers, std::max(1, (int)std::thread::hardware_concurrency() - 1)));
+	workers->Post([this](int) { RenderNewestJob(); });
+}
+
+void ThumbnailCache::RenderNewestJob() {
+	mtx_lock(&mutex);
+	// the latest edit first, the requests of intermediate states may be dropped meanwhile
+	if (stopping || jobs.empty()) {
+		mtx_unlock(&mutex);
+		return;
+	}
+	Job job = jobs.back();
+	jobs.pop_back();
+	mtx_unlock(&mutex);
+
+	Result result;
+	result.key = job.key;
+	Render(job.scene, result.pixels);
+
+	mtx_lock(&mutex);
+	results.push_back(result);
+	mtx_unlock(&mutex);
+}
+
+void ThumbnailCache::Render(CpuScene &scene, std::vector<unsigned char> &pixels) {
+	pixels.assign((size_t)ThumbnailSize * ThumbnailSize * 4, 0);
+	glm::vec3 min, max;
+	if (!scene.Bounds(min, max))
+		return;
+	scene.Compile();
+
+	// three-quarter view from above, the bounds filling most of the image
+	glm::vec3 center = 0.5f * (min + max);
+	float radius = std::max(0.5f * glm::length(max - min), 1e-3f);
+	Camera camera = Camera::LookAt(center + glm::normalize(glm::vec3(1.0f, 0.8f, 1.2f)) * radius * 1.6f, center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	glm::vec2 resolution((float)ThumbnailSize, (float)ThumbnailSize);
+	for (int y = 0; y < ThumbnailSize; y++) {
+		unsigned char *dst = &pixels[(size_t)y * ThumbnailSize * 4];
+		for (int x = 0; x < ThumbnailSize; x++) {
+			// Shade() is black beyond the fog: let the block show through
+			glm::vec3 col = glm::clamp(scene.Trace(camera, glm::vec2(x + 0.5f, y + 0.5f), resolution), 0.0f, 1.0f);
+			dst[x * 4 + 0] = (unsigned char)(col.r * 255.0f + 0.5f);
+			dst[x * 4 + 1] = (unsigned char)(col.g * 255.0f + 0.5f);
+			dst[x * 4 + 2] = (unsigned char)(col.b * 255.0f + 0.5f);
+			dst[x * 4 + 3] = (col == glm::vec3(0.0f)) ? 0 : 255;
+		}
+	}
+}
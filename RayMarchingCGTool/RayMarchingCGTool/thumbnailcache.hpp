@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef THUMBNAILCACHE_HPP
+#define THUMBNAILCACHE_HPP
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include "tinythread.hpp"
+
+#include "mathutil.hpp"
+#include "cpuscene.hpp"
+#include "workerpool.hpp"
+
+class Block;
+
+// Small renders of what each block outputs, shown in the diagram. Pool workers trace the subtree
+// of a block on the CPU, the diagram thread copies the images into slots of one RGBA atlas texture.
+// Entries are keyed by the subtree (BrickMap::SceneKey), so an edit only re-renders the blocks
+// downstream of it and equal subtrees share a slot. Nothing waits for a render: until its image
+// arrives, a block draws its glyph alone.
+class ThumbnailCache {
+
+public:
+	static const int ThumbnailSize = 64; // pixels
+	static const int AtlasSlots = 16; // per row and column of the atlas
+	static const int MaxWorkers = 2;
+	static const int MaxQueuedJobs = 64; // the oldest requests are dropped, their blocks ask again when drawn
+
+	static ThumbnailCache &getInstance() {
+		static ThumbnailCache instance;
+		return instance;
+	}
+
+	// diagram rendering thread
+	bool UploadFinished(); // copy the images finished so far to the atlas; true when the diagram needs a redraw
+	void BeginRedraw(); // before the blocks are drawn (LRU clock)
+	bool Draw(Block *block, Rec area); // false: nothing drawn, the render is queued or running
+
+	// main thread, once the rendering thread is joined
+	void Stop();
+
+	// any thread: RGBA rows bottom-up, transparent where the rays miss
+	static void Render(CpuScene &scene, std::vector<unsigned char> &pixels);
+
+private:
+	struct Entry {
+		int slot; // -1 until uploaded
+		unsigned lastDrawn; // redraw counter
+	};
+	struct Job {
+		std::string key;
+		CpuScene scene;
+	};
+	struct Result {
+		std::string key;
+		std::vector<unsigned char> pixels;
+	};
+
+	ThumbnailCache();
+	~ThumbnailCache();
+
+	void Queue(const std::string &key, const CpuScene &scene);
+	void RenderNewestJob(); // pool task, one per queued job
+	int AllocateSlot(); // -1: every slot was drawn by the last redraw
+
+	// diagram rendering thread
+	std::unordered_map<std::string, Entry> entries;
+	std::vector<std::string> slotKeys; // "": free
+	unsigned redraw;
+	GLuint atlas;
+
+	// hand-off with the workers, guarded by mutex
+	mtx_t mutex;
+	std::deque<Job> jobs; // the newest first out
+	std::vector<Result> results;
+	bool stopping;
+	WorkerPool *workers; // started with the first request
+};
+
+
+#endif
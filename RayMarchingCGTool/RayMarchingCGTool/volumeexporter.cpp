@@ -0,0 +1,165 @@
+#include "volumeexporter.hpp"
+
+// Include standard headers
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+VolumeExporter::VolumeExporter(const CpuScene &scene, const NativeScene *native, const VolumeFile::Header &header) :
+	scene(scene), native((native && native->IsNative()) ? native : NULL), simdLevel(DetectSimdLevel()), header(header), waitingBytes(0), peakWaitingBytes(0)
+{
+	done.assign(header.numChunks, NULL);
+}
+
+VolumeExporter::~VolumeExporter() {
+	for (size_t i = 0; i < done.size(); i++)
+		delete done[i];
+}
+
+bool VolumeExporter::Export(const CpuScene &scene, const NativeScene *native, int resolution, int numThreads, const std::string &fileName) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	glm::vec3 min, max;
+	if (!scene.Bounds(min, max)) {
+		fprintf(stderr, "Nothing to export, the scene is empty\n");
+		return false;
+	}
+
+	// two samples of margin around the bounds
+	glm::vec3 size = max - min;
+	float spacing = std::max(std::max(size.x, std::max(size.y, size.z)) / std::max(resolution - 1, 1), 1e-6f);
+	glm::ivec3 dims = glm::ivec3(glm::ceil(size / spacing)) + 5;
+	VolumeFile::Header header;
+	VolumeFile::InitHeader(header, dims, ChunkSize, min - 2.0f * spacing, spacing);
+
+	FILE *stream;
+	if (fopen_s(&stream, fileName.c_str(), "wb") != 0) {
+		fprintf(stderr, "Impossible to write %s\n", fileName.c_str());
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, stream);
+	unsigned long long offset = sizeof(header);
+
+	VolumeExporter exporter(scene, native, header);
+	WorkerPool pool(numThreads);
+	numThreads = pool.NumThreads();
+	Worker idle = { std::vector<float>(), 0 };
+	exporter.workers.assign(std::max(numThreads, 1), idle);
+
+	// the chunks are appended in order, each on an Alignment boundary
+	std::vector<VolumeFile::IndexEntry> index(header.numChunks);
+	static const unsigned char padding[VolumeFile::Alignment] = {};
+	int rawChunks = 0;
+	pool.Run((int)header.numChunks, [&exporter](int chunk, int worker) {
+		Chunk *encoded = exporter.Encode(chunk, exporter.workers[worker]);
+		exporter.done[chunk] = encoded;
+		size_t waiting = exporter.waitingBytes += encoded->data.capacity();
+		size_t peak = exporter.peakWaitingBytes;
+		while (waiting > peak && !exporter.peakWaitingBytes.compare_exchange_weak(peak, waiting));
+	}, [&](int chunk) {
+		Chunk *encoded = exporter.done[chunk];
+		exporter.done[chunk] = NULL;
+
+		size_t pad = (size_t)((VolumeFile::Alignment - offset % VolumeFile::Alignment) % VolumeFile::Alignment);
+		fwrite(padding, 1, pad, stream);
+		offset += pad;
+		index[chunk].offset = offset;
+		index[chunk].size = (unsigned)encoded->data.size();
+		index[chunk].codec = encoded->codec;
+		fwrite(&encoded->data[0], 1, encoded->data.size(), stream);
+		offset += encoded->data.size();
+		rawChunks += encoded->codec == VolumeFile::RAW;
+		exporter.waitingBytes -= encoded->data.capacity();
+		delete encoded;
+	}, numThreads * ChunksAheadPerThread);
+
+	// index last, then the header knows where it is
+	header.indexOffset = offset;
+	if (header.numChunks)
+		fwrite(&index[0], sizeof(VolumeFile::IndexEntry), header.numChunks, stream);
+	offset += sizeof(VolumeFile::IndexEntry) * header.numChunks;
+	fseek(stream, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, stream);
+	bool ok = !ferror(stream);
+	ok = fclose(stream) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "Error while writing %s\n", fileName.c_str());
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	double samples = (double)dims.x * dims.y * dims.z;
+	// allocated, not resident: each worker at its largest chunk, every waiting chunk at their peak
+	size_t workerBytes = 0;
+	for (auto it = exporter.workers.begin(); it != exporter.workers.end(); ++it)
+		workerBytes += it->peakBytes;
+	printf("Exported %s: %dx%dx%d samples (%u chunks, %d threads, %s) in %.0f ms, %.1f Msamples/s, %.1f MB/s written\n",
+		fileName.c_str(), dims.x, dims.y, dims.z, header.numChunks, numThreads, exporter.native ? "native" : SimdLevelName(exporter.simdLevel), ms,
+		samples / (ms * 1000.0), offset / (ms * 1000.0));
+	printf("  %.1f MB for %.1f MB of floats (ratio %.2f, %d chunks stored raw)\n",
+		offset / 1048576.0, samples * 4.0 / 1048576.0, samples * 4.0 / offset, rawChunks);
+	printf("  buffers of at most %.1f MB: %.1f MB in the workers, %.1f MB of encoded chunks waiting, %.1f MB of index\n",
+		(workerBytes + exporter.peakWaitingBytes + index.size() * sizeof(VolumeFile::IndexEntry)) / 1048576.0,
+		workerBytes / 1048576.0, exporter.peakWaitingBytes / 1048576.0, index.size() * sizeof(VolumeFile::IndexEntry) / 1048576.0);
+	return ok;
+}
+
+VolumeExporter::Chunk *VolumeExporter::Encode(int chunk, Worker &worker) {
+	glm::ivec3 first, size;
+	VolumeFile::ChunkBox(header, chunk, first, size);
+	int n = size.x * size.y * size.z;
+
+	worker.scratch.resize(4 * (size_t)n);
+	float *x = &worker.scratch[0], *y = x + n, *z = y + n, *d = z + n;
+	for (int k = 0, s = 0; k < size.z; k++)
+		for (int j = 0; j < size.y; j++)
+			for (int i = 0; i < size.x; i++, s++) {
+				x[s] = header.origin[0] + (first.x + i) * header.spacing;
+				y[s] = header.origin[1] + (first.y + j) * header.spacing;
+				z[s] = header.origin[2] + (first.z + k) * header.spacing;
+			}
+	if (native)
+		native->Evaluate(x, y, z, d, n);
+	else DistanceBatch(simdLevel, scene, x, y, z, d, n);
+
+	Chunk *encoded = new Chunk();
+	encoded->codec = VolumeFile::Compress(d, size, encoded->data);
+	// Compress() holds the ordered integers and its output at its largest
+	worker.peakBytes = std::max(worker.peakBytes, worker.scratch.capacity() * sizeof(float) + n * sizeof(long long) + encoded->data.capacity());
+	encoded->data.shrink_to_fit();
+	return encoded;
+}
+
+bool VolumeExporter::CheckRegion(const CpuScene &scene, const std::string &fileName, const glm::ivec3 &first, const glm::ivec3 &size) {
+	VolumeFile file;
+	if (!file.Open(fileName))
+		return false;
+	int n = size.x * size.y * size.z;
+	std::vector<float> samples(4 * (size_t)std::max(n, 0));
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (n <= 0 || !file.ReadRegion(first, size, &samples[0])) {
+		fprintf(stderr, "Impossible to read the region %d,%d,%d,%d,%d,%d of the %dx%dx%d volume\n", first.x, first.y, first.z, size.x, size.y, size.z,
+			file.header.dims[0], file.header.dims[1], file.header.dims[2]);
+		return false;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// the same points through the scene
+	float *x = &samples[n], *y = x + n, *z = y + n;
+	for (int k = 0, s = 0; k < size.z; k++)
+		for (int j = 0; j < size.y; j++)
+			for (int i = 0; i < size.x; i++, s++) {
+				x[s] = file.header.origin[0] + (first.x + i) * file.header.spacing;
+				y[s] = file.header.origin[1] + (first.y + j) * file.header.spacing;
+				z[s] = file.header.origin[2] + (first.z + k) * file.header.spacing;
+			}
+	std::vector<float> expected(n);
+	DistanceBatch(DetectSimdLevel(), scene, x, y, z, &expected[0], n);
+	float maxDifference = 0.0f, lo = samples[0], hi = samples[0];
+	for (int s = 0; s < n; s++) {
+		maxDifference = std::max(maxDifference, std::abs(samples[s] - expected[s]));
+		lo = std::min(lo, samples[s]);
+		hi = std::max(hi, samples[s]);
+	}
+	printf("Read %dx%dx%d samples of %s from %d chunks (%.1f KB) in %.2f ms: distances in [%g, %g], max difference with the scene %g\n",
+		size.x, size.y, size.z, fileName.c_str(), file.chunksDecoded, file.bytesRead / 1024.0, ms, lo, hi, maxDifference);
+	return true;
+}
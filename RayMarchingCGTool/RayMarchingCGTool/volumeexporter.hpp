@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef VOLUMEEXPORTER_HPP
+#define VOLUMEEXPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "cpuscene.hpp"
+#include "nativescene.hpp"
+#include "raypacket.hpp"
+#include "volumefile.hpp"
+#include "workerpool.hpp"
+
+// Out-of-core export of the distance field to a VolumeFile. The workers of an ordered WorkerPool Run
+// sample and compress chunks, the calling thread appends them in order and writes the index last: at most
+// ChunksAheadPerThread encoded chunks per thread wait for the writer, the volume itself is never
+// in memory, whatever its size. Samples come from the native backend of the same graph when it is
+// loaded, else from the SIMD kernels.
+class VolumeExporter {
+
+public:
+	static const int ChunkSize = 64; // samples per chunk edge
+	static const int ChunksAheadPerThread = 2;
+
+	// native: scene() of the same graph as machine code (NULL or without library: the SIMD kernels);
+	// resolution: samples along the longest side of the surface bounds; numThreads: 0 for one per core
+	static bool Export(const CpuScene &scene, const NativeScene *native, int resolution, int numThreads, const std::string &fileName);
+	// reads the samples [first, first + size) of a volume back and compares them with the scene
+	static bool CheckRegion(const CpuScene &scene, const std::string &fileName, const glm::ivec3 &first, const glm::ivec3 &size);
+
+private:
+	struct Chunk {
+		std::vector<unsigned char> data;
+		VolumeFile::Codec codec;
+	};
+
+	// per worker
+	struct Worker {
+		std::vector<float> scratch; // points and distances
+		size_t peakBytes; // scratch, and what Compress() allocated, for the largest chunk
+	};
+
+	VolumeExporter(const CpuScene &scene, const NativeScene *native, const VolumeFile::Header &header);
+	~VolumeExporter();
+
+	Chunk *Encode(int chunk, Worker &worker);
+
+	const CpuScene &scene;
+	const NativeScene *native; // NULL: DistanceBatch
+	SimdLevel simdLevel;
+	VolumeFile::Header header;
+
+	std::vector<Chunk *> done; // per chunk, from the worker that encodes it to the writer
+	std::vector<Worker> workers;
+	std::atomic<size_t> waitingBytes, peakWaitingBytes; // encoded chunks not written yet
+};
+
+
+#endif
@@ -0,0 +1,194 @@
+#include "volumefile.hpp"
+
+// Include standard headers
+#include <string.h>
+#include <algorithm>
+
+static const char VolumeMagic[8] = "SDFVOL1";
+
+// floats as integers in the same order: smooth fields give small Lorenzo residuals
+static inline long long OrderedBits(float f) {
+	unsigned u;
+	memcpy(&u, &f, 4);
+	return (u & 0x80000000u) ? (long long)~u : (long long)(u | 0x80000000u);
+}
+
+static inline float FromOrderedBits(long long o) {
+	unsigned u = (unsigned)o;
+	u = (u & 0x80000000u) ? u & 0x7fffffffu : ~u;
+	float f;
+	memcpy(&f, &u, 4);
+	return f;
+}
+
+// Lorenzo predictor: inclusion-exclusion of the preceding neighbours, dropping the axes at the
+// chunk faces (2D / 1D Lorenzo there, nothing at the first sample)
+static inline long long Predict(const long long *o, int x, int y, int z, int dy, int dz) {
+	long long prediction = 0;
+	for (int m = 1; m < 8; m++) {
+		if (((m & 1) && x == 0) || ((m & 2) && y == 0) || ((m & 4) && z == 0))
+			continue;
+		int offset = ((m & 1) ? 1 : 0) + ((m & 2) ? dy : 0) + ((m & 4) ? dz : 0);
+		int bits = (m & 1) + (m >> 1 & 1) + (m >> 2 & 1);
+		prediction += (bits & 1) ? o[-offset] : -o[-offset];
+	}
+	return prediction;
+}
+
+void VolumeFile::InitHeader(Header &header, const glm::ivec3 &dims, int chunkSize, const glm::vec3 &origin, float spacing) {
+	header = Header();
+	memcpy(header.magic, VolumeMagic, sizeof(header.magic));
+	header.version = Version;
+	header.chunkSize = chunkSize;
+	for (int i = 0; i < 3; i++) {
+		header.dims[i] = dims[i];
+		header.origin[i] = origin[i];
+	}
+	header.spacing = spacing;
+	glm::ivec3 chunks = ChunkCount(header);
+	header.numChunks = chunks.x * chunks.y * chunks.z;
+}
+
+glm::ivec3 VolumeFile::ChunkCount(const Header &header) {
+	int c = (int)header.chunkSize;
+	return glm::ivec3((header.dims[0] + c - 1) / c, (header.dims[1] + c - 1) / c, (header.dims[2] + c - 1) / c);
+}
+
+void VolumeFile::ChunkBox(const Header &header, int chunk, glm::ivec3 &first, glm::ivec3 &size) {
+	glm::ivec3 chunks = ChunkCount(header);
+	int c = (int)header.chunkSize;
+	first = glm::ivec3(chunk % chunks.x, chunk / chunks.x % chunks.y, chunk / (chunks.x * chunks.y)) * c;
+	for (int i = 0; i < 3; i++)
+		size[i] = std::min(c, header.dims[i] - first[i]);
+}
+
+VolumeFile::Codec VolumeFile::Compress(const float *v, const glm::ivec3 &size, std::vector<unsigned char> &out) {
+	int n = size.x * size.y * size.z;
+	int dy = size.x, dz = size.x * size.y;
+	std::vector<long long> o(n);
+	for (int i = 0; i < n; i++)
+		o[i] = OrderedBits(v[i]);
+
+	out.clear();
+	out.reserve((size_t)n * 2);
+	for (int z = 0, i = 0; z < size.z; z++)
+		for (int y = 0; y < size.y; y++)
+			for (int x = 0; x < size.x; x++, i++) {
+				long long residual = o[i] - Predict(&o[i], x, y, z, dy, dz);
+				unsigned long long zigzag = ((unsigned long long)residual << 1) ^ (unsigned long long)(residual >> 63);
+				while (zigzag >= 0x80) {
+					out.push_back((unsigned char)(zigzag | 0x80));
+					zigzag >>= 7;
+				}
+				out.push_back((unsigned char)zigzag);
+			}
+
+	if (out.size() < (size_t)n * 4)
+		return LORENZO;
+	out.resize((size_t)n * 4);
+	memcpy(&out[0], v, out.size());
+	return RAW;
+}
+
+bool VolumeFile::Decompress(const unsigned char *data, size_t n, Codec codec, const glm::ivec3 &size, float *v) {
+	int count = size.x * size.y * size.z;
+	if (codec == RAW) {
+		if (n != (size_t)count * 4)
+			return false;
+		memcpy(v, data, n);
+		return true;
+	}
+	if (codec != LORENZO)
+		return false;
+
+	int dy = size.x, dz = size.x * size.y;
+	std::vector<long long> o(count);
+	const unsigned char *p = data, *end = data + n;
+	for (int z = 0, i = 0; z < size.z; z++)
+		for (int y = 0; y < size.y; y++)
+			for (int x = 0; x < size.x; x++, i++) {
+				unsigned long long zigzag = 0;
+				for (int shift = 0;; shift += 7) {
+					if (p == end || shift > 63)
+						return false;
+					unsigned char byte = *p++;
+					zigzag |= (unsigned long long)(byte & 0x7f) << shift;
+					if (!(byte & 0x80))
+						break;
+				}
+				long long residual = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+				o[i] = residual + Predict(&o[i], x, y, z, dy, dz);
+				v[i] = FromOrderedBits(o[i]);
+			}
+	return p == end;
+}
+
+bool VolumeFile::Open(const std::string &fileName) {
+	Close();
+	this->fileName = fileName;
+	if (fopen_s(&stream, fileName.c_str(), "rb") != 0) {
+		fprintf(stderr, "Impossible to open %s\n", fileName.c_str());
+		return false;
+	}
+	if (fread(&header, sizeof(header), 1, stream) != 1 || memcmp(header.magic, VolumeMagic, sizeof(header.magic)) != 0 || header.version != Version) {
+		fprintf(stderr, "%s is not a distance volume\n", fileName.c_str());
+		Close();
+		return false;
+	}
+	index.resize(header.numChunks);
+	if (_fseeki64(stream, (long long)header.indexOffset, SEEK_SET) != 0 ||
+		(header.numChunks && fread(&index[0], sizeof(IndexEntry), header.numChunks, stream) != header.numChunks)) {
+		fprintf(stderr, "The index of %s is damaged\n", fileName.c_str());
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void VolumeFile::Close() {
+	if (stream) fclose(stream);
+	stream = NULL;
+	index.clear();
+}
+
+bool VolumeFile::ReadRegion(const glm::ivec3 &first, const glm::ivec3 &size, float *out) {
+	if (!stream)
+		return false;
+	for (int i = 0; i < 3; i++)
+		if (first[i] < 0 || size[i] <= 0 || first[i] + size[i] > header.dims[i])
+			return false;
+
+	// the chunks overlapping the region, one at a time
+	int c = (int)header.chunkSize;
+	glm::ivec3 chunks = ChunkCount(header);
+	glm::ivec3 from = first / c, to = (first + size - 1) / c;
+	std::vector<unsigned char> data;
+	std::vector<float> samples;
+	for (int cz = from.z; cz <= to.z; cz++)
+		for (int cy = from.y; cy <= to.y; cy++)
+			for (int cx = from.x; cx <= to.x; cx++) {
+				int chunk = (cz * chunks.y + cy) * chunks.x + cx;
+				const IndexEntry &entry = index[chunk];
+				glm::ivec3 chunkFirst, chunkSize;
+				ChunkBox(header, chunk, chunkFirst, chunkSize);
+				data.resize(std::max(entry.size, 1u));
+				samples.resize((size_t)chunkSize.x * chunkSize.y * chunkSize.z);
+				if (_fseeki64(stream, (long long)entry.offset, SEEK_SET) != 0 || fread(&data[0], 1, entry.size, stream) != entry.size ||
+					!Decompress(&data[0], entry.size, (Codec)entry.codec, chunkSize, &samples[0])) {
+					fprintf(stderr, "Chunk %d of %s is damaged\n", chunk, fileName.c_str());
+					return false;
+				}
+				bytesRead += entry.size;
+				chunksDecoded++;
+
+				// copy the overlap, rows of x
+				glm::ivec3 lo = glm::max(first, chunkFirst), hi = glm::min(first + size, chunkFirst + chunkSize);
+				for (int z = lo.z; z < hi.z; z++)
+					for (int y = lo.y; y < hi.y; y++) {
+						const float *src = &samples[((size_t)(z - chunkFirst.z) * chunkSize.y + (y - chunkFirst.y)) * chunkSize.x + (lo.x - chunkFirst.x)];
+						float *dst = out + ((size_t)(z - first.z) * size.y + (y - first.y)) * size.x + (lo.x - first.x);
+						memcpy(dst, src, (hi.x - lo.x) * sizeof(float));
+					}
+			}
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef VOLUMEFILE_HPP
+#define VOLUMEFILE_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+// Chunked distance volume file: a Header, the chunks compressed independently (each starting on an
+// Alignment boundary, so a mapped file can decode them in place) and an index of every chunk at the
+// end. Samples are float distances, x fastest, chunks of chunkSize^3 samples (less on the far faces).
+// Any region is read back by decoding only the chunks it overlaps.
+class VolumeFile {
+
+public:
+	static const unsigned Version = 1;
+	static const int Alignment = 64;
+
+	// LORENZO: lossless, 3D Lorenzo prediction of the order-preserving integer of every float,
+	// zigzag LEB128 residuals. A chunk is stored RAW when that doesn't make it smaller.
+	enum Codec { RAW = 0, LORENZO = 1 };
+
+	// little endian, no padding
+	struct Header {
+		char magic[8]; // "SDFVOL1"
+		unsigned version;
+		unsigned chunkSize;
+		int dims[3]; // samples per axis
+		float origin[3]; // position of sample 0
+		float spacing; // between samples
+		unsigned numChunks;
+		unsigned long long indexOffset;
+		unsigned reserved[2];
+	};
+
+	struct IndexEntry {
+		unsigned long long offset;
+		unsigned size; // bytes
+		unsigned codec;
+	};
+
+	VolumeFile() : bytesRead(0), chunksDecoded(0), stream(NULL) { header = Header(); }
+	~VolumeFile() { Close(); }
+
+	static void InitHeader(Header &header, const glm::ivec3 &dims, int chunkSize, const glm::vec3 &origin, float spacing);
+	static glm::ivec3 ChunkCount(const Header &header);
+	static void ChunkBox(const Header &header, int chunk, glm::ivec3 &first, glm::ivec3 &size);
+
+	// size: samples of the chunk; out is replaced
+	static Codec Compress(const float *v, const glm::ivec3 &size, std::vector<unsigned char> &out);
+	static bool Decompress(const unsigned char *data, size_t n, Codec codec, const glm::ivec3 &size, float *v);
+
+	bool Open(const std::string &fileName); // reads the header and the index
+	void Close();
+	// samples [first, first + size) into out (x fastest); false outside the volume or on a damaged chunk
+	bool ReadRegion(const glm::ivec3 &first, const glm::ivec3 &size, float *out);
+
+	Header header;
+	std::vector<IndexEntry> index;
+	size_t bytesRead; // compressed bytes read by ReadRegion()
+	int chunksDecoded;
+
+private:
+	FILE *stream;
+	std::string fileName;
+};
+
+
+#endif
@@ -3,20 +3,38 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <cmath>
+#include <algorithm>
 
 #include "appstate.hpp"
 #include "shader.hpp"
+#include "codegen.hpp"
+#include "block.hpp"
+
+// Include GLM
+#include <glm/glm.hpp>
+
+const double DisplayWindowInfo::ProgressiveFrameBudgetMs = 8.0;
+const float DisplayWindowInfo::SweepRange = 0.5f;
+const float DisplayWindowInfo::SliceZoomFactor = 1.25f;
 
 void WindowInfo::SetupRC() {
-	glfwWindowHint(GLFW_SAMPLES, 9);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_SAMPLES, Samples);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, ContextMajor);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, ContextMinor);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 	// Initialize WINDOW
 	window = glfwCreateWindow(Width, Height, "RaymarchingCGTool", NULL, NULL);
 
+	// Fall back to the 3.3 baseline
+	if (!window && (ContextMajor > 3 || ContextMinor > 3)) {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(Width, Height, "RaymarchingCGTool", NULL, NULL);
+	}
+
 	if (!window) {
 		fprintf(stderr, "Failed to open GLFW DisplayWindow. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version.\n");
 		glfwTerminate();
@@ -30,13 +48,120 @@ void WindowInfo::DestroyRC() {
 	window = NULL;
 }
 
-WindowInfo::WindowInfo(int w, int h) { Width = w; Height = h; window = NULL; }
+WindowInfo::WindowInfo(int w, int h, int samples) { Width = w; Height = h; Samples = samples; ContextMajor = 3; ContextMinor = 3; window = NULL; }
 
 
 void DisplayWindowInfo::key_callback(GLFWwindow* DisplayWindow, int key, int scancode, int action, int mods)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(DisplayWindow, GL_TRUE);
+	else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		// toggle progressive rendering (targets are (re)created lazily on the rendering thread)
+		getInstance().renderMode = (getInstance().renderMode == PROGRESSIVE) ? DIRECT : PROGRESSIVE;
+	}
+	else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		// toggle deferred shading
+		getInstance().renderMode = (getInstance().renderMode == DEFERRED) ? DIRECT : DEFERRED;
+	}
+	else if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		// toggle the compute backend
+		getInstance().renderMode = (getInstance().renderMode == COMPUTE) ? DIRECT : COMPUTE;
+	}
+	else if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+		// toggle the parameter sweep contact sheet
+		getInstance().renderMode = (getInstance().renderMode == SWEEP) ? DIRECT : SWEEP;
+	}
+	else if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+		// toggle the multi-viewport display
+		getInstance().renderMode = (getInstance().renderMode == MULTIVIEW) ? DIRECT : MULTIVIEW;
+	}
+	else if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+		// start/stop exporting the displayed frames
+		getInstance().needToggleRecording = true;
+	}
+	else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+		getInstance().needReloadShading = true;
+	}
+	else if (key == GLFW_KEY_A && action == GLFW_PRESS) {
+		// cycle anti-aliasing: none -> adaptive -> temporal
+		getInstance().antiAliasing = (AntiAliasing)((getInstance().antiAliasing + 1) % (AA_TEMPORAL + 1));
+		getInstance().temporalFrames = 0;
+	}
+	else if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+		// toggle the slice view
+		getInstance().renderMode = (getInstance().renderMode == SLICE) ? DIRECT : SLICE;
+	}
+	else if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+		getInstance().SetTimePaused(!getInstance().timePaused);
+	}
+	else if (getInstance().renderMode == SLICE && action != GLFW_RELEASE) {
+		getInstance().SliceKey(key);
+	}
+}
+
+void DisplayWindowInfo::SliceKey(int key)
+{
+	SlicePlane plane = slice.GetPlane();
+	float pan = SlicePanPixels * plane.pixelSize, step = SliceStepPixels * plane.pixelSize;
+	switch (key) {
+	case GLFW_KEY_LEFT: plane.center.x -= pan; break;
+	case GLFW_KEY_RIGHT: plane.center.x += pan; break;
+	case GLFW_KEY_DOWN: plane.center.y -= pan; break;
+	case GLFW_KEY_UP: plane.center.y += pan; break;
+	case GLFW_KEY_PAGE_DOWN: plane.offset -= step; break;
+	case GLFW_KEY_PAGE_UP: plane.offset += step; break;
+	case GLFW_KEY_TAB: plane.axis = (plane.axis + 1) % 3; break;
+	case GLFW_KEY_M:
+		// the colors only, the samples are kept
+		slice.SetColorMode(slice.GetColorMode() == SliceView::DISTANCE ? SliceView::GRADIENT : SliceView::DISTANCE);
+		return;
+	default:
+		return;
+	}
+	slice.SetPlane(plane);
+}
+
+void DisplayWindowInfo::mousebutton_callback(GLFWwindow *DisplayWindow, int button, int action, int mods)
+{
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		double x, y;
+		glfwGetCursorPos(DisplayWindow, &x, &y);
+		if (getInstance().renderMode == SLICE)
+			getInstance().PickSlice(x, y);
+		else
+			getInstance().Pick(x, y);
+	}
+}
+
+void DisplayWindowInfo::mousescroll_callback(GLFWwindow *DisplayWindow, double xoffset, double yoffset)
+{
+	DisplayWindowInfo &info = getInstance();
+	if (info.renderMode != SLICE)
+		return;
+
+	// zoom about the point under the cursor
+	double x, y;
+	glfwGetCursorPos(DisplayWindow, &x, &y);
+	SlicePlane plane = info.slice.GetPlane();
+	glm::vec2 offset = glm::vec2((float)x, (float)(info.Height - y)) - 0.5f * glm::vec2((float)info.Width, (float)info.Height);
+	glm::vec2 pivot = plane.center + offset * plane.pixelSize;
+	plane.pixelSize *= std::pow(SliceZoomFactor, (float)-yoffset);
+	plane.center = pivot - offset * plane.pixelSize;
+	info.slice.SetPlane(plane);
+}
+
+void DisplayWindowInfo::SetTimePaused(bool paused)
+{
+	if (paused == timePaused) return;
+	if (paused) {
+		pausedTime = GetSceneTime();
+	}
+	else {
+		// resume from the paused time
+		AppState::getInstance().mtime = std::chrono::system_clock::now() - std::chrono::milliseconds((long long)(pausedTime * 1000.0f));
+	}
+	timePaused = paused;
+	temporalFrames = 0;
 }
 
 void DisplayWindowInfo::resize_callback(GLFWwindow *DisplayWindow, int width, int height)
@@ -51,21 +176,95 @@ void DisplayWindowInfo::SetupRC()
 	// setup callbacks
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetWindowSizeCallback(window, resize_callback); //glfwSetFramebufferSizeCallback
+	glfwSetMouseButtonCallback(window, mousebutton_callback);
+	glfwSetScrollCallback(window, mousescroll_callback);
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+
+	// hidden context compiling the generated programs
+	shaderLoader.SetupRC(window);
+}
+
+void DisplayWindowInfo::DestroyRC()
+{
+	preview.Stop();
+	slice.Stop();
+	shaderLoader.DestroyRC();
+	delete pickQuery;
+	pickQuery = NULL;
+	WindowInfo::DestroyRC();
+}
+
+void DisplayWindowInfo::RequestShaderUpdate(const CpuScene &previewScene, const std::vector<BakedVolume> &bakes)
+{
+	mtx_lock(&previewSceneMutex);
+	this->previewScene = previewScene;
+	pendingBakes = bakes;
+	bakesChanged = true;
+	sliceSceneStale = true;
+	mtx_unlock(&previewSceneMutex);
+	needUpdateShader = true;
 }
 
 void DisplayWindowInfo::UpdateShader(std::string fileName)
 {
 	// Update shaders (should throw if errors)
-	GLint newProgramID = LoadShaders("DisplayWindow.vertexshader", fileName.c_str());
+	InstallProgram(LoadShaders("DisplayWindow.vertexshader", fileName.c_str()));
+}
 
+void DisplayWindowInfo::InstallProgram(GLuint newProgramID)
+{
 	// delete previous program
 	glDeleteProgram(programID);
 	programID = newProgramID;
 
 	// Use our shader
 	glUseProgram(programID);
+	GetUniformLocations();
+
+	// brick maps of the new program
+	mtx_lock(&previewSceneMutex);
+	if (bakesChanged) {
+		bakedTextures.Upload(pendingBakes);
+		pendingBakes.clear();
+		bakesChanged = false;
+	}
+	mtx_unlock(&previewSceneMutex);
+	bakedTextures.SetSamplers(programID);
+
+	// the accumulated images belong to the previous program
+	StartProgressivePass();
+	temporalFrames = 0;
+
+	// a new march pass and compute backend have been generated along with the program
+	marchProgramStale = true;
+	computeProgramStale = true;
+	sweepProgramStale = true;
+	sweepBaseParams = CodeGenManager::getInstance().GetParams();
+}
+
+void DisplayWindowInfo::LoadShadingProgram()
+{
+	GLuint newProgramID = LoadShaders("DisplayWindow.vertexshader", AppState::ShadingShaderName.c_str());
+	glDeleteProgram(shadingProgramID);
+	shadingProgramID = newProgramID;
+
+	glUseProgram(shadingProgramID);
+	glUniform1i(glGetUniformLocation(shadingProgramID, "gPositionDepth"), 0); // TEXTURE0, never changed
+	glUniform1i(glGetUniformLocation(shadingProgramID, "gNormalId"), 1); // TEXTURE1, never changed
+	shadingCameraPosID = glGetUniformLocation(shadingProgramID, "cameraPos");
+	glUseProgram(programID);
+}
+
+void DisplayWindowInfo::GetUniformLocations()
+{
+	// unused uniforms (e.g. in the reference shader) get -1, which glUniform* ignores
+	timeID = glGetUniformLocation(programID, "time");
+	resolutionID = glGetUniformLocation(programID, "resolution");
+	aaModeID = glGetUniformLocation(programID, "aaMode");
+	jitterID = glGetUniformLocation(programID, "jitter");
+	tileOriginID = glGetUniformLocation(programID, "tileOrigin");
+	cameraUniforms.Locate(programID);
 }
 
 void DisplayWindowInfo::RenderInit()
@@ -78,8 +277,7 @@ void DisplayWindowInfo::RenderInit()
 
 	////////////// todo: add error checking
 
-	timeID = glGetUniformLocation(programID, "time");
-	resolutionID = glGetUniformLocation(programID, "resolution");
+	GetUniformLocations();
 
 	static const GLfloat g_vertex_buffer_data[] = {
 		-1.0f, -1.0f, 0.0f,
@@ -112,36 +310,643 @@ void DisplayWindowInfo::RenderInit()
 	}
 	glBindVertexArray(0);
 
+	// Deferred programs: the march pass exists only after the first codegen
+	marchProgramID = 0;
+	marchProgramStale = false;
+	shadingProgramID = 0;
+	LoadShadingProgram();
+
+	// Compute backend (the context may have fallen back to 3.3)
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	computeSupported = (major > 4 || (major == 4 && minor >= 3));
+	computeProgramID = 0;
+	computeProgramStale = false;
+	computeTileQueue = 0;
+	if (computeSupported) {
+		GLuint zero = 0;
+		glGenBuffers(1, &computeTileQueue);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, computeTileQueue);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// Sweep program: generated along with the others
+	sweepProgramID = 0;
+	sweepProgramStale = false;
+
+	// Offscreen targets are created on first use
+	temporalFrames = 0;
+	gbufferValid = false;
+	glGenQueries(1, &progressiveTimerQuery);
+	progressiveQueryTiles = 0;
+	progressiveTileCostMs = 0.0;
+
 	// Dark blue background
 	glViewport(0, 0, Width, Height);
 	glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
 }
 
 
+float DisplayWindowInfo::GetSceneTime()
+{
+	// recorded frames advance by a fixed step, whatever the frame rate
+	if (recorder)
+		return recordStartTime + recorder->NumCapturedFrames * AppState::getInstance().timeStep;
+	if (timePaused)
+		return pausedTime;
+	return 0.001f * std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - AppState::getInstance().mtime).count();
+}
+
+void DisplayWindowInfo::SetAntiAliasingUniforms(float jitterX, float jitterY)
+{
+	// the temporal mode relies on jitter only, the shader itself takes a single ray
+	glUniform1i(aaModeID, antiAliasing == AA_ADAPTIVE ? 1 : 0);
+	glUniform2f(jitterID, jitterX, jitterY);
+}
+
+void DisplayWindowInfo::DrawQuad()
+{
+	glBindVertexArray(vertexarrayobject);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // draw quad (2 triangles)
+	glBindVertexArray(0);
+}
+
 void DisplayWindowInfo::Render()
 {
 	if (needUpdateShader) {
-		UpdateShader(AppState::OutputShaderName);
 		needUpdateShader = false;
+		if (shaderLoader.IsAvailable()) {
+			// keep drawing while the driver compiles: CPU preview of the new scene, from the current point of view
+			shaderLoader.Request("DisplayWindow.vertexshader", AppState::OutputShaderName);
+			mtx_lock(&previewSceneMutex);
+			preview.Start(previewScene, Camera::Orbit(GetSceneTime()), Width, Height);
+			mtx_unlock(&previewSceneMutex);
+		}
+		else UpdateShader(AppState::OutputShaderName);
+	}
+	GLuint linkedProgramID;
+	if (shaderLoader.Poll(linkedProgramID)) {
+		preview.Destroy();
+		InstallProgram(linkedProgramID);
+	}
+	if (needToggleRecording) {
+		if (recorder) StopRecording();
+		else StartRecording();
+		needToggleRecording = false;
 	}
+	// the recorded size is fixed
+	if (recorder && (recorder->Width != Width || recorder->Height != Height))
+		StopRecording();
+	glUseProgram(programID);
+
+	// the slice workers only run while it is shown
+	if (renderMode != SLICE && slice.IsActive())
+		slice.Stop();
+
+	// the preview stays up until the program is linked
+	if (preview.IsActive())
+		preview.Draw(Width, Height);
+	else switch (renderMode)
+	{
+	case DisplayWindowInfo::PROGRESSIVE:
+		RenderProgressive();
+		break;
+	case DisplayWindowInfo::DEFERRED:
+		RenderDeferred();
+		break;
+	case DisplayWindowInfo::COMPUTE:
+		RenderCompute();
+		break;
+	case DisplayWindowInfo::SWEEP:
+		RenderSweep();
+		break;
+	case DisplayWindowInfo::MULTIVIEW:
+		RenderMultiView();
+		break;
+	case DisplayWindowInfo::SLICE:
+		RenderSlice();
+		break;
+	default:
+		if (antiAliasing == AA_TEMPORAL && timePaused && !recorder)
+			RenderTemporal();
+		else
+			RenderDirect();
+		break;
+	}
+
+	// capture the back buffer, the readback completes while the next frames render
+	if (recorder)
+		recorder->CaptureFrame(0);
 
+	glfwSwapBuffers(window);
+}
+
+void DisplayWindowInfo::StartRecording()
+{
+	AppState &state = AppState::getInstance();
+	int fps = std::max(1, (int)(1.0f / state.timeStep + 0.5f));
+	recordStartTime = GetSceneTime();
+	recorder = new FrameExporter(state.outputPattern, Width, Height, fps);
+	if (!recorder->Start()) {
+		recorder->Finish();
+		delete recorder;
+		recorder = NULL;
+		return;
+	}
+	printf("Recording to %s\n", state.outputPattern.c_str());
+}
 
+void DisplayWindowInfo::StopRecording()
+{
+	// continue from the last recorded time
+	float time = GetSceneTime();
+	bool ok = recorder->Finish();
+	printf("Recorded %d frames%s\n", recorder->NumCapturedFrames, ok ? "" : " (with errors)");
+	delete recorder;
+	recorder = NULL;
+
+	if (timePaused) pausedTime = time;
+	else AppState::getInstance().mtime = std::chrono::system_clock::now() - std::chrono::milliseconds((long long)(time * 1000.0f));
+}
+
+void DisplayWindowInfo::RenderDirect()
+{
 	glViewport(0, 0, Width, Height);
 	glClear(GL_COLOR_BUFFER_BIT);
 
 
+	float time = GetSceneTime();
+	glUniform2f(resolutionID, Width, Height);
+	glUniform1f(timeID, time);
+	cameraUniforms.Set(Camera::Orbit(time));
+	SetAntiAliasingUniforms(0.0f, 0.0f);
+
+	DrawQuad();
+}
+
+static float Halton(int index, int base)
+{
+	float f = 1.0f, r = 0.0f;
+	for (; index > 0; index /= base) {
+		f /= base;
+		r += f * (index % base);
+	}
+	return r;
+}
+
+void DisplayWindowInfo::RenderTemporal()
+{
+	if (Width <= 0 || Height <= 0)
+		return;
+	if (!temporalTarget.Matches(Width, Height)) {
+		temporalTarget.Setup(Width, Height, GL_RGBA16F); // float target: 1/n weights do not band
+		temporalFrames = 0;
+	}
+
+	// Converged images are only presented
+	if (temporalFrames < TemporalMaxFrames) {
+		temporalTarget.Bind();
+		float time = GetSceneTime();
+		glUniform2f(resolutionID, Width, Height);
+		glUniform1f(timeID, time);
+		cameraUniforms.Set(Camera::Orbit(time));
+		SetAntiAliasingUniforms(Halton(temporalFrames + 1, 2) - 0.5f, Halton(temporalFrames + 1, 3) - 0.5f);
+
+		// running average: accum = mix(accum, sample, 1 / (n + 1))
+		glEnable(GL_BLEND);
+		glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (temporalFrames + 1));
+		glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+		DrawQuad();
+		glDisable(GL_BLEND);
+
+		temporalFrames++;
+	}
+
+	temporalTarget.BlitToScreen(Width, Height);
+}
+
+void DisplayWindowInfo::StartProgressivePass()
+{
+	progressiveNextTile = 0;
+	progressiveTime = GetSceneTime();
+}
+
+void DisplayWindowInfo::RenderProgressive()
+{
+	if (Width <= 0 || Height <= 0)
+		return;
+	if (!progressiveTarget[0].Matches(Width, Height)) {
+		progressiveTarget[0].Setup(Width, Height);
+		progressiveTarget[1].Setup(Width, Height);
+		progressiveHasImage = false;
+		StartProgressivePass();
+	}
+
+	// Update the per-tile cost from the previous frame (never wait for the gpu)
+	if (progressiveQueryTiles > 0) {
+		GLint available = 0;
+		glGetQueryObjectiv(progressiveTimerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(progressiveTimerQuery, GL_QUERY_RESULT, &elapsedNs);
+			double costMs = elapsedNs * 1e-6 / progressiveQueryTiles;
+			progressiveTileCostMs = (progressiveTileCostMs > 0.0) ? 0.5 * (progressiveTileCostMs + costMs) : costMs;
+			progressiveQueryTiles = 0;
+		}
+	}
+
+	int tilesX = (Width + ProgressiveTileSize - 1) / ProgressiveTileSize;
+	int tilesY = (Height + ProgressiveTileSize - 1) / ProgressiveTileSize;
+	int numTiles = tilesX * tilesY;
+
+	// Tiles that fit in the frame budget (at least one, so the pass always makes progress)
+	int budgetTiles = (progressiveTileCostMs > 0.0) ? (int)(ProgressiveFrameBudgetMs / progressiveTileCostMs) : 1;
+	budgetTiles = std::max(1, std::min(budgetTiles, numTiles - progressiveNextTile));
+
+	// Accumulate tiles into the working target, the frozen time keeps the tiles consistent
+	progressiveTarget[0].Bind();
 	glUniform2f(resolutionID, Width, Height);
-	glUniform1f(timeID, 0.001 * std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - AppState::getInstance().mtime).count());
+	glUniform1f(timeID, progressiveTime);
+	cameraUniforms.Set(Camera::Orbit(progressiveTime));
+	SetAntiAliasingUniforms(0.0f, 0.0f);
+
+	bool measure = (progressiveQueryTiles == 0);
+	if (measure) glBeginQuery(GL_TIME_ELAPSED, progressiveTimerQuery);
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < budgetTiles; i++, progressiveNextTile++) {
+		int tx = progressiveNextTile % tilesX, ty = progressiveNextTile / tilesX;
+		glScissor(tx * ProgressiveTileSize, ty * ProgressiveTileSize, ProgressiveTileSize, ProgressiveTileSize);
+		DrawQuad();
+		glFlush(); // submit each tile separately, no single command batch runs long enough to trip the watchdog
+	}
+	glDisable(GL_SCISSOR_TEST);
+	if (measure) {
+		glEndQuery(GL_TIME_ELAPSED);
+		progressiveQueryTiles = budgetTiles;
+	}
+
+	// Pass complete: the working target becomes the presented image
+	if (progressiveNextTile >= numTiles) {
+		std::swap(progressiveTarget[0], progressiveTarget[1]);
+		progressiveHasImage = true;
+		StartProgressivePass();
+	}
+
+	// Present the last complete image (the partial one until the first pass is done)
+	progressiveTarget[progressiveHasImage ? 1 : 0].BlitToScreen(Width, Height);
+}
 
+void DisplayWindowInfo::RenderDeferred()
+{
+	if (marchProgramStale) {
+		GLuint newProgramID = LoadShaders("DisplayWindow.vertexshader", AppState::OutputMarchShaderName.c_str());
+		glDeleteProgram(marchProgramID);
+		marchProgramID = newProgramID;
+		marchTimeID = glGetUniformLocation(marchProgramID, "time");
+		marchResolutionID = glGetUniformLocation(marchProgramID, "resolution");
+		marchCameraUniforms.Locate(marchProgramID);
+		glUseProgram(marchProgramID);
+		bakedTextures.SetSamplers(marchProgramID);
+		marchProgramStale = false;
+		gbufferValid = false;
+	}
+	if (needReloadShading) {
+		LoadShadingProgram();
+		needReloadShading = false;
+	}
+	// nothing generated yet (reference shader)
+	if (!marchProgramID) {
+		RenderDirect();
+		return;
+	}
+
+	if (Width <= 0 || Height <= 0)
+		return;
+	if (!gbufferTarget.Matches(Width, Height)) {
+		gbufferTarget.Setup(Width, Height, GL_RGBA32F, 2);
+		gbufferValid = false;
+	}
+
+	// March pass: only when what the rays see has changed
+	float time = GetSceneTime();
+	if (!gbufferValid || time != gbufferTime) {
+		glUseProgram(marchProgramID);
+		gbufferTarget.Bind();
+		glUniform2f(marchResolutionID, Width, Height);
+		glUniform1f(marchTimeID, time);
+		marchCameraUniforms.Set(Camera::Orbit(time));
+		DrawQuad();
+
+		gbufferValid = true;
+		gbufferTime = time;
+	}
+
+	// Shading pass (same camera as the march pass)
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, Width, Height);
+	glUseProgram(shadingProgramID);
+	glm::vec3 cameraPos = Camera::Orbit(time).position;
+	glUniform3f(shadingCameraPosID, cameraPos.x, cameraPos.y, cameraPos.z);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gbufferTarget.textures[0]);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gbufferTarget.textures[1]);
+	DrawQuad();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glUseProgram(programID);
+}
+
+void DisplayWindowInfo::RenderCompute()
+{
+	if (computeSupported && computeProgramStale) {
+		GLuint newProgramID = LoadComputeShader(AppState::OutputComputeShaderName.c_str());
+		glDeleteProgram(computeProgramID);
+		computeProgramID = newProgramID;
+		computeTimeID = glGetUniformLocation(computeProgramID, "time");
+		computeResolutionID = glGetUniformLocation(computeProgramID, "resolution");
+		computeTileCountID = glGetUniformLocation(computeProgramID, "tileCount");
+		computeCameraUniforms.Locate(computeProgramID);
+		glUseProgram(computeProgramID);
+		bakedTextures.SetSamplers(computeProgramID);
+		computeProgramStale = false;
+	}
+	// no 4.3 context, or nothing generated yet (reference shader)
+	if (!computeProgramID) {
+		RenderDirect();
+		return;
+	}
+
+	if (Width <= 0 || Height <= 0)
+		return;
+	if (!computeTarget.Matches(Width, Height))
+		computeTarget.Setup(Width, Height, GL_RGBA8);
+
+	int tilesX = (Width + CodeGenManager::ComputeTileSize - 1) / CodeGenManager::ComputeTileSize;
+	int tilesY = (Height + CodeGenManager::ComputeTileSize - 1) / CodeGenManager::ComputeTileSize;
+
+	// reset the work queue
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, computeTileQueue);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(computeProgramID);
+	glUniform2f(computeResolutionID, Width, Height);
+	float time = GetSceneTime();
+	glUniform1f(computeTimeID, time);
+	computeCameraUniforms.Set(Camera::Orbit(time));
+	glUniform2i(computeTileCountID, tilesX, tilesY);
+	glBindImageTexture(0, computeTarget.textures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, computeTileQueue);
+
+	glDispatchCompute(std::min(tilesX * tilesY, ComputePersistentGroups), 1, 1);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	computeTarget.BlitToScreen(Width, Height);
+	glUseProgram(programID);
+}
+
+void DisplayWindowInfo::RenderSweep()
+{
+	if (sweepProgramStale) {
+		GLuint newProgramID = LoadShaders(AppState::OutputSweepVertexShaderName.c_str(), AppState::OutputSweepShaderName.c_str());
+		glDeleteProgram(sweepProgramID);
+		sweepProgramID = newProgramID;
+		sweepTimeID = glGetUniformLocation(sweepProgramID, "time");
+		sweepResolutionID = glGetUniformLocation(sweepProgramID, "screenResolution");
+		sweepGridID = glGetUniformLocation(sweepProgramID, "sweepGrid");
+		sweepParamsID = glGetUniformLocation(sweepProgramID, "sweepParams");
+		sweepCameraUniforms.Locate(sweepProgramID);
+		glUseProgram(sweepProgramID);
+		bakedTextures.SetSamplers(sweepProgramID);
+		sweepProgramStale = false;
+	}
+	// nothing generated yet (reference shader)
+	if (!sweepProgramID) {
+		RenderDirect();
+		return;
+	}
+
+	// per-instance params: row-major from the top-left tile
+	const int gridX = CodeGenManager::SweepGridX, gridY = CodeGenManager::SweepGridY;
+	int numInstances = gridX * gridY;
+	int numParams = (int)sweepBaseParams.size();
+	// padded to the vec4 elements of the uniform
+	std::vector<float> instanceParams((numInstances * numParams + 3) / 4 * 4, 0.0f);
+	for (int i = 0; i < numInstances; i++) {
+		float *p = numParams ? &instanceParams[i * numParams] : NULL;
+		std::copy(sweepBaseParams.begin(), sweepBaseParams.end(), p);
+		if (numParams > 0) p[0] *= 1.0f + SweepRange * (2.0f * (i % gridX) / (gridX - 1) - 1.0f);
+		if (numParams > 1) p[1] *= 1.0f + SweepRange * (2.0f * (i / gridX) / (gridY - 1) - 1.0f);
+	}
+
+	glViewport(0, 0, Width, Height);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(sweepProgramID);
+	glUniform2f(sweepResolutionID, Width, Height);
+	float time = GetSceneTime();
+	glUniform1f(sweepTimeID, time);
+	sweepCameraUniforms.Set(Camera::Orbit(time));
+	glUniform2i(sweepGridID, gridX, gridY);
+	if (numParams)
+		glUniform4fv(sweepParamsID, (int)instanceParams.size() / 4, &instanceParams[0]);
+
+	// one instance per tile
 	glBindVertexArray(vertexarrayobject);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // draw quad (2 triangles)
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numInstances);
 	glBindVertexArray(0);
 
-	glfwSwapBuffers(window);
+	glUseProgram(programID);
+}
+
+// normalized screen rectangle (origin at the bottom-left) and resolution scale of each view
+struct MultiView {
+	float x, y, w, h;
+	float resolutionScale;
+};
+
+static const MultiView MultiViews[] = {
+	{ 0.0f, 0.5f, 0.5f, 0.5f, 1.0f }, // orbit
+	{ 0.5f, 0.5f, 0.5f, 0.5f, 0.5f }, // front
+	{ 0.0f, 0.0f, 0.5f, 0.5f, 0.5f }, // top
+	{ 0.5f, 0.0f, 0.5f, 0.5f, 0.5f }, // side
+};
+
+static Camera MultiViewCamera(int view, float time)
+{
+	switch (view) {
+	case 1: return Camera::LookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	case 2: return Camera::LookAt(glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	case 3: return Camera::LookAt(glm::vec3(5.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	default: return Camera::Orbit(time);
+	}
+}
+
+void DisplayWindowInfo::RenderMultiView()
+{
+	if (Width <= 0 || Height <= 0)
+		return;
+	if (!multiviewTarget.Matches(Width, Height))
+		multiviewTarget.Setup(Width, Height);
+
+	// per-frame uniforms are shared by all views
+	float time = GetSceneTime();
+	multiviewTarget.Bind();
+	glClear(GL_COLOR_BUFFER_BIT);
+	glUniform1f(timeID, time);
+	SetAntiAliasingUniforms(0.0f, 0.0f);
+
+	// each view renders its scaled-down image in the corner of its own rectangle
+	int numViews = sizeof(MultiViews) / sizeof(MultiViews[0]);
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < numViews; i++) {
+		const MultiView &view = MultiViews[i];
+		int x = (int)(view.x * Width), y = (int)(view.y * Height);
+		int w = std::max(1, (int)(view.w * Width * view.resolutionScale)), h = std::max(1, (int)(view.h * Height * view.resolutionScale));
+		glViewport(x, y, w, h);
+		glScissor(x, y, w, h);
+		glUniform2f(resolutionID, w, h);
+		glUniform2f(tileOriginID, -x, -y); // gl_FragCoord is relative to the target, not the viewport
+		cameraUniforms.Set(MultiViewCamera(i, time));
+		DrawQuad();
+	}
+	glDisable(GL_SCISSOR_TEST);
+	glUniform2f(tileOriginID, 0.0f, 0.0f);
+
+	// scale every view to its rectangle
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, multiviewTarget.framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glViewport(0, 0, Width, Height);
+	glClear(GL_COLOR_BUFFER_BIT);
+	for (int i = 0; i < numViews; i++) {
+		const MultiView &view = MultiViews[i];
+		int x = (int)(view.x * Width), y = (int)(view.y * Height);
+		int w = (int)(view.w * Width), h = (int)(view.h * Height);
+		int sw = std::max(1, (int)(w * view.resolutionScale)), sh = std::max(1, (int)(h * view.resolutionScale));
+		glBlitFramebuffer(x, y, x + sw, y + sh, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, (sw == w && sh == h) ? GL_NEAREST : GL_LINEAR);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DisplayWindowInfo::RenderSlice()
+{
+	// the scene of the last compilation, as the preview and the picking
+	mtx_lock(&previewSceneMutex);
+	if (sliceSceneStale) {
+		slice.SetScene(previewScene);
+		sliceSceneStale = false;
+	}
+	mtx_unlock(&previewSceneMutex);
+
+	slice.Draw(Width, Height);
+}
+
+bool DisplayWindowInfo::PickRay(double cursorX, double cursorY, glm::vec3 &origin, glm::vec3 &dir)
+{
+	// window coordinates (origin at the top-left) to gl_FragCoord of the full window
+	glm::vec2 fragCoord((float)cursorX, (float)(Height - cursorY));
+	glm::vec2 resolution((float)Width, (float)Height);
+	float time = GetSceneTime();
+	Camera camera = Camera::Orbit(time);
+
+	if (renderMode == MULTIVIEW) {
+		// the view under the cursor, its camera sees its rectangle (the ray direction ignores the resolution scale)
+		int numViews = sizeof(MultiViews) / sizeof(MultiViews[0]);
+		int i = 0;
+		for (; i < numViews; i++) {
+			const MultiView &view = MultiViews[i];
+			glm::vec2 viewOrigin(view.x * Width, view.y * Height), viewSize(view.w * Width, view.h * Height);
+			if (fragCoord.x >= viewOrigin.x && fragCoord.x < viewOrigin.x + viewSize.x &&
+				fragCoord.y >= viewOrigin.y && fragCoord.y < viewOrigin.y + viewSize.y) {
+				fragCoord -= viewOrigin;
+				resolution = viewSize;
+				camera = MultiViewCamera(i, time);
+				break;
+			}
+		}
+		if (i == numViews)
+			return false;
+	}
+	else if (renderMode == SWEEP) {
+		// every tile shows the whole scene (with other params: the pick is approximate)
+		resolution = glm::vec2((float)Width / CodeGenManager::SweepGridX, (float)Height / CodeGenManager::SweepGridY);
+		fragCoord = glm::vec2(std::fmod(fragCoord.x, resolution.x), std::fmod(fragCoord.y, resolution.y));
+	}
+
+	origin = camera.position;
+	dir = camera.RayDirection(fragCoord, resolution);
+	return Width > 0 && Height > 0;
+}
+
+void DisplayWindowInfo::Pick(double cursorX, double cursorY)
+{
+	glm::vec3 origin, dir;
+	if (!PickRay(cursorX, cursorY, origin, dir))
+		return;
+
+	// the scene of the last compilation (what is on screen)
+	if (!pickQuery)
+		pickQuery = new SdfQuery(1);
+	mtx_lock(&previewSceneMutex);
+	pickQuery->scene = previewScene;
+	mtx_unlock(&previewSceneMutex);
+
+	RayHit hit;
+	pickQuery->RayCast(&origin, &dir, 1, &hit);
+
+	BlockGraph &graph = BlockGraph::getInstance();
+	if (hit.blockId >= 0)
+		printf("Picked block %d at (%.3f, %.3f, %.3f), t = %.3f\n", hit.blockId, hit.position.x, hit.position.y, hit.position.z, hit.t);
+	if (hit.blockId != graph.highlightedBlock) {
+		graph.highlightedBlock = hit.blockId;
+		DiagramWindowInfo::getInstance().RequestRedraw();
+	}
+}
+
+void DisplayWindowInfo::PickSlice(double cursorX, double cursorY)
+{
+	glm::vec3 p = slice.GetPlane().Point(glm::vec2((float)cursorX, (float)(Height - cursorY)), Width, Height);
+	mtx_lock(&previewSceneMutex);
+	glm::vec2 hit = previewScene.IsEmpty() ? glm::vec2(0.0f, -1.0f) : previewScene.DistanceId(p);
+	mtx_unlock(&previewSceneMutex);
+
+	BlockGraph &graph = BlockGraph::getInstance();
+	int blockId = (int)hit.y;
+	printf("Slice point (%.4f, %.4f, %.4f): distance %g, block %d\n", p.x, p.y, p.z, hit.x, blockId);
+	if (blockId != graph.highlightedBlock) {
+		graph.highlightedBlock = blockId;
+		DiagramWindowInfo::getInstance().RequestRedraw();
+	}
 }
 
 void DisplayWindowInfo::RenderTerm()
 {
+	// Cleanup offscreen targets
+	temporalTarget.Destroy();
+	progressiveTarget[0].Destroy();
+	progressiveTarget[1].Destroy();
+	gbufferTarget.Destroy();
+	glDeleteProgram(marchProgramID);
+	glDeleteProgram(shadingProgramID);
+	computeTarget.Destroy();
+	glDeleteProgram(computeProgramID);
+	glDeleteBuffers(1, &computeTileQueue);
+	glDeleteProgram(sweepProgramID);
+	multiviewTarget.Destroy();
+	bakedTextures.Destroy();
+	preview.Destroy();
+	slice.Destroy();
+	shaderLoader.Stop();
+	if (recorder)
+		StopRecording();
+	glDeleteQueries(1, &progressiveTimerQuery);
+
 	// Cleanup VBO
 	glDeleteBuffers(1, &vertexbuffer);
 	glDeleteVertexArrays(1, &vertexarrayobject);
@@ -13,6 +13,16 @@
 #include <GLFW/glfw3.h>
 
 #include "mathutil.hpp"
+#include "offscreentarget.hpp"
+#include "frameexporter.hpp"
+#include "camera.hpp"
+#include "cpuscene.hpp"
+#include "cpupreview.hpp"
+#include "sliceview.hpp"
+#include "sdfquery.hpp"
+#include "brickmap.hpp"
+#include "asyncshaderloader.hpp"
+#include "tinythread.hpp"
 
 class WindowInfo {
 
@@ -27,10 +37,12 @@ public:
 
 	int Height;
 	int Width;
+	int Samples; // MSAA samples of the default framebuffer (0: none)
+	int ContextMajor, ContextMinor; // preferred context version (3.3 core is the fallback)
 	GLFWwindow *window;
 
 protected:
-	WindowInfo(int w, int h); // always subclassing
+	WindowInfo(int w, int h, int samples); // always subclassing
 };
 
 class DisplayWindowInfo : public WindowInfo {
@@ -41,27 +53,171 @@ public:
 		return instance;
 	}
 
+	// DIRECT: one fullscreen draw per frame; PROGRESSIVE: scissored tiles accumulated across frames
+	// DEFERRED: generated march pass into a G-buffer, separate (cheap) shading pass
+	// COMPUTE: generated compute shader marching screen tiles (needs a 4.3 context)
+	// SWEEP: contact sheet of parameter variants, one instanced draw
+	// MULTIVIEW: orbit, front, top and side cameras side by side, one program
+	// SLICE: cross-section of the distance field of the last compilation, refined on the CPU
+	enum RenderMode { DIRECT, PROGRESSIVE, DEFERRED, COMPUTE, SWEEP, MULTIVIEW, SLICE };
+	// Anti-aliasing done by the generated shader (the fullscreen quad has no geometric edges for MSAA)
+	// ADAPTIVE: extra rays where neighbouring hits differ; TEMPORAL: jittered accumulation while time is paused
+	enum AntiAliasing { AA_NONE, AA_ADAPTIVE, AA_TEMPORAL };
+	static const int TemporalMaxFrames = 64;
+	static const int ComputePersistentGroups = 128; // resident workgroups draining the tile queue
+	// sweep: the first block param varies along x, the second along y, by +-SweepRange
+	// (CodeGenManager::SweepGridX by SweepGridY tiles)
+	static const float SweepRange;
+
+	// slice: arrows and page up/down move the plane by these many pixels
+	static const int SlicePanPixels = 80;
+	static const int SliceStepPixels = 10;
+	static const float SliceZoomFactor; // per scroll step
+
+	static const int ProgressiveTileSize = 128;
+	static const double ProgressiveFrameBudgetMs; // gpu time spent on tiles per frame
+
 	virtual void SetupRC();
 	virtual void RenderInit();
 	virtual void Render();
 	virtual void RenderTerm();
+	virtual void DestroyRC();
+
+	// main thread, after codegen: link the new program, show a CPU preview of previewScene meanwhile;
+	// bakes: brick maps the new program samples (CodeGenManager::GetBakes())
+	void RequestShaderUpdate(const CpuScene &previewScene, const std::vector<BakedVolume> &bakes);
 
 	bool needUpdateShader;
+	bool needReloadShading; // lighting tweak: re-run the shading pass only
+	RenderMode renderMode;
+	AntiAliasing antiAliasing;
+
+	// Scene time control (SPACE): a paused scene is a static camera
+	void SetTimePaused(bool paused);
+	bool timePaused;
+	float pausedTime;
+
+	// Frame sequence export (R): fixed timestep, files named after the --out pattern
+	bool needToggleRecording;
 
 private:
-	DisplayWindowInfo(int w, int h) : WindowInfo(w, h) { needUpdateShader = false; }
+	DisplayWindowInfo(int w, int h) : WindowInfo(w, h, 0) { ContextMajor = 4; ContextMinor = 3; needUpdateShader = false; mtx_init(&previewSceneMutex, mtx_plain); needReloadShading = false; needToggleRecording = false; recorder = NULL; pickQuery = NULL; bakesChanged = false; sliceSceneStale = true; renderMode = DIRECT; antiAliasing = AA_ADAPTIVE; timePaused = false; pausedTime = 0.0f; }
 
 	static void key_callback(GLFWwindow* DisplayWindow, int key, int scancode, int action, int mods);
 	static void resize_callback(GLFWwindow *DisplayWindow, int width, int height);
+	static void mousebutton_callback(GLFWwindow *DisplayWindow, int button, int action, int mods);
+	static void mousescroll_callback(GLFWwindow *DisplayWindow, double xoffset, double yoffset);
 
 	GLuint programID;
 	GLuint timeID;
 	GLuint resolutionID;
+	GLuint aaModeID;
+	GLuint jitterID;
+	GLuint tileOriginID;
+	CameraUniforms cameraUniforms;
 	GLuint vertexbuffer;
 	GLuint vertexarrayobject;
 
 	// Update shader after compilation
 	void UpdateShader(std::string fileName);
+	void InstallProgram(GLuint newProgramID);
+	void GetUniformLocations();
+
+	float GetSceneTime();
+	void SetAntiAliasingUniforms(float jitterX, float jitterY);
+	void DrawQuad();
+
+	void RenderDirect();
+	void RenderTemporal();
+	void RenderProgressive();
+	void RenderDeferred();
+	void RenderCompute();
+	void RenderSweep();
+	void RenderMultiView();
+	void RenderSlice();
+
+	// Temporal accumulation data
+	OffscreenTarget temporalTarget;
+	int temporalFrames; // frames blended into temporalTarget (0: restart)
+
+	// Progressive rendering data ([0] is accumulating, [1] holds the last complete image)
+	void StartProgressivePass();
+
+	OffscreenTarget progressiveTarget[2];
+	GLuint progressiveTimerQuery;
+	int progressiveNextTile;
+	int progressiveQueryTiles; // tiles measured by the pending timer query (0: none pending)
+	double progressiveTileCostMs; // running estimate of the gpu cost of one tile
+	float progressiveTime; // scene time, frozen for the whole pass
+	bool progressiveHasImage;
+
+	// Deferred shading data (the march program is compiled on first use after codegen)
+	void LoadShadingProgram();
+
+	GLuint marchProgramID;
+	GLuint marchTimeID;
+	GLuint marchResolutionID;
+	CameraUniforms marchCameraUniforms;
+	bool marchProgramStale;
+	GLuint shadingProgramID;
+	GLuint shadingCameraPosID;
+	OffscreenTarget gbufferTarget; // [0] hit position & t, [1] normal & block id
+	bool gbufferValid;
+	float gbufferTime;
+
+	// Compute backend data
+	bool computeSupported;
+	GLuint computeProgramID;
+	GLuint computeTimeID;
+	GLuint computeResolutionID;
+	GLuint computeTileCountID;
+	CameraUniforms computeCameraUniforms;
+	bool computeProgramStale;
+	GLuint computeTileQueue; // SSBO holding the next tile index
+	OffscreenTarget computeTarget;
+
+	// Parameter sweep data
+	GLuint sweepProgramID;
+	GLuint sweepTimeID;
+	GLuint sweepResolutionID;
+	GLuint sweepGridID;
+	GLuint sweepParamsID;
+	CameraUniforms sweepCameraUniforms;
+	bool sweepProgramStale;
+	std::vector<float> sweepBaseParams; // block params of the generated program
+
+	// Multi-viewport data (views are rendered at their own resolution, then scaled to the screen)
+	OffscreenTarget multiviewTarget;
+
+	// Slice data (X): TAB cycles the normal axis, M the coloring, the scroll wheel zooms at the cursor
+	void SliceKey(int key);
+	void PickSlice(double cursorX, double cursorY); // distance & contributing block under the cursor
+
+	SliceView slice;
+	bool sliceSceneStale; // guarded by previewSceneMutex
+
+	// Shader update data: the program is linked by shaderLoader (when a shared context exists)
+	// while the preview of the new scene is shown
+	AsyncShaderLoader shaderLoader;
+	CpuPreview preview;
+	mtx_t previewSceneMutex;
+	CpuScene previewScene; // guarded by previewSceneMutex
+	std::vector<BakedVolume> pendingBakes; // guarded by previewSceneMutex, uploaded with the new program
+	bool bakesChanged;
+	BakedTextures bakedTextures;
+
+	// Picking (left click): one ray cast on the compiled scene, the hit block is highlighted in the diagram
+	void Pick(double cursorX, double cursorY);
+	bool PickRay(double cursorX, double cursorY, glm::vec3 &origin, glm::vec3 &dir);
+
+	SdfQuery *pickQuery; // created on the first click
+
+	// Recording data
+	void StartRecording();
+	void StopRecording();
+
+	FrameExporter *recorder; // NULL: not recording
+	float recordStartTime;
 };
 
 
@@ -101,6 +257,7 @@ public:
 	static void stopPortDragging(GLFWwindow *DisplayWindow);
 
 	static void startCompiling(GLFWwindow *DisplayWindow);
+	static void compileGraph(); // codegen, then the display window reloads the shaders (also when a bake finished)
 	static void doCompiling(GLFWwindow *DisplayWindow);
 	static void stopCompiling(GLFWwindow *DisplayWindow);
 
@@ -121,10 +278,13 @@ public:
 	}
 
 	virtual void SetupRC();
+	virtual void DestroyRC(); // stops the thumbnail workers
 	virtual void RenderInit();
 	virtual void Render();
 	virtual void RenderTerm() {};
 
+	void RequestRedraw() { needRedrawDiagram = true; } // e.g. the highlighted block changed
+
 	GLuint programID;
 	GLuint drawcolorID;
 	GLuint mvpID;
@@ -132,7 +292,7 @@ public:
 	GLuint shadertypeID;
 
 private:
-	DiagramWindowInfo(int w, int h) : WindowInfo(w, h) { }
+	DiagramWindowInfo(int w, int h) : WindowInfo(w, h, 4) { } // modest MSAA for lines and text
 
 	void updateMVPIfNeeded();
 	bool needRedraw();
@@ -0,0 +1,203 @@
+#include "workerpool.hpp"
+
+#include <algorithm>
+#include <thread>
+
+WorkerPool::WorkerPool(int numThreads) :
+	unclaimedChunks(0), process(NULL), ordered(false), busyWorkers(0),
+	numChunks(0), nextChunk(0), nextConsume(0), maxAhead(0), busyChunks(0), stopping(false)
+{
+	mtx_init(&mutex, mtx_plain);
+	cnd_init(&workAvailable);
+	cnd_init(&chunkDone);
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int i = 0; i < numThreads; i++) {
+		Thread *thread = new Thread();
+		thread->pool = this;
+		thread->index = (int)threads.size();
+		mtx_init(&thread->mutex, mtx_plain);
+		if (thrd_create(&thread->thread, WorkerThreadMain, thread) != thrd_success) {
+			mtx_destroy(&thread->mutex);
+			delete thread;
+			break;
+		}
+		threads.push_back(thread);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	mtx_lock(&mutex);
+	stopping = true;
+	cnd_broadcast(&workAvailable);
+	mtx_unlock(&mutex);
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		int result;
+		thrd_join((*it)->thread, &result);
+		mtx_destroy(&(*it)->mutex);
+		delete *it;
+	}
+
+	cnd_destroy(&chunkDone);
+	cnd_destroy(&workAvailable);
+	mtx_destroy(&mutex);
+}
+
+void WorkerPool::Run(int numChunks, const ChunkFunction &process) {
+	if (numChunks <= 0)
+		return;
+	if (threads.empty()) {
+		// no worker could be started: everything on the calling thread
+		for (int chunk = 0; chunk < numChunks; chunk++)
+			process(chunk, 0);
+		return;
+	}
+
+	// each worker starts with a contiguous range
+	int numWorkers = (int)threads.size();
+	for (int i = 0; i < numWorkers; i++) {
+		Thread &thread = *threads[i];
+		mtx_lock(&thread.mutex);
+		for (int chunk = (int)((long long)numChunks * i / numWorkers); chunk < (long long)numChunks * (i + 1) / numWorkers; chunk++)
+			thread.chunks.push_back(chunk);
+		mtx_unlock(&thread.mutex);
+	}
+
+	mtx_lock(&mutex);
+	this->process = &process;
+	ordered = false;
+	unclaimedChunks = numChunks;
+	cnd_broadcast(&workAvailable);
+	// every chunk is taken once the ranges are empty, the workers only have to leave process()
+	while (unclaimedChunks > 0 || busyWorkers > 0)
+		cnd_wait(&chunkDone, &mutex);
+	this->process = NULL;
+	mtx_unlock(&mutex);
+}
+
+void WorkerPool::Run(int numChunks, const ChunkFunction &process, const ConsumeFunction &consume, int maxAhead) {
+	if (numChunks <= 0)
+		return;
+	if (threads.empty()) {
+		// no worker could be started: everything on the calling thread
+		for (int chunk = 0; chunk < numChunks; chunk++) {
+			process(chunk, 0);
+			if (consume)
+				consume(chunk);
+		}
+		return;
+	}
+
+	mtx_lock(&mutex);
+	this->process = &process;
+	ordered = true;
+	this->numChunks = numChunks;
+	this->maxAhead = maxAhead > 0 ? maxAhead : numChunks;
+	nextChunk = 0;
+	nextConsume = 0;
+	processed.assign(numChunks, 0);
+	cnd_broadcast(&workAvailable);
+
+	for (int chunk = 0; chunk < numChunks; chunk++) {
+		while (!processed[chunk])
+			cnd_wait(&chunkDone, &mutex);
+		// the workers may run ahead of this chunk as soon as it is taken
+		nextConsume = chunk + 1;
+		if (this->maxAhead < numChunks)
+			cnd_broadcast(&workAvailable);
+		if (consume) {
+			mtx_unlock(&mutex);
+			consume(chunk);
+			mtx_lock(&mutex);
+		}
+	}
+	// every chunk is processed, the workers only have to leave process()
+	while (busyChunks > 0)
+		cnd_wait(&chunkDone, &mutex);
+	this->process = NULL;
+	mtx_unlock(&mutex);
+}
+
+void WorkerPool::Post(const Task &task) {
+	mtx_lock(&mutex);
+	tasks.push_back(task);
+	cnd_signal(&workAvailable);
+	mtx_unlock(&mutex);
+}
+
+bool WorkerPool::NextChunk(Thread &thread, int &chunk) {
+	bool found = false;
+	mtx_lock(&thread.mutex);
+	if (!thread.chunks.empty()) {
+		chunk = thread.chunks.front();
+		thread.chunks.pop_front();
+		found = true;
+	}
+	mtx_unlock(&thread.mutex);
+
+	// steal the chunk farthest from where the victim is working
+	for (int i = 1; !found && i < (int)threads.size(); i++) {
+		Thread &victim = *threads[(thread.index + i) % threads.size()];
+		mtx_lock(&victim.mutex);
+		if (!victim.chunks.empty()) {
+			chunk = victim.chunks.back();
+			victim.chunks.pop_back();
+			found = true;
+		}
+		mtx_unlock(&victim.mutex);
+	}
+	if (found)
+		unclaimedChunks--;
+	return found;
+}
+
+int WorkerPool::WorkerThreadMain(void *data) {
+	Thread *thread = (Thread *)data;
+	WorkerPool *pool = thread->pool;
+
+	mtx_lock(&pool->mutex);
+	for (;;) {
+		if (pool->process && !pool->ordered && pool->unclaimedChunks > 0) {
+			pool->busyWorkers++;
+			const ChunkFunction &process = *pool->process;
+			mtx_unlock(&pool->mutex);
+
+			int chunk;
+			while (pool->NextChunk(*thread, chunk))
+				process(chunk, thread->index);
+
+			// every chunk has been taken, and ours are done
+			mtx_lock(&pool->mutex);
+			if (--pool->busyWorkers == 0)
+				cnd_signal(&pool->chunkDone);
+		}
+		else if (pool->process && pool->ordered && pool->nextChunk < pool->numChunks && pool->nextChunk < pool->nextConsume + pool->maxAhead) {
+			int chunk = pool->nextChunk++;
+			pool->busyChunks++;
+			mtx_unlock(&pool->mutex);
+
+			(*pool->process)(chunk, thread->index);
+
+			mtx_lock(&pool->mutex);
+			pool->busyChunks--;
+			pool->processed[chunk] = 1;
+			cnd_signal(&pool->chunkDone);
+		}
+		else if (!pool->tasks.empty()) {
+			Task task;
+			task.swap(pool->tasks.front());
+			pool->tasks.pop_front();
+			mtx_unlock(&pool->mutex);
+
+			task(thread->index);
+
+			mtx_lock(&pool->mutex);
+		}
+		else if (pool->stopping)
+			break;
+		else cnd_wait(&pool->workAvailable, &pool->mutex);
+	}
+	mtx_unlock(&pool->mutex);
+	return 0;
+}
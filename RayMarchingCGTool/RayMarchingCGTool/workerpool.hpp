@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include "tinythread.hpp"
+
+// Worker threads of the CPU paths.
+// Run() spreads numbered chunks over the workers: each starts on its own contiguous range of chunks
+// and steals from the far end of the others' ranges once it runs dry, so neighbouring chunks mostly
+// share a worker. The ordered Run() hands the chunks back to the calling thread in order, at most
+// maxAhead chunks past the one it consumes: the exporters write while the workers sample, with
+// bounded memory. Post() queues tasks for the background users, which never wait for them.
+// Chunks of a Run come before the queued tasks. Each callback gets the index of its worker, for
+// per-worker scratch buffers and partial results.
+class WorkerPool {
+
+public:
+	typedef std::function<void(int chunk, int worker)> ChunkFunction;
+	typedef std::function<void(int chunk)> ConsumeFunction;
+	typedef std::function<void(int worker)> Task;
+
+	explicit WorkerPool(int numThreads); // 0: one per core
+	~WorkerPool(); // runs the queued tasks, then joins
+
+	int NumThreads() const { return (int)threads.size(); }
+
+	// one Run at a time: process(chunk, worker) for every chunk on the workers, in any order.
+	// Returns when every chunk is processed.
+	void Run(int numChunks, const ChunkFunction &process);
+
+	// process(chunk, worker) on the workers, consume(chunk) on the calling thread in chunk order once
+	// processed; maxAhead: 0 for no limit. Returns when every chunk is consumed.
+	void Run(int numChunks, const ChunkFunction &process, const ConsumeFunction &consume, int maxAhead = 0);
+
+	// any thread: task(worker) runs on a worker, in posting order
+	void Post(const Task &task);
+
+private:
+	struct Thread {
+		WorkerPool *pool;
+		int index;
+		thrd_t thread;
+		mtx_t mutex; // guards chunks
+		std::deque<int> chunks; // range of an unordered Run: the owner pops the front, thieves the back
+	};
+
+	static int WorkerThreadMain(void *data);
+	bool NextChunk(Thread &thread, int &chunk);
+
+	std::vector<Thread *> threads;
+	std::atomic<int> unclaimedChunks; // still in the ranges
+
+	// everything below is guarded by mutex
+	mtx_t mutex;
+	cnd_t workAvailable; // a chunk, a task, the consumer moved on, or stopping
+	cnd_t chunkDone;
+	const ChunkFunction *process; // NULL: no Run
+	bool ordered;
+	int busyWorkers; // unordered: still taking chunks
+	int numChunks, nextChunk, nextConsume, maxAhead; // ordered
+	int busyChunks; // ordered: taken and not processed yet
+	std::vector<char> processed; // ordered: per chunk
+	std::deque<Task> tasks;
+	bool stopping;
+};
+
+
+#endif